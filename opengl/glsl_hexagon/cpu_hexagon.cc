@@ -0,0 +1,393 @@
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "cpu_hexagon.h"
+
+enum {
+        PHASE_CELLS,
+        PHASE_TILES,
+};
+
+/*****************************************************************************
+ * Frame
+ ****************************************************************************/
+/* the scene texel at (x, y), clamped like GL_CLAMP_TO_EDGE */
+static inline const uint8_t *sceneTexel(const CpuHexagon *hex, int x, int y) {
+        x = x < 0 ? 0 : (x >= hex->width ? hex->width - 1 : x);
+        y = y < 0 ? 0 : (y >= hex->height ? hex->height - 1 : y);
+        /* the rotate stage turns the frame by 180 degrees */
+        int u = hex->width - 1 - x;
+        int v = hex->height - 1 - y;
+        return hex->bgr + ((size_t)v * hex->width + u) * 3;
+}
+
+/* the gray half darkens in bands of 1/50 of the frame, see bg_color() */
+static inline float grayFalloff(const CpuHexagon *hex, float px, float py) {
+        float radius = fmaxf(px / hex->width, py / hex->height);
+        return powf(0.947f, floorf(radius * 50.0f));
+}
+
+/*****************************************************************************
+ * Cells: the center and 20 spiral samples, four at a time
+ ****************************************************************************/
+#ifdef __SSE2__
+static inline __m128 floorPs(__m128 x) {
+        __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x),
+                _mm_set1_ps(1.0f)));
+}
+
+static void averageCell(const CpuHexagon *hex, float ox, float oy,
+        float *out)
+{
+        const __m128 max_x = _mm_set1_ps(hex->width - 1);
+        const __m128 max_y = _mm_set1_ps(hex->height - 1);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 level = _mm_set1_ps(255.0f);
+        const __m128 third = _mm_set1_ps(1.0f / 3.0f);
+        __m128 sum_r = zero, sum_g = zero, sum_b = zero, sum_gray = zero;
+
+        for (int s = 0; s < CPU_HEXAGON_PADDED; s += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps(ox),
+                        _mm_loadu_ps(hex->sample_x + s));
+                __m128 py = _mm_add_ps(_mm_set1_ps(oy),
+                        _mm_loadu_ps(hex->sample_y + s));
+                __m128 weight = _mm_loadu_ps(hex->sample_weight + s);
+
+                /* clamped first, truncating is flooring then */
+                int tx[4], ty[4];
+                _mm_storeu_si128((__m128i *)tx, _mm_cvttps_epi32(
+                        _mm_min_ps(_mm_max_ps(px, zero), max_x)));
+                _mm_storeu_si128((__m128i *)ty, _mm_cvttps_epi32(
+                        _mm_min_ps(_mm_max_ps(py, zero), max_y)));
+                const uint8_t *t0 = sceneTexel(hex, tx[0], ty[0]);
+                const uint8_t *t1 = sceneTexel(hex, tx[1], ty[1]);
+                const uint8_t *t2 = sceneTexel(hex, tx[2], ty[2]);
+                const uint8_t *t3 = sceneTexel(hex, tx[3], ty[3]);
+                __m128 r = _mm_div_ps(_mm_set_ps(t3[2], t2[2], t1[2], t0[2]),
+                        level);
+                __m128 g = _mm_div_ps(_mm_set_ps(t3[1], t2[1], t1[1], t0[1]),
+                        level);
+                __m128 b = _mm_div_ps(_mm_set_ps(t3[0], t2[0], t1[0], t0[0]),
+                        level);
+                sum_r = _mm_add_ps(sum_r, _mm_mul_ps(r, weight));
+                sum_g = _mm_add_ps(sum_g, _mm_mul_ps(g, weight));
+                sum_b = _mm_add_ps(sum_b, _mm_mul_ps(b, weight));
+
+                __m128 gray = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, third),
+                        _mm_mul_ps(g, third)), _mm_mul_ps(b, third));
+                __m128 radius = _mm_max_ps(
+                        _mm_div_ps(px, _mm_set1_ps(hex->width)),
+                        _mm_div_ps(py, _mm_set1_ps(hex->height)));
+                float coeff[4];
+                _mm_storeu_ps(coeff, floorPs(_mm_mul_ps(radius,
+                        _mm_set1_ps(50.0f))));
+                __m128 falloff = _mm_set_ps(powf(0.947f, coeff[3]),
+                        powf(0.947f, coeff[2]), powf(0.947f, coeff[1]),
+                        powf(0.947f, coeff[0]));
+                sum_gray = _mm_add_ps(sum_gray, _mm_mul_ps(
+                        _mm_mul_ps(gray, falloff), weight));
+        }
+
+        /* transpose so one add sums the lanes of all four */
+        _MM_TRANSPOSE4_PS(sum_r, sum_g, sum_b, sum_gray);
+        __m128 sum = _mm_add_ps(_mm_add_ps(sum_r, sum_g),
+                _mm_add_ps(sum_b, sum_gray));
+        _mm_storeu_ps(out, _mm_div_ps(sum,
+                _mm_set1_ps(CPU_HEXAGON_SAMPLES)));
+}
+#else
+static void averageCell(const CpuHexagon *hex, float ox, float oy,
+        float *out)
+{
+        float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int s = 0; s < CPU_HEXAGON_SAMPLES; s++) {
+                float px = ox + hex->sample_x[s];
+                float py = oy + hex->sample_y[s];
+                const uint8_t *t = sceneTexel(hex, (int)floorf(px),
+                        (int)floorf(py));
+                float r = t[2] / 255.0f;
+                float g = t[1] / 255.0f;
+                float b = t[0] / 255.0f;
+                sum[0] += r;
+                sum[1] += g;
+                sum[2] += b;
+                float gray = r * (1.0f / 3.0f) + g * (1.0f / 3.0f)
+                        + b * (1.0f / 3.0f);
+                sum[3] += gray * grayFalloff(hex, px, py);
+        }
+        for (int c = 0; c < 4; c++) {
+                out[c] = sum[c] / CPU_HEXAGON_SAMPLES;
+        }
+}
+#endif
+
+static void averageRow(CpuHexagon *hex, int j) {
+        for (int i = 0; i < hex->cells_x; i++) {
+                averageCell(hex, i * hex->vrad_x, j * hex->vrad_y,
+                        &hex->cell[((size_t)j * hex->cells_x + i) * 4]);
+        }
+}
+
+/*****************************************************************************
+ * Tiles: findOrigin() and is_in_polygon() per pixel
+ ****************************************************************************/
+static inline float dist(float x0, float y0, float x1, float y1) {
+        return sqrtf((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0));
+}
+
+static bool onEdge(const CpuHexagon *hex, float x, float y,
+        float ox, float oy)
+{
+        float line_width = hex->params.line_width;
+        float half_line_width = 0.5f * line_width;
+        const float *e = &hex->edge[0];
+        for (int i = 0; i < hex->params.points; i++, e += 4) {
+                float x0 = ox + e[0];
+                float y0 = oy + e[1];
+                float x1 = ox + e[2];
+                float y1 = oy + e[3];
+                float k = (y1 - y0) / (x1 - x0);
+
+                float progress_x = x - x0;
+                float progress_y = y - y0;
+                float dpoints_x = x1 - x0;
+                float dpoints_y = y1 - y0;
+                float scale_x = progress_x / dpoints_x;
+                float scale_y = progress_y / dpoints_y;
+                /* false for the NaNs and infinities of axis-aligned edges */
+                bool on_line = scale_x >= 0.0f && scale_x <= 1.0f
+                        && scale_y >= 0.0f && scale_y <= 1.0f;
+
+                bool on_straight_line =
+                        (fabsf(dpoints_y) < half_line_width
+                                && fabsf(progress_y) < half_line_width
+                                && x >= fminf(x0, x1) && x <= fmaxf(x0, x1))
+                        || (fabsf(dpoints_x) < half_line_width
+                                && fabsf(progress_x) < half_line_width
+                                && y >= fminf(y0, y1) && y <= fmaxf(y0, y1));
+
+                if ((fabsf(y0 + (x - x0) * k - y) < line_width && on_line)
+                        || on_straight_line)
+                {
+                        return true;
+                }
+        }
+        return false;
+}
+
+static void renderTile(CpuHexagon *hex, int tile) {
+        int tiles_x = (hex->width + CPU_HEXAGON_TILE - 1) / CPU_HEXAGON_TILE;
+        int x_begin = tile % tiles_x * CPU_HEXAGON_TILE;
+        int y_begin = tile / tiles_x * CPU_HEXAGON_TILE;
+        int x_end = x_begin + CPU_HEXAGON_TILE;
+        int y_end = y_begin + CPU_HEXAGON_TILE;
+        x_end = x_end < hex->width ? x_end : hex->width;
+        y_end = y_end < hex->height ? y_end : hex->height;
+        float vx = hex->vrad_x;
+        float vy = hex->vrad_y;
+
+        for (int y = y_begin; y < y_end; y++) {
+                uint8_t *out = hex->rgb + ((size_t)y * hex->width + x_begin) * 3;
+                float fy = y + 0.5f;
+                for (int x = x_begin; x < x_end; x++, out += 3) {
+                        float fx = x + 0.5f;
+                        float sx = fx / vx;
+                        float sy = fy / vy;
+                        int down_x = (int)floorf(sx), up_x = (int)ceilf(sx);
+                        int down_y = (int)floorf(sy), up_y = (int)ceilf(sy);
+
+                        /* the nearest lattice point, ties as findOrigin() */
+                        int i = down_x, j = down_y;
+                        float best = dist(down_x * vx, down_y * vy, fx, fy);
+                        const int cand[3][2] = {
+                                { up_x, up_y }, { down_x, up_y },
+                                { up_x, down_y },
+                        };
+                        for (int c = 0; c < 3; c++) {
+                                float d = dist(cand[c][0] * vx,
+                                        cand[c][1] * vy, fx, fy);
+                                if (d <= best) {
+                                        best = d;
+                                        i = cand[c][0];
+                                        j = cand[c][1];
+                                }
+                        }
+
+                        if (!onEdge(hex, fx, fy, i * vx, j * vy)) {
+                                out[0] = out[1] = out[2] = 0;
+                                continue;
+                        }
+                        const float *cell =
+                                &hex->cell[((size_t)j * hex->cells_x + i) * 4];
+                        /* the right half of the output is gray */
+                        if (fx / hex->width > 0.5f) {
+                                uint8_t gray = (uint8_t)(fminf(cell[3], 1.0f)
+                                        * 255.0f + 0.5f);
+                                out[0] = out[1] = out[2] = gray;
+                        }
+                        else {
+                                for (int c = 0; c < 3; c++) {
+                                        out[c] = (uint8_t)(fminf(cell[c], 1.0f)
+                                                * 255.0f + 0.5f);
+                                }
+                        }
+                }
+        }
+}
+
+/*****************************************************************************
+ * Thread pool
+ ****************************************************************************/
+static void runTask(CpuHexagon *hex, int task) {
+        if (hex->phase == PHASE_CELLS) {
+                averageRow(hex, task);
+        }
+        else {
+                renderTile(hex, task);
+        }
+}
+
+/* the worker's own share first, then whatever is left of the others' */
+static void runShare(CpuHexagon *hex, int self) {
+        for (int v = 0; v < hex->num_threads; v++) {
+                CpuHexagonQueue *q = &hex->queue[(self + v) % hex->num_threads];
+                int task;
+                while ((task = q->next.fetch_add(1)) < q->end) {
+                        runTask(hex, task);
+                        if (v) {
+                                hex->steals++;
+                        }
+                }
+        }
+}
+
+static void workerMain(CpuHexagon *hex, int self) {
+        unsigned seen = 0;
+        for (;;) {
+                {
+                        std::unique_lock<std::mutex> lock(hex->mutex);
+                        hex->start.wait(lock, [&] {
+                                return hex->quit || hex->generation != seen;
+                        });
+                        if (hex->quit) {
+                                return;
+                        }
+                        seen = hex->generation;
+                }
+                runShare(hex, self);
+                std::lock_guard<std::mutex> lock(hex->mutex);
+                if (--hex->running == 0) {
+                        hex->done.notify_one();
+                }
+        }
+}
+
+static void runPhase(CpuHexagon *hex, int phase, int num_tasks) {
+        int n = hex->num_threads;
+        for (int w = 0; w < n; w++) {
+                hex->queue[w].next.store(num_tasks * w / n);
+                hex->queue[w].end = num_tasks * (w + 1) / n;
+        }
+        {
+                std::lock_guard<std::mutex> lock(hex->mutex);
+                hex->phase = phase;
+                hex->running = n - 1;
+                hex->generation++;
+        }
+        hex->start.notify_all();
+        runShare(hex, n - 1);
+        std::unique_lock<std::mutex> lock(hex->mutex);
+        hex->done.wait(lock, [&] { return hex->running == 0; });
+}
+
+void cpuHexagonInit(CpuHexagon *hex, int width, int height,
+        int num_threads)
+{
+        hex->width = width;
+        hex->height = height;
+        if (num_threads < 1) {
+                num_threads = 1;
+        }
+        if (num_threads > CPU_HEXAGON_MAX_THREADS) {
+                num_threads = CPU_HEXAGON_MAX_THREADS;
+        }
+        hex->num_threads = num_threads;
+        hex->generation = 0;
+        hex->running = 0;
+        hex->quit = false;
+        hex->steals = 0;
+        for (int w = 0; w < num_threads - 1; w++) {
+                hex->workers.push_back(std::thread(workerMain, hex, w));
+        }
+}
+
+void cpuHexagonDestroy(CpuHexagon *hex) {
+        {
+                std::lock_guard<std::mutex> lock(hex->mutex);
+                hex->quit = true;
+        }
+        hex->start.notify_all();
+        for (size_t i = 0; i < hex->workers.size(); i++) {
+                hex->workers[i].join();
+        }
+        hex->workers.clear();
+}
+
+/*****************************************************************************
+ * Frames
+ ****************************************************************************/
+/* the constants hexagonalize computes per pixel, computed once */
+static void setParams(CpuHexagon *hex, const CpuHexagonParams *params) {
+        hex->params = *params;
+        float rad = params->radius;
+        float pi = acosf(-1.0f);
+
+        float d_phase = 2.0f * pi / (float)params->points;
+        hex->edge.resize(params->points * 4);
+        for (int i = 0; i < params->points; i++) {
+                float phi0 = (float)i * d_phase;
+                float phi1 = phi0 + d_phase;
+                hex->edge[i * 4 + 0] = rad * cosf(phi0);
+                hex->edge[i * 4 + 1] = rad * sinf(phi0);
+                hex->edge[i * 4 + 2] = rad * cosf(phi1);
+                hex->edge[i * 4 + 3] = rad * sinf(phi1);
+        }
+
+        /* the center, then 20 samples spiralling out to the radius */
+        int num_spiral = CPU_HEXAGON_SAMPLES - 1;
+        d_phase = 2.0f * pi / (float)num_spiral;
+        for (int s = 0; s < CPU_HEXAGON_PADDED; s++) {
+                int i = s - 1;
+                float mult = (float)(i + 1) / (float)num_spiral;
+                bool spiral = s > 0 && s < CPU_HEXAGON_SAMPLES;
+                hex->sample_x[s] = spiral ?
+                        mult * rad * cosf((float)i * d_phase) : 0.0f;
+                hex->sample_y[s] = spiral ?
+                        mult * rad * sinf((float)i * d_phase) : 0.0f;
+                hex->sample_weight[s] = s < CPU_HEXAGON_SAMPLES ? 1.0f : 0.0f;
+        }
+
+        hex->vrad_x = 2.0f * rad;
+        hex->vrad_y = 1.7f * rad;
+        hex->cells_x = (int)(hex->width / hex->vrad_x) + 2;
+        hex->cells_y = (int)(hex->height / hex->vrad_y) + 2;
+        hex->cell.resize((size_t)hex->cells_x * hex->cells_y * 4);
+}
+
+void cpuHexagonRender(CpuHexagon *hex, const uint8_t *bgr, uint8_t *rgb,
+        const CpuHexagonParams *params)
+{
+        setParams(hex, params);
+        hex->bgr = bgr;
+        hex->rgb = rgb;
+
+        int tiles_x = (hex->width + CPU_HEXAGON_TILE - 1) / CPU_HEXAGON_TILE;
+        int tiles_y = (hex->height + CPU_HEXAGON_TILE - 1) / CPU_HEXAGON_TILE;
+        runPhase(hex, PHASE_CELLS, hex->cells_y);
+        runPhase(hex, PHASE_TILES, tiles_x * tiles_y);
+}
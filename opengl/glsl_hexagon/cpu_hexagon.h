@@ -0,0 +1,99 @@
+#ifndef __CPU_HEXAGON__H__
+#define __CPU_HEXAGON__H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*****************************************************************************
+ * CPU hexagon mosaic
+ *
+ * The hexagonalize stage with the loop grid, for machines without a usable
+ * GPU: findOrigin(), is_in_polygon() and the 21 bg_color() samples over
+ * the frame turned by 180 degrees, in the same float math. Outputs match
+ * the GPU within CPU_HEXAGON_TOLERANCE, trig and pow round differently and
+ * may flip pixels right on an edge or move a cell by a level.
+ *
+ * A frame runs in two phases on a pool of threads: every cell is averaged
+ * once, four samples at a time with SSE, then the pixels are tested
+ * against the edges in tiles. Each phase splits its tasks evenly over the
+ * workers, a worker done with its share steals from the others.
+ ****************************************************************************/
+enum {
+        CPU_HEXAGON_TILE = 64,
+        CPU_HEXAGON_MAX_THREADS = 64,
+        /* bg_color() calls per cell, padded to whole SSE vectors */
+        CPU_HEXAGON_SAMPLES = 21,
+        CPU_HEXAGON_PADDED = 24,
+};
+
+/* level difference and share of differing bytes out.bin may show */
+static const int CPU_HEXAGON_TOLERANCE = 2;
+static const double CPU_HEXAGON_MAX_MISMATCH = 0.001;
+
+struct CpuHexagonParams {
+        float radius;
+        int points;
+        float line_width;
+};
+
+/* the tasks one worker starts with, others take from next when idle */
+struct alignas(64) CpuHexagonQueue {
+        std::atomic<int> next;
+        int end;
+};
+
+struct CpuHexagon {
+        int width;
+        int height;
+        int num_threads;
+        std::vector<std::thread> workers;
+
+        /* a phase starts with a new generation and ends at running == 0 */
+        std::mutex mutex;
+        std::condition_variable start;
+        std::condition_variable done;
+        unsigned generation;
+        int running;
+        bool quit;
+        int phase;
+        CpuHexagonQueue queue[CPU_HEXAGON_MAX_THREADS];
+        std::atomic<int> steals;
+
+        /* the frame being rendered */
+        const uint8_t *bgr;
+        uint8_t *rgb;
+        CpuHexagonParams params;
+
+        /* x0, y0, x1, y1 of every polygon edge around the origin */
+        std::vector<float> edge;
+        /* spiral sample offsets, the padding has weight 0 */
+        float sample_x[CPU_HEXAGON_PADDED];
+        float sample_y[CPU_HEXAGON_PADDED];
+        float sample_weight[CPU_HEXAGON_PADDED];
+        /* lattice spacing and the averages of every cell, color and gray */
+        float vrad_x;
+        float vrad_y;
+        int cells_x;
+        int cells_y;
+        std::vector<float> cell;
+};
+
+/* starts num_threads - 1 workers, the caller is the last one */
+void cpuHexagonInit(CpuHexagon *hex, int width, int height,
+        int num_threads);
+void cpuHexagonDestroy(CpuHexagon *hex);
+
+/*
+ * Renders the mosaic of a packed BGR frame, as uploaded to the GPU, into
+ * packed RGB rows bottom up like glReadPixels.
+ */
+void cpuHexagonRender(CpuHexagon *hex, const uint8_t *bgr, uint8_t *rgb,
+        const CpuHexagonParams *params);
+
+#endif //__CPU_HEXAGON__H__
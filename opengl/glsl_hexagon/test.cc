@@ -1,108 +1,103 @@
+#include <fcntl.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
+#ifdef __APPLE__
 #include <OpenGL/gl3.h>
-#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
 
-#include <GLFW/glfw3.h>
+#include "opengl_utils.h"
+#include "context.h"
+#include "cpu_hexagon.h"
+#include "cpu_nv12.h"
+#include "filter_graph.h"
+#include "program_cache.h"
+#include "tiles.h"
 
 //#define SHOW_IMAGE
 
-/*****************************************************************************
- * OpenGL Helpers
- ****************************************************************************/
-#define ogl(x) do { \
-        x; \
-        int _err = glGetError(); \
-        if (_err) { \
-                printf("GL Error %d at %d, %s\n", _err, __LINE__, __func__); \
-                exit (-1); \
-        } \
-} while (0)
-
-static inline void oglProgramLog(int pid)
-{
-        GLint logLen;
-        GLsizei realLen;
-
-        glGetProgramiv(pid, GL_INFO_LOG_LENGTH, &logLen);
-        if (!logLen) {
-                return;
-        }
-        char *log = (char *)malloc(logLen);
-        if (!log) {
-                perror("malloc");
-                return;
-        }
-        glGetProgramInfoLog(pid, logLen, &realLen, log);
-        if (realLen) {
-                printf("program %d log %s\n", pid, log);
-        }
-        free(log);
-}
-
-static inline void oglShaderLog(int sid) {
-        GLint logLen;
-        GLsizei realLen;
-
-        glGetShaderiv(sid, GL_INFO_LOG_LENGTH, &logLen);
-        if (!logLen) {
-                return;
-        }
-        char *log = (char *)malloc(logLen);
-        if (!log) {
-                perror("malloc");
-                return;
-        }
-        glGetShaderInfoLog(sid, logLen, &realLen, log);
-        if (realLen) {
-                printf("shader %d log %s\n", sid, log);
-        }
-        free(log);
-}
+#ifdef SHOW_IMAGE
+static const bool ShowImage = true;
+#else
+static const bool ShowImage = false;
+#endif
 
-#define SHADER(name, text) static const char *name = "#version 150 core\n" #text
+/* a function of the output pixel, see filter_graph.h for stages */
+#define STAGE(name, text) static const char *name = #text
 
 /*****************************************************************************
- * RGB -> YUV
+ * Stages
  ****************************************************************************/
-SHADER(vert_passthru,
-        in vec4 position;
-        in vec2 texcoord;
-        out vec2 frag_texcoord;
-
-        void main(void) {
-                gl_Position = position;
-                frag_texcoord = texcoord;
+/* turns the frame by 180 degrees before the hexagons are laid over it */
+STAGE(stage_rotate,
+        vec4 rotate(vec2 pixel) {
+                return rotate_src(rotate_src_size - floor(pixel) - vec2(0.5));
         }
 );
 
-SHADER(frag_texture,
-        in vec2 frag_texcoord;
-        uniform sampler2D tex_input;
-		out vec4 FragColor;
+/*
+ * rotate for YUV frames, converting them back to RGB the way stage_rgb2y
+ * and stage_rgb2uv encode it. The frame is one R8 texture holding the Y
+ * plane in its top rows and the chroma in the half as high rows below,
+ * NV12's interleaved UV rows or I420's U and V planes side by side, so a
+ * frame is uploaded as it was decoded. See --input-format.
+ */
+STAGE(stage_rotate_yuv,
+	uniform int yuv_planar;
+
+	float yuvByte(vec2 texel) {
+		return rotate_yuv_src(texel + vec2(0.5)).r;
+	}
 
-        void main(void) {
-                FragColor = texture(tex_input, frag_texcoord);
-        }
+	vec4 rotate_yuv(vec2 pixel) {
+		vec2 size = vec2(rotate_yuv_src_size.x,
+			rotate_yuv_src_size.y * 2.0 / 3.0);
+		/* the edge clamp of "scene", for samples fused past it */
+		vec2 p = clamp(size - floor(pixel) - vec2(1.0), vec2(0.0),
+			size - vec2(1.0));
+		vec2 chroma = floor(0.5 * p);
+		vec2 u_texel;
+		vec2 v_texel;
+		if (yuv_planar != 0) {
+			u_texel = vec2(chroma.x, size.y + chroma.y);
+			v_texel = u_texel + vec2(0.5 * size.x, 0.0);
+		}
+		else {
+			u_texel = vec2(2.0 * chroma.x, size.y + chroma.y);
+			v_texel = u_texel + vec2(1.0, 0.0);
+		}
+		float y = 1.164 * (yuvByte(p) - 0.0625);
+		float u = yuvByte(u_texel) - 0.5;
+		float v = yuvByte(v_texel) - 0.5;
+		return vec4(y + 1.596 * v, y - 0.392 * u - 0.813 * v,
+			y + 2.017 * u, 1.0);
+	}
 );
 
-SHADER(frag_hexagonalize,
-	in vec2 frag_texcoord;
-	uniform sampler2D tex_input;
-	uniform vec2 framesize;
-	out vec4 FragColor;
-
-	const float poly_rad = 15.0;
-	const int num_points = 6;
-	const float line_width = 2.0;
-	const float half_line_width = 0.5 * line_width;
-
-	vec2 findOrigin(void)
+/*
+ * The grids put a polygon with num_points corners poly_rad from its
+ * center on every point of a 2 x 1.7 poly_rad lattice and draw its edges
+ * line_width wide, the gaps between four polygons make the cells in
+ * between. cellEdge() returns how much of the pixel an edge covers and
+ * the center of that polygon, the cell stages fill it, see
+ * hexagonSource().
+ *
+ * The loop grid picks the nearest center and walks the polygon's edges
+ * with a trig pair and divides per corner, pixels are on an edge or not.
+ */
+STAGE(stage_grid_loop,
+	uniform float poly_rad;
+	uniform int num_points;
+	uniform float line_width;
+
+	vec2 findOrigin(vec2 fragCoord)
 	{
 		//return vec2(200.0);
-		vec2 fragCoord = gl_FragCoord.xy;
-
 		vec2 vrad = vec2(2.0 * poly_rad, 1.7 * poly_rad);
 		vec2 coord_scale = fragCoord / vrad;
 		vec2 coord_down = floor(coord_scale) * vrad;
@@ -125,6 +120,7 @@ SHADER(frag_hexagonalize,
 	}
 
 	bool is_in_polygon(vec2 coord, vec2 origin) {
+		float half_line_width = 0.5 * line_width;
 		float PI = acos(-1.0);
 		float d_phase = 2.0 * PI / float(num_points);
 		for (int i = 0; i < num_points; i++) {
@@ -176,10 +172,70 @@ SHADER(frag_hexagonalize,
 		return false;
 	}
 
-	vec4 bg_color(vec2 fragCoord) {
-		vec2 tc = fragCoord / framesize;
-		vec4 color = texture(tex_input, tc);
-		if (frag_texcoord.x > 0.5) {
+	float cellEdge(vec2 coord, out vec2 origin) {
+		origin = findOrigin(coord);
+		return is_in_polygon(coord, origin) ? 1.0 : 0.0;
+	}
+);
+
+/*
+ * The analytic grid finds the lattice cell in closed form and measures
+ * the distance to the edge of each of the cell's four polygons: the
+ * angle of the pixel picks the edge, the rest is a dot product and a
+ * clamp. The distance gives the edge's coverage of the pixel, so edges
+ * are anti-aliased without extra samples.
+ */
+STAGE(stage_grid_analytic,
+	uniform float poly_rad;
+	uniform int num_points;
+	uniform float line_width;
+
+	/* distance from p to the edge of the polygon centered at 0 */
+	float edgeDistance(vec2 p) {
+		float sector = 2.0 * acos(-1.0) / float(num_points);
+		float edge = (floor(atan(p.y, p.x) / sector) + 0.5) * sector;
+		vec2 normal = vec2(cos(edge), sin(edge));
+		float across = dot(p, normal) - poly_rad * cos(0.5 * sector);
+		float along = dot(p, vec2(-normal.y, normal.x));
+		float half_edge = poly_rad * sin(0.5 * sector);
+		return length(vec2(across,
+			along - clamp(along, -half_edge, half_edge)));
+	}
+
+	float cellEdge(vec2 coord, out vec2 origin) {
+		vec2 vrad = vec2(2.0 * poly_rad, 1.7 * poly_rad);
+		vec2 corner = floor(coord / vrad) * vrad;
+		float nearest = 1e30;
+		for (int i = 0; i < 4; i++) {
+			vec2 center = corner + vrad * vec2(i & 1, i >> 1);
+			float d = edgeDistance(coord - center);
+			if (d < nearest) {
+				nearest = d;
+				origin = center;
+			}
+		}
+		/* a pixel wide box filter across the line */
+		return clamp(0.5 * line_width - nearest + 0.5, 0.0, 1.0);
+	}
+);
+
+/*
+ * The color of the polygon centered at origin, the average of the center
+ * and 20 samples on a spiral around it. The grid and the samples are laid
+ * out in frame coordinates, a tile renders the part of the frame starting
+ * at tile_origin. The stage reading the scene defines cellFetch().
+ */
+STAGE(stage_cell_color,
+	uniform vec2 tile_origin;
+	uniform vec2 frame_size;
+
+	vec4 cellFetch(vec2 pixel);
+
+	vec4 bg_color(vec2 fragCoord, bool gray_half) {
+		vec2 tc = fragCoord / frame_size;
+		/* the texel in frame coordinates, a tile's own would round apart */
+		vec4 color = cellFetch(floor(fragCoord) + 0.5 - tile_origin);
+		if (gray_half) {
 			float gray = dot(vec3(1.0 / 3.0), color.xyz);
 			float radius = max(tc.s, tc.t);
 			float coeff = floor(radius * 50.0);
@@ -189,220 +245,537 @@ SHADER(frag_hexagonalize,
 		return color;
 	}
 
-	void main(void) {
-		vec2 fragCoord = gl_FragCoord.xy;
+	vec4 cellColor(vec2 origin, bool gray_half) {
+		const int num_samples = 20;
+		float rad_sc = poly_rad;
+		vec4 color = bg_color(origin, gray_half);
+
+		float PI = acos(-1.0);
+		float d_phase = 2.0 * PI / float(num_samples);
+		for (int i = 0; i < num_samples; i++) {
+			float phase = float(i) * d_phase;
+			float mult = float(i + 1) / float(num_samples);
+			vec2 diff = mult * rad_sc * vec2(cos(phase), sin(phase));
+			color += bg_color(origin + diff, gray_half);
+		}
+
+		return color / float(num_samples + 1);
+	}
+);
+
+/* fills the cells with their sampled color per pixel */
+STAGE(stage_hexagonalize,
+	vec4 cellFetch(vec2 pixel) {
+		return hexagonalize_src(pixel);
+	}
+
+	vec4 hexagonalize(vec2 pixel) {
 		vec4 hex_color = vec4(0.0, 1.0, 1.0, 1.0);
-		vec2 origin = findOrigin();
+		vec2 fragCoord = pixel + tile_origin;
+		vec2 origin;
+		float edge = cellEdge(fragCoord, origin);
+		/* the right half of the output is gray */
+		bool gray_half = fragCoord.x / frame_size.x > 0.5;
 
-		if (!is_in_polygon(fragCoord, origin))
+		if (edge == 0.0)
 		{
-			FragColor = vec4(0.0, 0.0, 0.0, 1.0);
-			return;
+			return vec4(0.0, 0.0, 0.0, 1.0);
 		}
 		else {
-			const int num_samples = 20;
-			float rad_sc = poly_rad;
-			vec4 color = bg_color(origin);
-
-			float PI = acos(-1.0);
-			float d_phase = 2.0 * PI / float(num_samples);
-			for (int i = 0; i < num_samples; i++) {
-				float phase = float(i) * d_phase;
-				float mult = float(i + 1) / float(num_samples);
-				vec2 diff = mult * rad_sc * vec2(cos(phase), sin(phase));
-				color += bg_color(origin + diff);
-			}
+			vec4 color = cellColor(origin, gray_half);
+			return vec4(color.rgb * edge, 1.0);
+		}
+	}
+);
+
+/*
+ * One texel per lattice point with the color of the polygon centered
+ * there: the first cell_columns texels of a row for the left half of the
+ * frame, the next ones gray for the right half. See --video.
+ */
+STAGE(stage_cellavg,
+	uniform float cell_columns;
 
-			color /= float(num_samples + 1);
-			FragColor = color;
+	vec4 cellFetch(vec2 pixel) {
+		return cellavg_src(pixel);
+	}
+
+	vec4 cellavg(vec2 pixel) {
+		vec2 cell = floor(pixel);
+		bool gray_half = cell.x >= cell_columns;
+		if (gray_half) {
+			cell.x -= cell_columns;
 		}
+		vec2 vrad = vec2(2.0 * poly_rad, 1.7 * poly_rad);
+		return cellColor(cell * vrad, gray_half);
+	}
+);
+
+/* programs of their own rather than stages, after a GlslVersion line */
+#define SHADER(name, text) static const char *name = #text
+static const char *GlslVersion = "#version 150\n";
+
+/* the quads of the cells --video draws, in pixels of the frame */
+SHADER(vert_cells,
+	in vec2 position;
+	uniform vec2 frame_size;
+
+	void main(void) {
+		gl_Position = vec4(2.0 * position / frame_size - 1.0, 0.0, 1.0);
 	}
 );
 
+/* stage_hexagonalize with the colors stage_cellavg left in cells */
+SHADER(frag_cells,
+	uniform sampler2D cells;
+	uniform vec2 frame_size;
+	uniform float cell_columns;
+	out vec4 color;
+
+	void main(void) {
+		vec2 origin;
+		float edge = cellEdge(gl_FragCoord.xy, origin);
+		vec2 vrad = vec2(2.0 * poly_rad, 1.7 * poly_rad);
+		vec2 cell = floor(origin / vrad + 0.5);
+		if (gl_FragCoord.x / frame_size.x > 0.5) {
+			cell.x += cell_columns;
+		}
+		color = vec4(texelFetch(cells, ivec2(cell), 0).rgb * edge, 1.0);
+	}
+);
+
+/*
+ * One step of a parallel prefix scan building the summed-area table of
+ * the scene: every pixel adds up the 4 pixels sat_scan_step apart ending
+ * at it. After steps of 1, 4, 16... along the rows and then the columns
+ * a pixel holds the sum of all pixels left of and below it, inclusive.
+ * The first step subtracts sat_scan_bias = 0.5, the centered sums keep
+ * their precision in 32-bit floats.
+ */
+STAGE(stage_sat_scan,
+        uniform vec2 sat_scan_step;
+        uniform float sat_scan_bias;
+
+        vec4 sat_scan(vec2 pixel) {
+                vec4 sum = vec4(0.0);
+                for (int i = 0; i < 4; i++) {
+                        vec2 p = pixel - float(i) * sat_scan_step;
+                        if (p.x < 0.0 || p.y < 0.0) {
+                                break;
+                        }
+                        sum += sat_scan_src(p) - vec4(sat_scan_bias);
+                }
+                return sum;
+        }
+);
+
+/*
+ * Fills the cells with the average of every pixel under the hexagon,
+ * looked up in the summed-area table in the same 12 fetches at any
+ * poly_rad. The hexagon has the area of the union of a tall r x 1.73r
+ * and a wide 2r x 0.87r rectangle around its center, and nearly the
+ * same shape. Other polygons are averaged over that hexagon too.
+ */
+STAGE(stage_hexcells,
+	/* sum of the pixels left of and below p, inclusive */
+	vec4 hexcells_corner(vec2 p) {
+		if (p.x < 0.0 || p.y < 0.0) {
+			return vec4(0.0);
+		}
+		return hexcells_src(min(p, hexcells_src_size - 1.0) + 0.5);
+	}
+
+	/* sum of the pixels centered in [lo, hi) and their count in w */
+	vec4 hexcells_rect(vec2 lo, vec2 hi) {
+		lo = clamp(ceil(lo - 0.5), vec2(0.0), hexcells_src_size);
+		hi = clamp(ceil(hi - 0.5), lo, hexcells_src_size);
+		vec4 sum = hexcells_corner(hi - 1.0)
+			- hexcells_corner(vec2(lo.x, hi.y) - 1.0)
+			- hexcells_corner(vec2(hi.x, lo.y) - 1.0)
+			+ hexcells_corner(lo - 1.0);
+		vec2 extent = hi - lo;
+		return vec4(sum.rgb, extent.x * extent.y);
+	}
+
+	vec4 hexcells(vec2 fragCoord) {
+		vec2 origin;
+		float edge = cellEdge(fragCoord, origin);
+		/* the right half of the output is gray */
+		bool gray_half = fragCoord.x / hexcells_src_size.x > 0.5;
+
+		if (edge == 0.0) {
+			return vec4(0.0, 0.0, 0.0, 1.0);
+		}
+		vec2 tall = poly_rad * vec2(0.5, 0.866);
+		vec2 wide = poly_rad * vec2(1.0, 0.433);
+		vec2 both = poly_rad * vec2(0.5, 0.433);
+		vec4 sum = hexcells_rect(origin - tall, origin + tall)
+			+ hexcells_rect(origin - wide, origin + wide)
+			- hexcells_rect(origin - both, origin + both);
+		vec3 color = sum.rgb / max(sum.w, 1.0) + vec3(0.5);
+		if (gray_half) {
+			vec2 tc = origin / hexcells_src_size;
+			float gray = dot(vec3(1.0 / 3.0), color);
+			float coeff = floor(max(tc.s, tc.t) * 50.0);
+			color = vec3(gray * pow(0.947, coeff));
+		}
+		return vec4(color * edge, 1.0);
+	}
+);
+
+/*
+ * NV12 planes of the hexagons. Chroma averages the 2x2 block under its
+ * pixel with four taps, a single bilinear fetch cannot be fused.
+ */
+STAGE(stage_rgb2y,
+        const vec4 rgb2y_coef = vec4(0.257, 0.504, 0.098, 0.0625);
+
+        vec4 rgb2y(vec2 pixel) {
+                vec4 rgb = vec4(rgb2y_src(pixel).rgb, 1.0);
+                return vec4(dot(rgb2y_coef, rgb));
+        }
+);
+
+STAGE(stage_rgb2uv,
+        const vec4 rgb2uv_u = vec4(-0.148, -0.291, 0.439, 0.5);
+        const vec4 rgb2uv_v = vec4(0.439, -0.368, -0.071, 0.5);
+
+        vec4 rgb2uv(vec2 pixel) {
+                vec2 base = 2.0 * floor(pixel) + vec2(0.5);
+                vec3 sum = rgb2uv_src(base).rgb
+                        + rgb2uv_src(base + vec2(1.0, 0.0)).rgb
+                        + rgb2uv_src(base + vec2(0.0, 1.0)).rgb
+                        + rgb2uv_src(base + vec2(1.0, 1.0)).rgb;
+                vec4 rgb = vec4(0.25 * sum, 1.0);
+                return vec4(dot(rgb2uv_u, rgb), dot(rgb2uv_v, rgb), 0.0, 0.0);
+        }
+);
+
 /*****************************************************************************
  * Rendering the texture to framebuffer
  ****************************************************************************/
 enum {
-        TEX_WIDTH = 1024,
-        TEX_HEIGHT = 768,
+        DEFAULT_WIDTH = 1024,
+        DEFAULT_HEIGHT = 768,
+        /* tiles of frames too large for one texture, see --tile */
+        DEFAULT_TILE = 2048,
 };
 
-static const GLfloat QuadSide = 1.0f;
+/* packed BGR, DEFAULT_WIDTH x DEFAULT_HEIGHT unless --size says else */
+static const char *DefaultInput = "me_no_bg.rgb";
+
+/* the layout of --input, see --input-format */
+enum InputFormat {
+        INPUT_BGR,
+        /* the Y plane, then interleaved UV at half the size */
+        INPUT_NV12,
+        /* the Y plane, then U and V at half the size */
+        INPUT_I420,
+};
 
-static GLfloat QuadData[] = {
-        //vertex coordinates
-        QuadSide, QuadSide, 0.0f,
-        -QuadSide, QuadSide, 0.0f,
-        -QuadSide, -QuadSide, 0.0f,
-        QuadSide, -QuadSide, 0.0f,
+/* fetches per pixel a fused stage may reach with --fuse */
+static const int DefaultFuseFetches = 32;
+/* poly_rad without --radius and the ones --bench-cells compares */
+static const float DefaultRadius = 15.0f;
+static const float BenchRadius[] = { 5.0f, 10.0f, 15.0f, 30.0f, 60.0f };
+static const int DefaultPoints = 6;
+static const float DefaultLineWidth = 2.0f;
 
-        //texture coordinates
-        0, 0,
-        1, 0,
-        1, 1,
-        0, 1,
+enum {
+        /*
+         * Pixels each sat_scan step adds up. A scan over N pixels makes
+         * SAT_RADIX * log(N) / log(SAT_RADIX) fetches per pixel, 4 has
+         * fewer than 8 and fewer passes than 2.
+         */
+        SAT_RADIX = 4,
+        /* 6 steps per axis cover 4096 pixels */
+        MAX_SAT_STEPS = 12,
 };
 
-static GLfloat QuadData_inverted[] = {
-        //vertex coordinates
-        -QuadSide, -QuadSide, 0.0f,
-        QuadSide, -QuadSide, 0.0f,
-        QuadSide, QuadSide, 0.0f,
-        -QuadSide, QuadSide, 0.0f,
-
-        //texture coordinates
-        0, 0,
-        1, 0,
-        1, 1,
-        0, 1,
+/* the targets of the scan steps, the last one holds the table */
+static const char *SatTarget[MAX_SAT_STEPS] = {
+        "sat_0", "sat_1", "sat_2", "sat_3", "sat_4", "sat_5",
+        "sat_6", "sat_7", "sat_8", "sat_9", "sat_10", "sat_11",
 };
 
-static GLuint QuadIndices[] = {
-        0, 1, 2,
-        0, 2, 3,
+/* how the cells get their color, see --sat */
+enum CellAverage {
+        CELL_SAMPLES,
+        /* summed-area table scanned by the graph */
+        CELL_SAT_GPU,
+        /* scene read back, scanned and uploaded between passes */
+        CELL_SAT_CPU,
+        NUM_CELL_AVERAGES,
 };
 
-static const size_t VertexStride = 3;
-static const size_t TexCoordStride = 2;
+/* how the edges are found, see the grid stages */
+enum HexGrid {
+        GRID_LOOP,
+        GRID_ANALYTIC,
+        NUM_GRIDS,
+};
 
-static const size_t CoordOffset = 0;
-static const size_t TexCoordOffset = 12;
+/* the look of the hexagons, all but the grid and average are uniforms */
+struct HexagonParams {
+        HexGrid grid;
+        CellAverage average;
+        float radius;
+        int points;
+        float line_width;
+};
 
-static const size_t NumVertices = 4;
-static const size_t NumIndices = 6;
+/* the frame and the window of it one run of the graph renders */
+struct HexagonGeometry {
+        int width;
+        int height;
+        /* the whole frame unless tiled, see renderTiles() */
+        int window_width;
+        int window_height;
+};
 
-static GLuint _program_id;
+static ProgramCache _programs;
 static GLuint _texture;
-static GLuint _fb_hexagonalize;
-static GLuint _texture_hexagonalize_fb;
-
-static GLuint _vao;
-static GLuint _vbo;
-static GLuint _vbo_idx;
-
-static GLuint _position_attr;
-static GLuint _tex_coord_attr;
-static GLuint _frame_size_attr;
-static GLuint _texture_location_in_shader;
-
-static void setGlProgram(const char *frag_source, const char *vert_source) {
-        ogl(_program_id = glCreateProgram());
-
-        GLuint vert, frag;
-        ogl(vert = glCreateShader(GL_VERTEX_SHADER));
-        ogl(frag = glCreateShader(GL_FRAGMENT_SHADER));
-
-        const char **vsrc = const_cast<const char**>(&vert_source);
-        const char **fsrc = const_cast<const char**>(&frag_source);
+/* NV12 instead of RGB in out.bin, see --nv12 */
+static bool _nv12;
+static InputFormat _input_format = INPUT_BGR;
+static HexagonParams _params = {
+        GRID_ANALYTIC, CELL_SAMPLES, DefaultRadius, DefaultPoints,
+        DefaultLineWidth,
+};
+static HexagonGeometry _geo = {
+        DEFAULT_WIDTH, DEFAULT_HEIGHT, DEFAULT_WIDTH, DEFAULT_HEIGHT,
+};
+/* the table built on the CPU and what it is built from */
+static GLuint _sat_texture;
+static uint8_t *_sat_scene;
+static float *_sat_table;
+
+static FilterQuad _quad;
+/*
+ * The frame is turned into "scene", converted to RGB if it is YUV, and
+ * hexagonalized into "hexagons", which are converted into the "y" and
+ * "uv" planes for NV12. With
+ * CELL_SAT_GPU the scene's summed-area table is built in "sat_*" first,
+ * with CELL_SAT_CPU it is the "sat" input.
+ */
+static FilterGraph _graph;
+static int _hexagon_pass;
+
+/* the grid and the stage filling the cells in one source */
+static const char *hexagonSource(HexGrid grid, CellAverage average) {
+        static char source[NUM_GRIDS][NUM_CELL_AVERAGES][8192];
+        char *buf = source[grid][average];
+        snprintf(buf, sizeof(source[grid][average]), "%s\n%s\n%s",
+                grid == GRID_LOOP ? stage_grid_loop : stage_grid_analytic,
+                average == CELL_SAMPLES ? stage_cell_color : "",
+                average == CELL_SAMPLES ? stage_hexagonalize : stage_hexcells);
+        return buf;
+}
 
-        ogl(glShaderSource(vert, 1, vsrc, NULL));
-        ogl(glCompileShader(vert));
-        oglShaderLog(vert);
+/* the grid and stage_cellavg in one source */
+static const char *cellsSource(HexGrid grid) {
+        static char source[NUM_GRIDS][8192];
+        snprintf(source[grid], sizeof(source[grid]), "%s\n%s\n%s",
+                grid == GRID_LOOP ? stage_grid_loop : stage_grid_analytic,
+                stage_cell_color, stage_cellavg);
+        return source[grid];
+}
 
-        ogl(glShaderSource(frag, 1, fsrc, NULL));
-        ogl(glCompileShader(frag));
-        oglShaderLog(frag);
+/* converts input into the "y" and "uv" planes */
+static void addNv12Passes(FilterGraph *graph, const char *input,
+        int width, int height)
+{
+        filterGraphAddTarget(graph, "y", width, height, GL_R8);
+        filterGraphAddTarget(graph, "uv", width / 2, height / 2, GL_RG8);
+        int pass = filterGraphAddStage(graph, "rgb2y", stage_rgb2y, 1, 0);
+        filterPassRead(graph, pass, input, NULL, 0);
+        filterPassWrite(graph, pass, "y");
+        pass = filterGraphAddStage(graph, "rgb2uv", stage_rgb2uv, 4, 0);
+        filterPassRead(graph, pass, input, NULL, 0);
+        filterPassWrite(graph, pass, "uv");
+}
 
-        ogl(glAttachShader(_program_id, frag));
-        ogl(glAttachShader(_program_id, vert));
+/* rows of the "frame" texture, YUV frames put the chroma below the luma */
+static int frameRows(int height) {
+        return _input_format == INPUT_BGR ? height : height * 3 / 2;
+}
 
-        ogl(glBindAttribLocation(_program_id, 0, "position"));
-        ogl(glBindAttribLocation(_program_id, 1, "texcoord"));
-        ogl(glBindFragDataLocation(_program_id, 0, "FragColor"));
+/* bytes of a frame in the --input-format layout */
+static size_t inputSize(int width, int height) {
+        return (size_t)width * frameRows(height)
+                * (_input_format == INPUT_BGR ? 3 : 1);
+}
 
-        ogl(glLinkProgram(_program_id));
-        ogl(oglProgramLog(_program_id));
+/* turns "frame" into "scene" */
+static void addRotatePass(FilterGraph *graph) {
+        if (_input_format == INPUT_BGR) {
+                int pass = filterGraphAddStage(graph, "rotate", stage_rotate,
+                        1, 0);
+                filterPassRead(graph, pass, "frame", NULL, 0);
+                filterPassWrite(graph, pass, "scene");
+                return;
+        }
+        /* luma, U and V */
+        int pass = filterGraphAddStage(graph, "rotate_yuv", stage_rotate_yuv,
+                3, 0);
+        filterPassRead(graph, pass, "frame", NULL, 0);
+        filterPassWrite(graph, pass, "scene");
+        filterPassUniform1i(graph, pass, "yuv_planar",
+                _input_format == INPUT_I420);
+}
 
-        ogl(_position_attr = glGetAttribLocation(_program_id, "position"));
-        ogl(_tex_coord_attr = glGetAttribLocation(_program_id, "texcoord"));
+/* adds the scan steps over "scene", returns the target with the table */
+static const char *addSatPasses(FilterGraph *graph) {
+        const char *input = "scene";
+        int steps = 0;
+        for (int axis = 0; axis < 2; axis++) {
+                int size = axis ? _geo.window_height : _geo.window_width;
+                for (int step = 1; step < size; step *= SAT_RADIX) {
+                        if (steps == MAX_SAT_STEPS) {
+                                puts("frame too large for the scan steps");
+                                exit(-1);
+                        }
+                        const char *target = SatTarget[steps++];
+                        filterGraphAddTarget(graph, target,
+                                _geo.window_width, _geo.window_height,
+                                GL_RGBA32F);
+                        int pass = filterGraphAddStage(graph, "sat_scan",
+                                stage_sat_scan, SAT_RADIX, 0);
+                        filterPassRead(graph, pass, input, NULL, 0);
+                        filterPassWrite(graph, pass, target);
+                        filterPassUniform2f(graph, pass, "sat_scan_step",
+                                axis ? 0.0f : step, axis ? step : 0.0f);
+                        GLfloat bias = steps == 1 ? 0.5f : 0.0f;
+                        filterPassUniform(graph, pass, "sat_scan_bias",
+                                1, &bias);
+                        input = target;
+                }
+        }
+        return input;
 }
 
-static void setGlProgramForRgb2Yuv(void) {
-        setGlProgram(frag_hexagonalize, vert_passthru);
-        ogl(glUseProgram(_program_id));
-        ogl(_frame_size_attr = glGetUniformLocation(_program_id, "framesize"));
-        ogl(glUniform2f(_frame_size_attr, TEX_WIDTH, TEX_HEIGHT));
+/* returns the pass drawing the hexagons */
+static int initializeGraph(FilterGraph *graph, int fuse_fetches,
+        const HexagonParams *params)
+{
+        CellAverage average = params->average;
+        filterGraphInit(graph, &_quad, &_programs);
+        filterGraphSetFusion(graph, fuse_fetches);
+        int width = _geo.window_width;
+        int height = _geo.window_height;
+        filterGraphAddInput(graph, "frame", width, frameRows(height));
+        filterGraphAddTarget(graph, "scene", width, height, GL_RGB8);
+        /* headless contexts have no default framebuffer to render into */
+        filterGraphAddTarget(graph, "hexagons", width, height, GL_RGB8);
+
+        addRotatePass(graph);
+
+        int pass;
+        if (average != CELL_SAMPLES) {
+                const char *table = "sat";
+                if (average == CELL_SAT_GPU) {
+                        table = addSatPasses(graph);
+                }
+                else {
+                        filterGraphAddInput(graph, table, width, height);
+                }
+                /* three rectangles of four corners */
+                pass = filterGraphAddStage(graph, "hexcells",
+                        hexagonSource(params->grid, average), 12,
+                        FILTER_CLEAR);
+                filterPassRead(graph, pass, table, NULL, 0);
+        }
+        else {
+                /* the polygon's center and 20 samples around it */
+                pass = filterGraphAddStage(graph, "hexagonalize",
+                        hexagonSource(params->grid, average), 21,
+                        FILTER_CLEAR);
+                filterPassRead(graph, pass, "scene", NULL, 0);
+                /* the whole frame, renderTiles() moves the origin */
+                filterPassUniform2f(graph, pass, "tile_origin", 0.0f, 0.0f);
+                filterPassUniform2f(graph, pass, "frame_size",
+                        _geo.width, _geo.height);
+        }
+        filterPassWrite(graph, pass, "hexagons");
+        filterPassUniform(graph, pass, "poly_rad", 1, &params->radius);
+        filterPassUniform1i(graph, pass, "num_points", params->points);
+        filterPassUniform(graph, pass, "line_width", 1, &params->line_width);
+        int hexagon_pass = pass;
+
+        if (_nv12) {
+                addNv12Passes(graph, "hexagons", width, height);
+        }
+        filterGraphCompile(graph);
+        filterGraphSetInput(graph, "frame", _texture);
+        if (average == CELL_SAT_CPU) {
+                filterGraphSetInput(graph, "sat", _sat_texture);
+        }
+        return hexagon_pass;
 }
 
-static void initializeContext(void) {
-        ogl(glGenVertexArrays(1, &_vao));
-        ogl(glBindVertexArray(_vao));
-        ogl(glGenBuffers(1, &_vbo));
-        ogl(glGenBuffers(1, &_vbo_idx));
+static void initializeContext(int fuse_fetches) {
         ogl(glGenTextures(1, &_texture));
-
-        setGlProgram(frag_texture, vert_passthru);
-
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-
-        ogl(glGenFramebuffers(1, &_fb_hexagonalize));
-        ogl(glGenTextures(1, &_texture_hexagonalize_fb));
-        ogl(glBindTexture(GL_TEXTURE_2D, _texture_hexagonalize_fb));
-        ogl(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, TEX_WIDTH, TEX_HEIGHT, 0,
-                GL_RGB, GL_UNSIGNED_BYTE, NULL));
+        ogl(glActiveTexture(GL_TEXTURE0));
+        ogl(glBindTexture(GL_TEXTURE_2D, _texture));
         ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
         ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
         ogl(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
         ogl(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-        ogl(glBindTexture(GL_TEXTURE_2D, 0));
-}
-
-static void renderTexturedQuad(bool inverted) {
-        ogl(glClearColor(0, 1, 0, 1));
-        ogl(glUseProgram(_program_id));
-
-        ogl(_texture_location_in_shader = glGetUniformLocation(_program_id, "tex_input"));
-        ogl(glUniform1i(_texture_location_in_shader, 0));
-
-        ogl(glBindVertexArray(_vao));
-
-        ogl(glBindBuffer(GL_ARRAY_BUFFER, _vbo));
-        if (inverted) {
-                ogl(glBufferData(GL_ARRAY_BUFFER, sizeof(QuadData),
-                        QuadData_inverted, GL_STATIC_DRAW));
+        if (_input_format == INPUT_BGR) {
+                ogl(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, _geo.window_width,
+                        _geo.window_height, 0, GL_BGR, GL_UNSIGNED_BYTE,
+                        NULL));
         }
         else {
-                ogl(glBufferData(GL_ARRAY_BUFFER, sizeof(QuadData),
-                        QuadData, GL_STATIC_DRAW));
+                ogl(glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, _geo.window_width,
+                        frameRows(_geo.window_height), 0, GL_RED,
+                        GL_UNSIGNED_BYTE, NULL));
         }
+        filterQuadInit(&_quad);
 
-        ogl(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _vbo_idx));
-        ogl(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                sizeof(QuadIndices), QuadIndices, GL_STATIC_DRAW));
-
-        ogl(glVertexAttribPointer(_position_attr, VertexStride,
-                GL_FLOAT, GL_FALSE, 0,
-                (GLvoid *) (CoordOffset * sizeof(GLfloat))));
-        ogl(glVertexAttribPointer(_tex_coord_attr, TexCoordStride,
-                GL_FLOAT, GL_FALSE, 0,
-                (GLvoid *) (TexCoordOffset * sizeof(GLfloat))));
-
-        ogl(glEnableVertexAttribArray(_position_attr));
-        ogl(glEnableVertexAttribArray(_tex_coord_attr));
+        size_t pixels = (size_t)_geo.window_width * _geo.window_height;
+        _sat_scene = (uint8_t*)malloc(pixels * 3);
+        _sat_table = (float*)malloc(pixels * 3 * sizeof(float));
+        if (!_sat_scene || !_sat_table) {
+                perror("malloc");
+                exit(-1);
+        }
+        ogl(glGenTextures(1, &_sat_texture));
+        ogl(glBindTexture(GL_TEXTURE_2D, _sat_texture));
+        ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+        ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+        ogl(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, _geo.window_width,
+                _geo.window_height, 0, GL_RGB, GL_FLOAT, NULL));
 
-        ogl(glDrawElements(GL_TRIANGLES, NumIndices, GL_UNSIGNED_INT, 0));
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        ogl(glClearColor(0, 1, 0, 1));
 
-        ogl(glDisableVertexAttribArray(_tex_coord_attr));
-        ogl(glDisableVertexAttribArray(_position_attr));
+        _hexagon_pass = initializeGraph(&_graph, fuse_fetches, &_params);
+}
 
-        ogl(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
-        ogl(glBindBuffer(GL_ARRAY_BUFFER, 0));
-        ogl(glBindVertexArray(0));
+static void destroyHexagons(void) {
+        filterGraphDestroy(&_graph);
+        filterQuadDestroy(&_quad);
+        ogl(glDeleteTextures(1, &_texture));
+        ogl(glDeleteTextures(1, &_sat_texture));
+        free(_sat_scene);
+        free(_sat_table);
+        programCacheDestroy(&_programs);
 }
 
 /*****************************************************************************
  * Rendering RGB to YUV
  ****************************************************************************/
-static void uploadTexture(void) {
-        FILE *fin = fopen("me_no_bg.rgb", "rb");
-        //FILE *fin = fopen("cat_1024_768.rgb", "rb");
+/* the frame every path starts from, in the --input-format layout */
+static uint8_t *readFrame(const char *path) {
+        FILE *fin = fopen(path, "rb");
         if (!fin) {
-                perror("fopen");
+                perror(path);
                 exit(-1);
         }
 
-        size_t buf_size = TEX_WIDTH * TEX_HEIGHT * 3;
-        void *buf = malloc(buf_size);
+        size_t buf_size = inputSize(_geo.width, _geo.height);
+        uint8_t *buf = (uint8_t*)malloc(buf_size);
         if (!buf) {
                 perror("malloc");
                 exit(-1);
@@ -412,31 +785,47 @@ static void uploadTexture(void) {
                 perror("fread");
                 exit(-1);
         }
+        fclose(fin);
+        return buf;
+}
 
+/*
+ * A window in the --input-format layout into the graph's "frame". The
+ * planes go up as they are, the YUV to RGB conversion is the rotate pass.
+ */
+static void uploadWindow(const uint8_t *frame) {
+        int width = _geo.window_width;
+        int height = _geo.window_height;
         ogl(glActiveTexture(GL_TEXTURE0));
         ogl(glBindTexture(GL_TEXTURE_2D, _texture));
-
-        ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
-        ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
-        ogl(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-        ogl(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-
-        ogl(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
-                TEX_WIDTH, TEX_HEIGHT,
-                0, GL_BGR,
-                GL_UNSIGNED_BYTE, buf));
-
-        fclose(fin);
-        free(buf);
+        ogl(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+        switch (_input_format) {
+        case INPUT_BGR:
+                ogl(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+                        GL_BGR, GL_UNSIGNED_BYTE, frame));
+                break;
+        case INPUT_NV12:
+                ogl(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width,
+                        frameRows(height), GL_RED, GL_UNSIGNED_BYTE, frame));
+                break;
+        case INPUT_I420: {
+                const uint8_t *u = frame + (size_t)width * height;
+                const uint8_t *v = u + (size_t)width * height / 4;
+                ogl(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+                        GL_RED, GL_UNSIGNED_BYTE, frame));
+                ogl(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, height,
+                        width / 2, height / 2, GL_RED, GL_UNSIGNED_BYTE, u));
+                ogl(glTexSubImage2D(GL_TEXTURE_2D, 0, width / 2, height,
+                        width / 2, height / 2, GL_RED, GL_UNSIGNED_BYTE, v));
+                break;
+        }
+        }
 }
 
-static void renderFbWithShader(void) {
-        ogl(glBindFramebuffer(GL_FRAMEBUFFER, 0));
-        ogl(glViewport(0, 0, TEX_WIDTH, TEX_HEIGHT));
-        ogl(glClear(GL_COLOR_BUFFER_BIT));
-        setGlProgramForRgb2Yuv();
-        ogl(glBindTexture(GL_TEXTURE_2D, _texture_hexagonalize_fb));
-        renderTexturedQuad(true);
+static void uploadTexture(const char *path) {
+        uint8_t *buf = readFrame(path);
+        uploadWindow(buf);
+        free(buf);
 }
 
 static void writeToFile(void *data, size_t size, const char *fname)
@@ -455,69 +844,1276 @@ static void writeToFile(void *data, size_t size, const char *fname)
         fclose(fout);
 }
 
-static void dumpOutputToFile(void) {
-        size_t buf_size = TEX_WIDTH * TEX_HEIGHT * 3;
-        char *buf = (char*)malloc(buf_size);
-        if (!buf) {
-                perror("malloc");
-                exit (-1);
+static size_t outputSize(void) {
+        if (_nv12) {
+                return (size_t)_geo.width * _geo.height * 3 / 2;
         }
-        ogl(glFinish());
+        return (size_t)_geo.width * _geo.height * 3;
+}
+
+/* a rectangle of the output in out.bin's layout, even for NV12 */
+static void readOutputRect(const FilterGraph *graph, int x, int y,
+        int width, int height, char *buf)
+{
         ogl(glPixelStorei(GL_PACK_ALIGNMENT, 1));
         ogl(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
         ogl(glPixelStorei(GL_PACK_ROW_LENGTH, 0));
         ogl(glPixelStorei(GL_PACK_SKIP_ROWS, 0));
         ogl(glPixelStorei(GL_PACK_SKIP_PIXELS, 0));
-        ogl(glReadPixels(0, 0, TEX_WIDTH, TEX_HEIGHT,
-                GL_RGB, GL_UNSIGNED_BYTE, buf));
+        if (!_nv12) {
+                filterGraphBindRead(graph, "hexagons");
+                ogl(glReadPixels(x, y, width, height,
+                        GL_RGB, GL_UNSIGNED_BYTE, buf));
+                return;
+        }
+        filterGraphBindRead(graph, "y");
+        ogl(glReadPixels(x, y, width, height,
+                GL_RED, GL_UNSIGNED_BYTE, buf));
+        filterGraphBindRead(graph, "uv");
+        ogl(glReadPixels(x / 2, y / 2, width / 2, height / 2,
+                GL_RG, GL_UNSIGNED_BYTE, buf + (size_t)width * height));
+}
 
-        writeToFile(buf, buf_size, "out.bin");
+static void readOutput(const FilterGraph *graph, char *buf) {
+        readOutputRect(graph, 0, 0, _geo.window_width, _geo.window_height,
+                buf);
+}
+
+static char *mallocOutput(void) {
+        char *buf = (char*)malloc(outputSize());
+        if (!buf) {
+                perror("malloc");
+                exit (-1);
+        }
+        return buf;
+}
+
+static void dumpOutputToFile(void) {
+        char *buf = mallocOutput();
+        ogl(glFinish());
+        readOutput(&_graph, buf);
+        writeToFile(buf, outputSize(), "out.bin");
         free(buf);
 }
 
-int main(void) {
-        glfwInit();
-        glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-#ifndef SHOW_IMAGE
-        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
-#endif
-        glfwWindowHint(GLFW_ALPHA_BITS, 0);
-        glfwWindowHint(GLFW_DEPTH_BITS, 0);
-        glfwWindowHint(GLFW_STENCIL_BITS, 0);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
-		glfwWindowHint (GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-		glfwWindowHint (GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-        GLFWwindow* window = glfwCreateWindow(TEX_WIDTH, TEX_HEIGHT,
-                "OpenGL", NULL, NULL);
-        glfwMakeContextCurrent(window);
-
-        initializeContext();
-        uploadTexture();
-
-        ogl(glBindFramebuffer(GL_FRAMEBUFFER, _fb_hexagonalize));
+/*
+ * The table the GPU scan builds, in one pass over the scene: every sum
+ * is its row's running sum plus the sum above it. Like the scan it sums
+ * color - 0.5, in doubles, and leaves the alpha of the upload at 1.
+ */
+static void buildSatTable(const uint8_t *scene, float *table) {
+        int row_size = _geo.window_width * 3;
+        double *column = (double*)calloc(row_size, sizeof(double));
+        if (!column) {
+                perror("calloc");
+                exit(-1);
+        }
+        for (int y = 0; y < _geo.window_height; y++) {
+                double row[3] = { 0.0, 0.0, 0.0 };
+                const uint8_t *src = scene + (size_t)y * row_size;
+                float *dst = table + (size_t)y * row_size;
+                for (int x = 0; x < row_size; x++) {
+                        row[x % 3] += src[x] / 255.0 - 0.5;
+                        column[x] += row[x % 3];
+                        dst[x] = (float)column[x];
+                }
+        }
+        free(column);
+}
+
+/*
+ * Runs the graph. With CELL_SAT_CPU the rotate pass runs first and
+ * "scene" is read back, which waits for the GPU, to upload its table
+ * before the rest of the passes.
+ */
+static void renderHexagons(const FilterGraph *graph, CellAverage average) {
+        if (average != CELL_SAT_CPU) {
+                filterGraphRun(graph);
+                return;
+        }
+        filterGraphRunPasses(graph, 0, 1);
+        ogl(glPixelStorei(GL_PACK_ALIGNMENT, 1));
+        filterGraphBindRead(graph, "scene");
+        ogl(glReadPixels(0, 0, _geo.window_width, _geo.window_height,
+                GL_RGB, GL_UNSIGNED_BYTE, _sat_scene));
+        buildSatTable(_sat_scene, _sat_table);
+        ogl(glBindTexture(GL_TEXTURE_2D, _sat_texture));
+        ogl(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+        ogl(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, _geo.window_width,
+                _geo.window_height, GL_RGB, GL_FLOAT, _sat_table));
+        filterGraphRunPasses(graph, 1, graph->num_passes - 1);
+}
+
+static double timeGraph(const FilterGraph *graph, CellAverage average,
+        int frames)
+{
+        renderHexagons(graph, average);
+        ogl(glFinish());
+        double start = nowSeconds();
+        for (int i = 0; i < frames; i++) {
+                renderHexagons(graph, average);
+        }
+        ogl(glFinish());
+        return (nowSeconds() - start) / frames;
+}
+
+/* the largest and the mean difference of two graphs' outputs */
+static void compareOutputs(const FilterGraph *a, const FilterGraph *b,
+        int *max_diff, double *mean_diff)
+{
+        char *buf_a = mallocOutput();
+        char *buf_b = mallocOutput();
+        readOutput(a, buf_a);
+        readOutput(b, buf_b);
+        int max = 0;
+        double total = 0.0;
+        for (size_t i = 0; i < outputSize(); i++) {
+                int diff = abs((uint8_t)buf_a[i] - (uint8_t)buf_b[i]);
+                max = diff > max ? diff : max;
+                total += diff;
+        }
+        free(buf_a);
+        free(buf_b);
+        if (max_diff) {
+                *max_diff = max;
+        }
+        if (mean_diff) {
+                *mean_diff = total / outputSize();
+        }
+}
+
+/*
+ * Renders the frame with every stage a pass of its own and with fusion,
+ * and compares the traffic through render targets, the frame time and
+ * the output.
+ */
+static void benchFusion(int frames, int fuse_fetches) {
+        FilterGraph unfused;
+        FilterGraph fused;
+        initializeGraph(&unfused, 0, &_params);
+        initializeGraph(&fused, fuse_fetches, &_params);
+        filterGraphPrintStats(&unfused, "unfused");
+        filterGraphPrintStats(&fused, "fused");
+
+        double unfused_time = timeGraph(&unfused, _params.average, frames);
+        double fused_time = timeGraph(&fused, _params.average, frames);
+
+        int max_diff;
+        compareOutputs(&unfused, &fused, &max_diff, NULL);
+
+        size_t saved = filterGraphTraffic(&unfused)
+                - filterGraphTraffic(&fused);
+        printf("fusion (up to %d fetches per pixel) saves %.1f MB/frame of "
+                "target traffic, %.3f -> %.3f ms/frame over %d frames, "
+                "max output difference %d\n",
+                fuse_fetches, saved / 1048576.0, unfused_time * 1e3,
+                fused_time * 1e3, frames, max_diff);
+
+        filterGraphDestroy(&unfused);
+        filterGraphDestroy(&fused);
+}
+
+/*
+ * Times the sampled cells against both summed-area tables for cell radii
+ * from 5 to 60 pixels. Every way costs the same at any radius, but the
+ * samples see 21 pixels of a cell and the tables all of them, the mean
+ * difference is how far the samples are off the true cell average.
+ */
+static void benchCells(int frames, int fuse_fetches) {
+        printf("radius  samples ms  gpu table ms  cpu table ms  "
+                "mean difference\n");
+        for (size_t i = 0; i < sizeof(BenchRadius) / sizeof(BenchRadius[0]);
+                i++)
+        {
+                FilterGraph graph[NUM_CELL_AVERAGES];
+                double time[NUM_CELL_AVERAGES];
+                for (int a = 0; a < NUM_CELL_AVERAGES; a++) {
+                        HexagonParams params = _params;
+                        params.average = (CellAverage)a;
+                        params.radius = BenchRadius[i];
+                        initializeGraph(&graph[a], fuse_fetches, &params);
+                        time[a] = timeGraph(&graph[a], (CellAverage)a,
+                                frames);
+                }
+                double mean_diff;
+                compareOutputs(&graph[CELL_SAMPLES], &graph[CELL_SAT_GPU],
+                        NULL, &mean_diff);
+                printf("%6.1f  %10.3f  %12.3f  %12.3f  %15.2f\n",
+                        BenchRadius[i], time[CELL_SAMPLES] * 1e3,
+                        time[CELL_SAT_GPU] * 1e3, time[CELL_SAT_CPU] * 1e3,
+                        mean_diff);
+                for (int a = 0; a < NUM_CELL_AVERAGES; a++) {
+                        filterGraphDestroy(&graph[a]);
+                }
+        }
+}
+
+/*
+ * Times the loop and the analytic grid with the cells filled the same
+ * way, the difference per pixel is what finding the edges costs.
+ */
+static void benchGrid(int frames, int fuse_fetches) {
+        static const char *name[NUM_GRIDS] = { "loop", "analytic" };
+        FilterGraph graph[NUM_GRIDS];
+        double time[NUM_GRIDS];
+        for (int g = 0; g < NUM_GRIDS; g++) {
+                HexagonParams params = _params;
+                params.grid = (HexGrid)g;
+                initializeGraph(&graph[g], fuse_fetches, &params);
+                time[g] = timeGraph(&graph[g], params.average, frames);
+                printf("%-8s grid: %.3f ms/frame, %.1f ns/pixel\n", name[g],
+                        time[g] * 1e3,
+                        time[g] * 1e9 / ((size_t)_geo.width * _geo.height));
+        }
+        double mean_diff;
+        compareOutputs(&graph[GRID_LOOP], &graph[GRID_ANALYTIC], NULL,
+                &mean_diff);
+        printf("analytic grid saves %.1f ns/pixel over %d frames, "
+                "mean output difference %.2f\n",
+                (time[GRID_LOOP] - time[GRID_ANALYTIC]) * 1e9
+                        / ((size_t)_geo.width * _geo.height), frames,
+                mean_diff);
+        for (int g = 0; g < NUM_GRIDS; g++) {
+                filterGraphDestroy(&graph[g]);
+        }
+}
+
+/*****************************************************************************
+ * Tiles
+ ****************************************************************************/
+/*
+ * How far from a pixel its cell's samples reach. Only pixels on an edge
+ * of their polygon are filled, at most poly_rad and half a line from its
+ * center, and the samples reach poly_rad further. A pixel more covers
+ * the rounding.
+ */
+static int hexagonHalo(const HexagonParams *params) {
+        return (int)ceilf(2.0f * params->radius + params->line_width) + 1;
+}
+
+/* the tile out of a window's output, at its place in out.bin */
+static void writeTile(int fd, const Tile *tile, const char *buf) {
+        bool ok;
+        if (!_nv12) {
+                RawRect rgb = { 0, (size_t)_geo.width * 3, 3,
+                        tile->x, tile->y, tile->width, tile->height };
+                ok = rawRectWrite(fd, &rgb, buf, tile->width * 3);
+        }
+        else {
+                RawRect y = { 0, (size_t)_geo.width, 1,
+                        tile->x, tile->y, tile->width, tile->height };
+                RawRect uv = { (off_t)_geo.width * _geo.height,
+                        (size_t)_geo.width, 2, tile->x / 2, tile->y / 2,
+                        tile->width / 2, tile->height / 2 };
+                ok = rawRectWrite(fd, &y, buf, tile->width)
+                        && rawRectWrite(fd, &uv,
+                                buf + (size_t)tile->width * tile->height,
+                                tile->width);
+        }
+        if (!ok) {
+                exit(-1);
+        }
+}
+
+/*
+ * Reads the window at x, y of the frame in fd into the layout
+ * uploadWindow() takes, plane by plane for YUV.
+ */
+static bool readWindow(int fd, int x, int y, uint8_t *window) {
+        int width = _geo.window_width;
+        int height = _geo.window_height;
+        size_t luma = (size_t)_geo.width * _geo.height;
+        size_t window_luma = (size_t)width * height;
+        if (_input_format == INPUT_BGR) {
+                RawRect src = { 0, (size_t)_geo.width * 3, 3, x, y,
+                        width, height };
+                return rawRectRead(fd, &src, window, width * 3);
+        }
+        RawRect y_plane = { 0, (size_t)_geo.width, 1, x, y, width, height };
+        if (!rawRectRead(fd, &y_plane, window, width)) {
+                return false;
+        }
+        if (_input_format == INPUT_NV12) {
+                RawRect uv = { (off_t)luma, (size_t)_geo.width, 2, x / 2,
+                        y / 2, width / 2, height / 2 };
+                return rawRectRead(fd, &uv, window + window_luma, width);
+        }
+        RawRect u = { (off_t)luma, (size_t)_geo.width / 2, 1, x / 2, y / 2,
+                width / 2, height / 2 };
+        RawRect v = u;
+        v.offset += luma / 4;
+        return rawRectRead(fd, &u, window + window_luma, width / 2)
+                && rawRectRead(fd, &v, window + window_luma * 5 / 4,
+                        width / 2);
+}
+
+/*
+ * Renders out.bin a tile at a time from the input file at path. Every
+ * window is read with its halo, turned and hexagonalized in frame
+ * coordinates, and only the tile in it is read back and written, so no
+ * buffer is larger than a window.
+ */
+static void renderTiles(const char *path, const TileGrid *grid) {
+        int in = open(path, O_RDONLY);
+        if (in < 0) {
+                perror(path);
+                exit(-1);
+        }
+        int out = open("out.bin", O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (out < 0 || ftruncate(out, outputSize())) {
+                perror("out.bin");
+                exit(-1);
+        }
+        size_t window_size =
+                (size_t)grid->window_width * grid->window_height * 3;
+        uint8_t *window = (uint8_t*)malloc(
+                inputSize(grid->window_width, grid->window_height));
+        char *tile_buf = (char*)malloc(window_size);
+        if (!window || !tile_buf) {
+                perror("malloc");
+                exit(-1);
+        }
+
+        for (int i = 0; i < tileGridCount(grid); i++) {
+                Tile tile;
+                tileGridGet(grid, i, &tile);
+                /* the scene is the frame turned, its window is mirrored */
+                if (!readWindow(in,
+                        _geo.width - tile.window_x - grid->window_width,
+                        _geo.height - tile.window_y - grid->window_height,
+                        window))
+                {
+                        printf("%s: not a %dx%d frame\n", path,
+                                _geo.width, _geo.height);
+                        exit(-1);
+                }
+                uploadWindow(window);
+                filterPassUniform2f(&_graph, _hexagon_pass, "tile_origin",
+                        tile.window_x, tile.window_y);
+                renderHexagons(&_graph, _params.average);
+                readOutputRect(&_graph, tile.x - tile.window_x,
+                        tile.y - tile.window_y, tile.width, tile.height,
+                        tile_buf);
+                writeTile(out, &tile, tile_buf);
+        }
+
+        free(window);
+        free(tile_buf);
+        close(in);
+        close(out);
+}
+
+static double timeTiles(const char *path, const TileGrid *grid,
+        int frames)
+{
+        double start = nowSeconds();
+        for (int i = 0; i < frames; i++) {
+                renderTiles(path, grid);
+        }
+        return (nowSeconds() - start) / frames;
+}
+
+/*****************************************************************************
+ * Video
+ *
+ * Most of a talking-head clip stands still, so --video keeps the colors
+ * the cells were last drawn with and redraws only the cells whose color
+ * moved. Every frame the cells graph renders one texel per polygon, the
+ * colors are read back and compared, and the changed cells are drawn into
+ * an output that persists from frame to frame. A cell's quad is its
+ * polygon's bounding box widened by the edge line, every pixel whose
+ * color the cell decides lies in it.
+ ****************************************************************************/
+/* what --video redraws per frame */
+enum VideoMode {
+        VIDEO_OFF,
+        VIDEO_CELLS,
+        /* the whole graph, to compare against */
+        VIDEO_FULL,
+};
+
+static const float DefaultVideoThreshold = 1.0f;
+
+struct HexagonVideo {
+        /* "frame" turned into "scene" and averaged into "cells" */
+        FilterGraph cells;
+        /* the output turned into the "y" and "uv" planes for NV12 */
+        FilterGraph nv12;
+        /* lattice points covering the frame */
+        int columns;
+        int rows;
+        /* RGBA per cell, a row holds the left then the gray right half */
+        float *average;
+        float *drawn;
+        GLuint drawn_texture;
+        /* two triangles per changed cell */
+        float *quads;
+        GLuint program;
+        GLuint vao;
+        GLuint vbo;
+        GLuint output;
+        GLuint fbo;
+        /* the color change redrawing a cell, 0..1 */
+        float threshold;
+        bool first;
+        long drawn_cells;
+        long skipped_cells;
+};
+
+static GLuint videoTexture(GLenum internal_format, int width, int height,
+        GLenum format, GLenum type)
+{
+        GLuint texture;
+        ogl(glGenTextures(1, &texture));
+        ogl(glBindTexture(GL_TEXTURE_2D, texture));
+        ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+        ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+        ogl(glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height,
+                0, format, type, NULL));
+        return texture;
+}
+
+static GLuint videoProgram(const HexagonVideo *video) {
+        const char *vert[] = { GlslVersion, vert_cells };
+        const char *frag[] = {
+                GlslVersion,
+                _params.grid == GRID_LOOP ?
+                        stage_grid_loop : stage_grid_analytic,
+                frag_cells,
+        };
+        ProgramDesc desc;
+        programDescInit(&desc);
+        programDescAddStage(&desc, GL_VERTEX_SHADER, 2, vert);
+        programDescAddStage(&desc, GL_FRAGMENT_SHADER, 3, frag);
+        desc.attrib[0] = "position";
+        desc.frag_out = "color";
+        GLuint program = programCacheRequest(&_programs, &desc);
+        programCacheFinish(&_programs);
+        if (!programCacheLinked(program)) {
+                puts("the --video program did not link");
+                exit(-1);
+        }
+
+        ogl(glUseProgram(program));
+        ogl(glUniform1i(glGetUniformLocation(program, "cells"), 0));
+        ogl(glUniform2f(glGetUniformLocation(program, "frame_size"),
+                _geo.width, _geo.height));
+        ogl(glUniform1f(glGetUniformLocation(program, "cell_columns"),
+                video->columns));
+        ogl(glUniform1f(glGetUniformLocation(program, "poly_rad"),
+                _params.radius));
+        ogl(glUniform1i(glGetUniformLocation(program, "num_points"),
+                _params.points));
+        ogl(glUniform1f(glGetUniformLocation(program, "line_width"),
+                _params.line_width));
+        ogl(glUseProgram(0));
+        return program;
+}
+
+static void initializeVideo(HexagonVideo *video, int fuse_fetches,
+        float threshold)
+{
+        int width = _geo.width;
+        int height = _geo.height;
+        memset(video, 0, sizeof(*video));
+        video->columns = (int)ceilf(width / (2.0f * _params.radius)) + 1;
+        video->rows = (int)ceilf(height / (1.7f * _params.radius)) + 1;
+        video->threshold = threshold;
+        video->first = true;
+        size_t cells = (size_t)video->columns * video->rows;
+        video->average = (float*)malloc(cells * 8 * sizeof(float));
+        video->drawn = (float*)malloc(cells * 8 * sizeof(float));
+        video->quads = (float*)malloc(cells * 12 * sizeof(float));
+        if (!video->average || !video->drawn || !video->quads) {
+                perror("malloc");
+                exit(-1);
+        }
+
+        FilterGraph *graph = &video->cells;
+        filterGraphInit(graph, &_quad, &_programs);
+        filterGraphSetFusion(graph, fuse_fetches);
+        filterGraphAddInput(graph, "frame", width, frameRows(height));
+        filterGraphAddTarget(graph, "scene", width, height, GL_RGB8);
+        filterGraphAddTarget(graph, "cells", 2 * video->columns, video->rows,
+                GL_RGBA32F);
+        addRotatePass(graph);
+        int pass = filterGraphAddStage(graph, "cellavg",
+                cellsSource(_params.grid), 21, 0);
+        filterPassRead(graph, pass, "scene", NULL, 0);
+        filterPassWrite(graph, pass, "cells");
+        float columns = video->columns;
+        filterPassUniform(graph, pass, "cell_columns", 1, &columns);
+        filterPassUniform(graph, pass, "poly_rad", 1, &_params.radius);
+        filterPassUniform2f(graph, pass, "tile_origin", 0.0f, 0.0f);
+        filterPassUniform2f(graph, pass, "frame_size", width, height);
+        filterGraphCompile(graph);
+        filterGraphSetInput(graph, "frame", _texture);
+
+        video->drawn_texture = videoTexture(GL_RGBA32F, 2 * video->columns,
+                video->rows, GL_RGBA, GL_FLOAT);
+        video->output = videoTexture(GL_RGB8, width, height, GL_RGB,
+                GL_UNSIGNED_BYTE);
+        ogl(glGenFramebuffers(1, &video->fbo));
+        ogl(glBindFramebuffer(GL_FRAMEBUFFER, video->fbo));
         ogl(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                GL_TEXTURE_2D, _texture_hexagonalize_fb, 0));
+                GL_TEXTURE_2D, video->output, 0));
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER)
+                != GL_FRAMEBUFFER_COMPLETE)
+        {
+                puts("incomplete --video framebuffer");
+                exit(-1);
+        }
+        ogl(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+
+        ogl(glGenVertexArrays(1, &video->vao));
+        ogl(glGenBuffers(1, &video->vbo));
+        ogl(glBindVertexArray(video->vao));
+        ogl(glBindBuffer(GL_ARRAY_BUFFER, video->vbo));
+        ogl(glBufferData(GL_ARRAY_BUFFER, cells * 12 * sizeof(float), NULL,
+                GL_STREAM_DRAW));
+        ogl(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0));
+        ogl(glEnableVertexAttribArray(0));
+        ogl(glBindVertexArray(0));
+        video->program = videoProgram(video);
+
+        if (_nv12) {
+                graph = &video->nv12;
+                filterGraphInit(graph, &_quad, &_programs);
+                filterGraphAddInput(graph, "hexagons", width, height);
+                addNv12Passes(graph, "hexagons", width, height);
+                filterGraphCompile(graph);
+                filterGraphSetInput(graph, "hexagons", video->output);
+        }
+}
+
+static void destroyVideo(HexagonVideo *video) {
+        filterGraphDestroy(&video->cells);
+        if (_nv12) {
+                filterGraphDestroy(&video->nv12);
+        }
+        ogl(glDeleteTextures(1, &video->drawn_texture));
+        ogl(glDeleteTextures(1, &video->output));
+        ogl(glDeleteFramebuffers(1, &video->fbo));
+        ogl(glDeleteVertexArrays(1, &video->vao));
+        ogl(glDeleteBuffers(1, &video->vbo));
+        free(video->average);
+        free(video->drawn);
+        free(video->quads);
+}
 
-        GLenum status;
-        ogl(status = glCheckFramebufferStatus(GL_FRAMEBUFFER));
-        if (status != GL_FRAMEBUFFER_COMPLETE) {
-                puts("failed binding framebuffer");
+static bool cellMoved(const float *average, const float *drawn,
+        float threshold)
+{
+        for (int c = 0; c < 3; c++) {
+                if (fabsf(average[c] - drawn[c]) > threshold) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+/*
+ * Reads the cell colors back, keeps the ones that moved as the colors
+ * drawn and returns how many quads it left in video->quads.
+ */
+static int updateCells(HexagonVideo *video) {
+        int width = 2 * video->columns;
+        filterGraphBindRead(&video->cells, "cells");
+        ogl(glPixelStorei(GL_PACK_ALIGNMENT, 4));
+        ogl(glReadPixels(0, 0, width, video->rows, GL_RGBA, GL_FLOAT,
+                video->average));
+
+        float vrad_x = 2.0f * _params.radius;
+        float vrad_y = 1.7f * _params.radius;
+        float reach = _params.radius + _params.line_width + 1.0f;
+        int count = 0;
+        for (int y = 0; y < video->rows; y++) {
+                for (int x = 0; x < video->columns; x++) {
+                        size_t left = ((size_t)y * width + x) * 4;
+                        size_t right = left + (size_t)video->columns * 4;
+                        if (!video->first
+                                && !cellMoved(video->average + left,
+                                        video->drawn + left, video->threshold)
+                                && !cellMoved(video->average + right,
+                                        video->drawn + right, video->threshold))
+                        {
+                                continue;
+                        }
+                        memcpy(video->drawn + left, video->average + left,
+                                4 * sizeof(float));
+                        memcpy(video->drawn + right, video->average + right,
+                                4 * sizeof(float));
+                        float x0 = x * vrad_x - reach;
+                        float y0 = y * vrad_y - reach;
+                        float x1 = x * vrad_x + reach;
+                        float y1 = y * vrad_y + reach;
+                        float quad[12] = {
+                                x0, y0, x1, y0, x0, y1,
+                                x0, y1, x1, y0, x1, y1,
+                        };
+                        memcpy(video->quads + count++ * 12, quad,
+                                sizeof(quad));
+                }
+        }
+        video->first = false;
+        video->drawn_cells += count;
+        video->skipped_cells += video->columns * video->rows - count;
+        return count;
+}
+
+static void renderVideoFrame(HexagonVideo *video) {
+        filterGraphRun(&video->cells);
+        int count = updateCells(video);
+        if (!count) {
+                return;
+        }
+
+        ogl(glBindTexture(GL_TEXTURE_2D, video->drawn_texture));
+        ogl(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+        ogl(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 2 * video->columns,
+                video->rows, GL_RGBA, GL_FLOAT, video->drawn));
+        ogl(glBindBuffer(GL_ARRAY_BUFFER, video->vbo));
+        ogl(glBufferSubData(GL_ARRAY_BUFFER, 0,
+                count * 12 * sizeof(float), video->quads));
+
+        ogl(glBindFramebuffer(GL_FRAMEBUFFER, video->fbo));
+        ogl(glViewport(0, 0, _geo.width, _geo.height));
+        ogl(glUseProgram(video->program));
+        ogl(glBindVertexArray(video->vao));
+        ogl(glDrawArrays(GL_TRIANGLES, 0, count * 6));
+        ogl(glBindVertexArray(0));
+        ogl(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+
+        if (_nv12) {
+                filterGraphRun(&video->nv12);
+        }
+}
+
+static void readVideoFrame(const HexagonVideo *video, char *buf) {
+        if (_nv12) {
+                readOutput(&video->nv12, buf);
+                return;
+        }
+        ogl(glPixelStorei(GL_PACK_ALIGNMENT, 1));
+        ogl(glBindFramebuffer(GL_READ_FRAMEBUFFER, video->fbo));
+        ogl(glReadBuffer(GL_COLOR_ATTACHMENT0));
+        ogl(glReadPixels(0, 0, _geo.width, _geo.height, GL_RGB,
+                GL_UNSIGNED_BYTE, buf));
+}
+
+/*
+ * Renders every frame of the clip at path into out.bin, one after the
+ * other. The frame time covers the upload, the render and the readback,
+ * not the disk.
+ */
+static int runVideo(const char *path, VideoMode mode, float threshold,
+        int fuse_fetches)
+{
+        FILE *in = fopen(path, "rb");
+        if (!in) {
+                perror(path);
+                return -1;
+        }
+        FILE *out = fopen("out.bin", "wb");
+        if (!out) {
+                perror("out.bin");
+                fclose(in);
+                return -1;
+        }
+        size_t frame_size = inputSize(_geo.width, _geo.height);
+        uint8_t *frame = (uint8_t*)malloc(frame_size);
+        char *buf = mallocOutput();
+        if (!frame) {
+                perror("malloc");
                 exit(-1);
         }
-        /* render the scene */
-        ogl(glViewport(0, 0, TEX_WIDTH, TEX_HEIGHT));
-        renderTexturedQuad(false);
-        renderFbWithShader();
-        dumpOutputToFile();
+        HexagonVideo video;
+        if (mode == VIDEO_CELLS) {
+                initializeVideo(&video, fuse_fetches, threshold);
+        }
 
-#ifdef SHOW_IMAGE
-        while (!glfwWindowShouldClose(window)) {
-                glfwSwapBuffers(window);
-                glfwPollEvents();
+        int frames = 0;
+        double time = 0.0;
+        while (1 == fread(frame, frame_size, 1, in)) {
+                double start = nowSeconds();
+                uploadWindow(frame);
+                if (mode == VIDEO_CELLS) {
+                        renderVideoFrame(&video);
+                        readVideoFrame(&video, buf);
+                }
+                else {
+                        renderHexagons(&_graph, _params.average);
+                        readOutput(&_graph, buf);
+                }
+                time += nowSeconds() - start;
+                if (1 != fwrite(buf, outputSize(), 1, out)) {
+                        perror("fwrite");
+                        exit(-1);
+                }
+                frames++;
+        }
+
+        if (mode == VIDEO_CELLS) {
+                long cells = video.drawn_cells + video.skipped_cells;
+                fprintf(stderr, "video: %d frames, %ld of %ld cells "
+                        "(%.1f%%) skipped\n", frames, video.skipped_cells,
+                        cells, cells ? 100.0 * video.skipped_cells / cells
+                                : 0.0);
+                filterGraphPrintStats(&video.cells, "video cells");
+                destroyVideo(&video);
+        }
+        else {
+                fprintf(stderr, "video: %d frames redrawn in full\n", frames);
+        }
+        if (frames) {
+                fprintf(stderr, "frame time %.3f ms over %d frames\n",
+                        time / frames * 1e3, frames);
+        }
+        free(frame);
+        free(buf);
+        fclose(in);
+        fclose(out);
+        return frames ? 0 : -1;
+}
+
+/*****************************************************************************
+ * Rendering on the CPU
+ ****************************************************************************/
+/* the loop grid with sampled cells, --grid and --sat have no effect */
+static CpuHexagonParams cpuParams(void) {
+        CpuHexagonParams params = {
+                _params.radius, _params.points, _params.line_width,
+        };
+        return params;
+}
+
+/* what the GPU writes into out.bin, NV12 from cpu_nv12.cc's converter */
+static void renderOnCpu(CpuHexagon *hex, const uint8_t *frame, uint8_t *rgb,
+        uint8_t *buf)
+{
+        CpuHexagonParams params = cpuParams();
+        cpuHexagonRender(hex, frame, _nv12 ? rgb : buf, &params);
+        if (_nv12) {
+                uint8_t *uv = buf + (size_t)_geo.width * _geo.height;
+                cpuRgbToNv12(rgb, _geo.width * 3, buf, _geo.width,
+                        uv, _geo.width, _geo.width, _geo.height,
+                        CPU_KERNEL_AUTO, hex->num_threads);
+        }
+}
+
+/*
+ * Diffs a CPU frame against out.bin from a GPU run with the same options
+ * and --grid=loop, returns 0 when it is within CPU_HEXAGON_TOLERANCE.
+ * NV12 converts with cpu_nv12.cc's fixed point and may round by a level.
+ */
+static int compareWithGpu(const uint8_t *buf) {
+        uint8_t *dump = (uint8_t*)mallocOutput();
+        FILE *fin = fopen("out.bin", "rb");
+        if (!fin || 1 != fread(dump, outputSize(), 1, fin)) {
+                puts("out.bin missing, run the GPU path with --grid=loop "
+                        "first");
+                if (fin) {
+                        fclose(fin);
+                }
+                free(dump);
+                return -1;
+        }
+        fclose(fin);
+
+        int max_err = 0;
+        size_t mismatches = 0;
+        unsigned long long sum = 0;
+        for (size_t i = 0; i < outputSize(); i++) {
+                int e = abs((int)buf[i] - (int)dump[i]);
+                if (e > CPU_HEXAGON_TOLERANCE) {
+                        mismatches++;
+                }
+                max_err = e > max_err ? e : max_err;
+                sum += e;
+        }
+        free(dump);
+
+        double share = (double)mismatches / outputSize();
+        bool ok = share <= CPU_HEXAGON_MAX_MISMATCH;
+        printf("CPU vs GPU: max err %d  mean err %.4f  off by more than %d "
+                "%zu / %zu (%.4f%%, at most %.4f%%) %s\n",
+                max_err, (double)sum / outputSize(), CPU_HEXAGON_TOLERANCE,
+                mismatches, outputSize(), share * 100.0,
+                CPU_HEXAGON_MAX_MISMATCH * 100.0,
+                ok ? "ok" : "MISMATCH");
+        return ok ? 0 : -1;
+}
+
+/*
+ * Times the CPU mosaic on 1, 2, 4... threads up to max_threads, the
+ * speedup is over one thread and steals are tasks a worker took from
+ * another's share, per frame.
+ */
+static void benchCpu(const uint8_t *frame, int frames, int max_threads) {
+        uint8_t *rgb = (uint8_t*)malloc((size_t)_geo.width * _geo.height * 3);
+        if (!rgb) {
+                perror("malloc");
+                exit(-1);
+        }
+        CpuHexagonParams params = cpuParams();
+        double single = 0.0;
+        printf("%8s %10s %8s %8s %8s\n", "threads", "ms/frame", "MP/s",
+                "speedup", "steals");
+        for (int n = 1; ; n = n * 2 < max_threads ? n * 2 : max_threads) {
+                CpuHexagon hex;
+                cpuHexagonInit(&hex, _geo.width, _geo.height, n);
+                cpuHexagonRender(&hex, frame, rgb, &params);
+                hex.steals = 0;
+                double start = nowSeconds();
+                for (int i = 0; i < frames; i++) {
+                        cpuHexagonRender(&hex, frame, rgb, &params);
+                }
+                double elapsed = (nowSeconds() - start) / frames;
+                single = n == 1 ? elapsed : single;
+                printf("%8d %10.3f %8.1f %8.2f %8.1f\n", n, elapsed * 1e3,
+                        (size_t)_geo.width * _geo.height / elapsed * 1e-6,
+                        single / elapsed, (double)hex.steals / frames);
+                cpuHexagonDestroy(&hex);
+                if (n >= max_threads) {
+                        break;
+                }
+        }
+        free(rgb);
+}
+
+/*
+ * Renders out.bin on the CPU, or diffs it against the GPU's with compare,
+ * then times frame_time more frames.
+ */
+static int runOnCpu(const uint8_t *frame, int num_threads, bool compare,
+        int frame_time)
+{
+        CpuHexagon hex;
+        cpuHexagonInit(&hex, _geo.width, _geo.height, num_threads);
+        uint8_t *rgb = (uint8_t*)mallocOutput();
+        uint8_t *buf = (uint8_t*)mallocOutput();
+        if (_nv12) {
+                free(rgb);
+                rgb = (uint8_t*)malloc((size_t)_geo.width * _geo.height * 3);
+                if (!rgb) {
+                        perror("malloc");
+                        exit(-1);
+                }
+        }
+        double start = nowSeconds();
+        renderOnCpu(&hex, frame, rgb, buf);
+        fprintf(stderr, "CPU frame in %.1f ms on %d threads\n",
+                (nowSeconds() - start) * 1e3, hex.num_threads);
+        if (frame_time > 0) {
+                start = nowSeconds();
+                for (int i = 0; i < frame_time; i++) {
+                        renderOnCpu(&hex, frame, rgb, buf);
+                }
+                fprintf(stderr, "frame time %.3f ms over %d frames\n",
+                        (nowSeconds() - start) / frame_time * 1e3,
+                        frame_time);
+        }
+        cpuHexagonDestroy(&hex);
+
+        int status = 0;
+        if (!compare) {
+                writeToFile(buf, outputSize(), "out.bin");
+        }
+        else {
+                status = compareWithGpu(buf);
+        }
+        free(rgb);
+        free(buf);
+        return status;
+}
+
+int main(int argc, char **argv) {
+        ContextBackend backend = CONTEXT_GLFW;
+        const char *program_dir = programCacheDefaultDir();
+        int fuse_fetches = 0;
+        int bench_frames = 0;
+        int bench_cells = 0;
+        int bench_grid = 0;
+        bool cpu_mode = false;
+        bool compare_mode = false;
+        int num_threads = cpuDefaultThreads();
+        int bench_cpu = 0;
+        int frame_time = 0;
+        const char *input = DefaultInput;
+        /* 0 tiles only frames larger than a texture */
+        int tile_size = 0;
+        VideoMode video_mode = VIDEO_OFF;
+        float video_threshold = DefaultVideoThreshold;
+        for (int i = 1; i < argc; i++) {
+                int b = -1;
+                if (!strncmp(argv[i], "--input=", 8)) {
+                        input = argv[i] + 8;
+                        continue;
+                }
+                if (!strncmp(argv[i], "--size=", 7)
+                        && 2 == sscanf(argv[i] + 7, "%dx%d",
+                                &_geo.width, &_geo.height)
+                        && _geo.width > 0 && _geo.height > 0)
+                {
+                        _geo.window_width = _geo.width;
+                        _geo.window_height = _geo.height;
+                        continue;
+                }
+                if (!strcmp(argv[i], "--input-format=bgr")) {
+                        _input_format = INPUT_BGR;
+                        continue;
+                }
+                if (!strcmp(argv[i], "--input-format=nv12")) {
+                        _input_format = INPUT_NV12;
+                        continue;
+                }
+                if (!strcmp(argv[i], "--input-format=i420")) {
+                        _input_format = INPUT_I420;
+                        continue;
+                }
+                if (!strcmp(argv[i], "--tile")) {
+                        tile_size = DEFAULT_TILE;
+                        continue;
+                }
+                if (!strncmp(argv[i], "--tile=", 7) && atoi(argv[i] + 7) > 0) {
+                        tile_size = atoi(argv[i] + 7);
+                        continue;
+                }
+                if (!strcmp(argv[i], "--video")
+                        || !strcmp(argv[i], "--video=cells"))
+                {
+                        video_mode = VIDEO_CELLS;
+                        continue;
+                }
+                if (!strcmp(argv[i], "--video=full")) {
+                        video_mode = VIDEO_FULL;
+                        continue;
+                }
+                if (!strncmp(argv[i], "--video-threshold=", 18)
+                        && atof(argv[i] + 18) >= 0.0)
+                {
+                        video_threshold = atof(argv[i] + 18);
+                        continue;
+                }
+                if (!strncmp(argv[i], "--frame-time=", 13)
+                        && atoi(argv[i] + 13) > 0)
+                {
+                        frame_time = atoi(argv[i] + 13);
+                        continue;
+                }
+                if (!strcmp(argv[i], "--cpu")) {
+                        cpu_mode = true;
+                        continue;
+                }
+                if (!strcmp(argv[i], "--compare")) {
+                        compare_mode = true;
+                        continue;
+                }
+                if (!strncmp(argv[i], "--threads=", 10)
+                        && atoi(argv[i] + 10) > 0)
+                {
+                        num_threads = atoi(argv[i] + 10);
+                        continue;
+                }
+                if (!strncmp(argv[i], "--bench-cpu=", 12)
+                        && atoi(argv[i] + 12) > 0)
+                {
+                        bench_cpu = atoi(argv[i] + 12);
+                        continue;
+                }
+                if (!strcmp(argv[i], "--nv12")) {
+                        _nv12 = true;
+                        continue;
+                }
+                if (!strcmp(argv[i], "--sat")
+                        || !strcmp(argv[i], "--sat=gpu"))
+                {
+                        _params.average = CELL_SAT_GPU;
+                        continue;
+                }
+                if (!strcmp(argv[i], "--sat=cpu")) {
+                        _params.average = CELL_SAT_CPU;
+                        continue;
+                }
+                if (!strncmp(argv[i], "--radius=", 9)
+                        && atof(argv[i] + 9) >= 1.0)
+                {
+                        _params.radius = atof(argv[i] + 9);
+                        continue;
+                }
+                if (!strncmp(argv[i], "--points=", 9)
+                        && atoi(argv[i] + 9) >= 3)
+                {
+                        _params.points = atoi(argv[i] + 9);
+                        continue;
+                }
+                if (!strncmp(argv[i], "--line-width=", 13)
+                        && atof(argv[i] + 13) > 0.0)
+                {
+                        _params.line_width = atof(argv[i] + 13);
+                        continue;
+                }
+                if (!strcmp(argv[i], "--grid=loop")) {
+                        _params.grid = GRID_LOOP;
+                        continue;
+                }
+                if (!strcmp(argv[i], "--grid=analytic")) {
+                        _params.grid = GRID_ANALYTIC;
+                        continue;
+                }
+                if (!strncmp(argv[i], "--bench-grid=", 13)
+                        && atoi(argv[i] + 13) > 0)
+                {
+                        bench_grid = atoi(argv[i] + 13);
+                        continue;
+                }
+                if (!strncmp(argv[i], "--bench-cells=", 14)
+                        && atoi(argv[i] + 14) > 0)
+                {
+                        bench_cells = atoi(argv[i] + 14);
+                        continue;
+                }
+                if (!strcmp(argv[i], "--fuse")) {
+                        fuse_fetches = DefaultFuseFetches;
+                        continue;
+                }
+                if (!strncmp(argv[i], "--fuse=", 7) && atoi(argv[i] + 7) > 0) {
+                        fuse_fetches = atoi(argv[i] + 7);
+                        continue;
+                }
+                if (!strncmp(argv[i], "--bench=", 8) && atoi(argv[i] + 8) > 0) {
+                        bench_frames = atoi(argv[i] + 8);
+                        continue;
+                }
+                if (!strncmp(argv[i], "--program-cache=", 16)) {
+                        program_dir = strcmp(argv[i] + 16, "none") ?
+                                argv[i] + 16 : NULL;
+                        continue;
+                }
+                if (!strncmp(argv[i], "--context=", 10)) {
+                        b = contextBackendFromName(argv[i] + 10);
+                }
+                if (b < 0) {
+                        printf("usage: %s [--context=glfw|egl] "
+                                "[--program-cache=DIR|none] [--nv12] "
+                                "[--sat[=gpu|cpu]] [--grid=analytic|loop] "
+                                "[--radius=PIXELS] [--points=N] "
+                                "[--line-width=PIXELS] "
+                                "[--fuse[=FETCHES]] [--bench=FRAMES] "
+                                "[--bench-cells=FRAMES] "
+                                "[--bench-grid=FRAMES] "
+                                "[--cpu | --compare] [--threads=N] "
+                                "[--bench-cpu=FRAMES] [--input=PATH] "
+                                "[--input-format=bgr|nv12|i420] "
+                                "[--size=WxH] [--tile[=PIXELS]] "
+                                "[--video[=cells|full]] "
+                                "[--video-threshold=LEVELS] "
+                                "[--frame-time=FRAMES]\n"
+                                "  --input  packed BGR frame (default %s)\n"
+                                "  --input-format  packed BGR (default), "
+                                "or NV12 or I420 planes turned into RGB "
+                                "on the GPU\n"
+                                "  --size   frame size (default %dx%d)\n"
+                                "  --tile   render tiles of at most PIXELS "
+                                "(default %d) squared with the halo the "
+                                "samples need, frames larger than a "
+                                "texture always are\n"
+                                "  --video  render every frame of --input "
+                                "into out.bin, redrawing only the cells "
+                                "whose color moved (default) or the whole "
+                                "frame\n"
+                                "  --video-threshold  color change in "
+                                "levels of 255 redrawing a cell "
+                                "(default %.0f)\n"
+                                "  --nv12   write NV12 instead of RGB\n"
+                                "  --sat    average whole cells from a "
+                                "summed-area table instead of 21 samples, "
+                                "scanned on the GPU (default) or CPU\n"
+                                "  --grid   find edges in closed form with "
+                                "anti-aliasing (default) or by walking "
+                                "them\n"
+                                "  --radius, --points, --line-width  "
+                                "polygon radius (default %.0f), corners "
+                                "(%d) and edge width (%.0f)\n"
+                                "  --fuse   chain stages into their readers "
+                                "while a pixel makes at most FETCHES "
+                                "(default %d) texture fetches\n"
+                                "  --bench  time FRAMES frames with and "
+                                "without --fuse and compare the output\n"
+                                "  --bench-cells  time FRAMES frames of "
+                                "samples and --sat at several radii\n"
+                                "  --bench-grid  time FRAMES frames of "
+                                "both grids\n"
+                                "  --cpu    render the loop grid with "
+                                "sampled cells on N threads (default %d) "
+                                "without a GPU\n"
+                                "  --compare  diff the CPU frame against "
+                                "out.bin from a GPU run with --grid=loop\n"
+                                "  --bench-cpu  time FRAMES CPU frames on "
+                                "1, 2, 4... up to N threads\n"
+                                "  --frame-time  time FRAMES more frames "
+                                "after out.bin is written\n",
+                                argv[0], DefaultInput, DEFAULT_WIDTH,
+                                DEFAULT_HEIGHT, DEFAULT_TILE,
+                                DefaultVideoThreshold, DefaultRadius,
+                                DefaultPoints, DefaultLineWidth, DefaultFuseFetches,
+                                cpuDefaultThreads());
+                        return -1;
+                }
+                backend = (ContextBackend)b;
+        }
+
+        if (_input_format != INPUT_BGR
+                && (_geo.width % 2 || _geo.height % 2))
+        {
+                puts("YUV frames need an even size");
+                return -1;
+        }
+        if (cpu_mode || compare_mode || bench_cpu) {
+                if (_input_format != INPUT_BGR) {
+                        puts("the CPU renders packed BGR frames");
+                        return -1;
+                }
+                uint8_t *frame = readFrame(input);
+                if (bench_cpu) {
+                        benchCpu(frame, bench_cpu, num_threads);
+                }
+                int status = 0;
+                if (cpu_mode || compare_mode) {
+                        status = runOnCpu(frame, num_threads, compare_mode,
+                                frame_time);
+                }
+                free(frame);
+                return status;
+        }
+
+        double launch = nowSeconds();
+        GlContext context;
+        if (!contextCreate(&context, backend, DEFAULT_WIDTH, DEFAULT_HEIGHT,
+                3, 2, ShowImage))
+        {
+                return -1;
+        }
+        fprintf(stderr, "%s context created in %.1f ms\n",
+                contextBackendName(backend), context.create_time * 1e3);
+#ifndef __APPLE__
+        glewExperimental = GL_TRUE;
+        GLenum glew_status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+        /* a GLX build of GLEW still resolves the entry points under EGL */
+        if (glew_status == GLEW_ERROR_NO_GLX_DISPLAY) {
+                glew_status = GLEW_OK;
         }
 #endif
+        if (glew_status != GLEW_OK) {
+                printf("glewInit failed: %s\n",
+                        glewGetErrorString(glew_status));
+                return -1;
+        }
+        /* core profiles may flag the extension probing */
+        glGetError();
+#endif
+        oglDebugInit();
+
+        int max_size = oglMaxRenderSize();
+        if (_input_format != INPUT_BGR) {
+                /* the chroma rows below the luma */
+                max_size = max_size * 2 / 3;
+        }
+        bool tiled = tile_size || _geo.width > max_size
+                || _geo.height > max_size;
+        TileGrid grid;
+        if (tiled) {
+                if (_params.average != CELL_SAMPLES) {
+                        puts("tiles need sampled cells, the summed-area "
+                                "tables span the whole frame");
+                        return -1;
+                }
+                if (bench_frames || bench_cells || bench_grid) {
+                        puts("the benchmarks render whole frames");
+                        return -1;
+                }
+                if (!tileGridInit(&grid, _geo.width, _geo.height,
+                        tile_size ? tile_size : DEFAULT_TILE,
+                        hexagonHalo(&_params), max_size,
+                        _nv12 || _input_format != INPUT_BGR ? 2 : 1))
+                {
+                        printf("no tiles of %dx%d fit %d pixel textures\n",
+                                _geo.width, _geo.height, max_size);
+                        return -1;
+                }
+                _geo.window_width = grid.window_width;
+                _geo.window_height = grid.window_height;
+                fprintf(stderr, "%d tiles of %dx%d in %dx%d windows, "
+                        "halo %d\n", tileGridCount(&grid), grid.tile_width,
+                        grid.tile_height, grid.window_width,
+                        grid.window_height, grid.halo);
+        }
+        if (video_mode != VIDEO_OFF && (tiled || bench_frames
+                || bench_cells || bench_grid
+                || (video_mode == VIDEO_CELLS
+                        && _params.average != CELL_SAMPLES)))
+        {
+                puts("--video renders whole frames with sampled cells");
+                return -1;
+        }
+
+        programCacheInit(&_programs, program_dir);
+        initializeContext(fuse_fetches);
+        if (video_mode != VIDEO_OFF) {
+                int status = runVideo(input, video_mode,
+                        video_threshold / 255.0f, fuse_fetches);
+                programCachePrintStats(&_programs);
+                destroyHexagons();
+                contextDestroy(&context);
+                return status;
+        }
+        if (!tiled) {
+                uploadTexture(input);
+        }
+
+        if (bench_frames) {
+                benchFusion(bench_frames,
+                        fuse_fetches ? fuse_fetches : DefaultFuseFetches);
+        }
+        if (bench_cells) {
+                benchCells(bench_cells, fuse_fetches);
+        }
+        if (bench_grid) {
+                benchGrid(bench_grid, fuse_fetches);
+        }
+
+        /* render the scene */
+        if (tiled) {
+                renderTiles(input, &grid);
+        }
+        else {
+                renderHexagons(&_graph, _params.average);
+                dumpOutputToFile();
+        }
+        fprintf(stderr, "first frame %.1f ms after start\n",
+                (nowSeconds() - launch) * 1e3);
+        if (frame_time) {
+                double time = tiled ? timeTiles(input, &grid, frame_time)
+                        : timeGraph(&_graph, _params.average, frame_time);
+                fprintf(stderr, "frame time %.3f ms over %d frames\n",
+                        time * 1e3, frame_time);
+        }
+        programCachePrintStats(&_programs);
+        filterGraphPrintStats(&_graph, "hexagon");
+
+        if (ShowImage && !_nv12 && !tiled) {
+                filterGraphBindRead(&_graph, "hexagons");
+                ogl(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0));
+                ogl(glBlitFramebuffer(0, 0, _geo.width, _geo.height,
+                        0, 0, _geo.width, _geo.height,
+                        GL_COLOR_BUFFER_BIT, GL_NEAREST));
+                while (!contextShouldClose(&context)) {
+                        contextSwapBuffers(&context);
+                }
+        }
 
-        glfwTerminate();
+        destroyHexagons();
+        contextDestroy(&context);
         return 0;
 }
@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "context.h"
+
+static const char *backend_names[CONTEXT_BACKEND_COUNT] = {
+        "glfw",
+        "egl",
+};
+
+static double contextNow(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+const char *contextBackendName(ContextBackend backend) {
+        if (backend < 0 || backend >= CONTEXT_BACKEND_COUNT) {
+                return "unknown";
+        }
+        return backend_names[backend];
+}
+
+int contextBackendFromName(const char *name) {
+        for (int i = 0; i < CONTEXT_BACKEND_COUNT; i++) {
+                if (!strcmp(backend_names[i], name)) {
+                        return i;
+                }
+        }
+        return -1;
+}
+
+bool contextBackendSupported(ContextBackend backend) {
+        switch (backend) {
+        case CONTEXT_GLFW:
+                return true;
+#ifdef HAVE_EGL
+        case CONTEXT_EGL:
+                return true;
+#endif
+        default:
+                return false;
+        }
+}
+
+/*****************************************************************************
+ * GLFW
+ ****************************************************************************/
+static void setGlfwHints(int major, int minor, bool visible) {
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
+        glfwWindowHint(GLFW_ALPHA_BITS, 0);
+        glfwWindowHint(GLFW_DEPTH_BITS, 0);
+        glfwWindowHint(GLFW_STENCIL_BITS, 0);
+        if (major) {
+                glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, major);
+                glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minor);
+                glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
+                glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        }
+}
+
+static bool createGlfw(GlContext *ctx, int width, int height,
+        int major, int minor, bool visible)
+{
+        if (!glfwInit()) {
+                puts("glfwInit failed");
+                return false;
+        }
+        setGlfwHints(major, minor, visible);
+        ctx->window = glfwCreateWindow(width, height, "OpenGL", NULL, NULL);
+        if (!ctx->window) {
+                puts("glfwCreateWindow failed");
+                glfwTerminate();
+                return false;
+        }
+        glfwMakeContextCurrent(ctx->window);
+        return true;
+}
+
+/*****************************************************************************
+ * EGL surfaceless
+ ****************************************************************************/
+#ifdef HAVE_EGL
+static bool hasExtension(const char *list, const char *name) {
+        size_t len = strlen(name);
+        while (list && (list = strstr(list, name))) {
+                if (list[len] == ' ' || list[len] == '\0') {
+                        return true;
+                }
+                list += len;
+        }
+        return false;
+}
+
+static void setEglAttribs(EGLint *attribs, int major, int minor) {
+        attribs[0] = EGL_NONE;
+        if (major) {
+                attribs[0] = EGL_CONTEXT_MAJOR_VERSION;
+                attribs[1] = major;
+                attribs[2] = EGL_CONTEXT_MINOR_VERSION;
+                attribs[3] = minor;
+                attribs[4] = EGL_CONTEXT_OPENGL_PROFILE_MASK;
+                attribs[5] = EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT;
+                attribs[6] = EGL_NONE;
+        }
+}
+
+static bool createEgl(GlContext *ctx, int major, int minor) {
+        const char *client = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (!hasExtension(client, "EGL_MESA_platform_surfaceless")) {
+                puts("EGL_MESA_platform_surfaceless is not supported");
+                return false;
+        }
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+                (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+                eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (!getPlatformDisplay) {
+                puts("eglGetPlatformDisplayEXT is missing");
+                return false;
+        }
+
+        EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                EGL_DEFAULT_DISPLAY, NULL);
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+                printf("eglInitialize failed: 0x%x\n", eglGetError());
+                return false;
+        }
+
+        /* no config and no surface, rendering only goes into FBOs */
+        const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+        if (!hasExtension(extensions, "EGL_KHR_no_config_context")
+                || !hasExtension(extensions, "EGL_KHR_surfaceless_context"))
+        {
+                puts("EGL display cannot create surfaceless contexts");
+                eglTerminate(display);
+                return false;
+        }
+
+        EGLint attribs[7];
+        setEglAttribs(attribs, major, minor);
+
+        EGLContext context = EGL_NO_CONTEXT;
+        if (eglBindAPI(EGL_OPENGL_API)) {
+                context = eglCreateContext(display, EGL_NO_CONFIG_KHR,
+                        EGL_NO_CONTEXT, attribs);
+        }
+        if (context == EGL_NO_CONTEXT) {
+                printf("eglCreateContext failed: 0x%x\n", eglGetError());
+                eglTerminate(display);
+                return false;
+        }
+        if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+                printf("eglMakeCurrent failed: 0x%x\n", eglGetError());
+                eglDestroyContext(display, context);
+                eglTerminate(display);
+                return false;
+        }
+
+        ctx->egl_display = display;
+        ctx->egl_context = context;
+        return true;
+}
+#endif
+
+/*****************************************************************************
+ * Context
+ ****************************************************************************/
+bool contextCreate(GlContext *ctx, ContextBackend backend,
+        int width, int height, int major, int minor, bool visible)
+{
+        memset(ctx, 0, sizeof(*ctx));
+        ctx->backend = backend;
+        ctx->major = major;
+        ctx->minor = minor;
+        if (!contextBackendSupported(backend)) {
+                printf("context backend %s is not compiled in\n",
+                        contextBackendName(backend));
+                return false;
+        }
+
+        double start = contextNow();
+        bool ok = false;
+        switch (backend) {
+        case CONTEXT_GLFW:
+                ok = createGlfw(ctx, width, height, major, minor, visible);
+                break;
+#ifdef HAVE_EGL
+        case CONTEXT_EGL:
+                ok = createEgl(ctx, major, minor);
+                break;
+#endif
+        default:
+                break;
+        }
+        ctx->create_time = contextNow() - start;
+        return ok;
+}
+
+void contextDestroy(GlContext *ctx) {
+        switch (ctx->backend) {
+        case CONTEXT_GLFW:
+                if (ctx->window) {
+                        glfwDestroyWindow(ctx->window);
+                        ctx->window = NULL;
+                }
+                if (!ctx->shared) {
+                        glfwTerminate();
+                }
+                break;
+#ifdef HAVE_EGL
+        case CONTEXT_EGL:
+                if (ctx->egl_display && ctx->shared) {
+                        eglDestroyContext(ctx->egl_display, ctx->egl_context);
+                        ctx->egl_display = NULL;
+                        ctx->egl_context = NULL;
+                }
+                else if (ctx->egl_display) {
+                        eglMakeCurrent(ctx->egl_display, EGL_NO_SURFACE,
+                                EGL_NO_SURFACE, EGL_NO_CONTEXT);
+                        eglDestroyContext(ctx->egl_display, ctx->egl_context);
+                        eglTerminate(ctx->egl_display);
+                        ctx->egl_display = NULL;
+                        ctx->egl_context = NULL;
+                }
+                break;
+#endif
+        default:
+                break;
+        }
+}
+
+bool contextCreateShared(GlContext *ctx, const GlContext *share) {
+        memset(ctx, 0, sizeof(*ctx));
+        ctx->backend = share->backend;
+        ctx->shared = true;
+        ctx->major = share->major;
+        ctx->minor = share->minor;
+
+        double start = contextNow();
+        switch (share->backend) {
+        case CONTEXT_GLFW:
+                /* a hidden 1x1 window, only its context is used */
+                setGlfwHints(share->major, share->minor, false);
+                ctx->window = glfwCreateWindow(1, 1, "OpenGL", NULL,
+                        share->window);
+                if (!ctx->window) {
+                        puts("glfwCreateWindow failed for a shared context");
+                        return false;
+                }
+                break;
+#ifdef HAVE_EGL
+        case CONTEXT_EGL: {
+                EGLint attribs[7];
+                setEglAttribs(attribs, share->major, share->minor);
+                EGLContext context = eglCreateContext(share->egl_display,
+                        EGL_NO_CONFIG_KHR, share->egl_context, attribs);
+                if (context == EGL_NO_CONTEXT) {
+                        printf("eglCreateContext failed for a shared "
+                                "context: 0x%x\n", eglGetError());
+                        return false;
+                }
+                ctx->egl_display = share->egl_display;
+                ctx->egl_context = context;
+                break;
+        }
+#endif
+        default:
+                return false;
+        }
+        ctx->create_time = contextNow() - start;
+        return true;
+}
+
+bool contextMakeCurrent(GlContext *ctx) {
+        switch (ctx->backend) {
+        case CONTEXT_GLFW:
+                glfwMakeContextCurrent(ctx->window);
+                return true;
+#ifdef HAVE_EGL
+        case CONTEXT_EGL:
+                return eglMakeCurrent(ctx->egl_display, EGL_NO_SURFACE,
+                        EGL_NO_SURFACE, ctx->egl_context);
+#endif
+        default:
+                return false;
+        }
+}
+
+void contextReleaseCurrent(GlContext *ctx) {
+        switch (ctx->backend) {
+        case CONTEXT_GLFW:
+                glfwMakeContextCurrent(NULL);
+                break;
+#ifdef HAVE_EGL
+        case CONTEXT_EGL:
+                eglMakeCurrent(ctx->egl_display, EGL_NO_SURFACE,
+                        EGL_NO_SURFACE, EGL_NO_CONTEXT);
+                break;
+#endif
+        default:
+                break;
+        }
+}
+
+bool contextShouldClose(GlContext *ctx) {
+        if (!ctx->window) {
+                return true;
+        }
+        glfwPollEvents();
+        return glfwWindowShouldClose(ctx->window);
+}
+
+void contextSwapBuffers(GlContext *ctx) {
+        if (ctx->window) {
+                glfwSwapBuffers(ctx->window);
+        }
+}
@@ -0,0 +1,62 @@
+#ifndef __CONTEXT__H__
+#define __CONTEXT__H__
+
+/*****************************************************************************
+ * GL context backends
+ *
+ * GLFW needs a window system even when its window stays hidden. The EGL
+ * backend uses EGL_MESA_platform_surfaceless and has no default
+ * framebuffer at all, so it runs in containers with Mesa llvmpipe and no
+ * X server. Callers render into FBOs only.
+ ****************************************************************************/
+struct GLFWwindow;
+
+enum ContextBackend {
+        CONTEXT_GLFW,
+        CONTEXT_EGL,
+        CONTEXT_BACKEND_COUNT,
+};
+
+struct GlContext {
+        ContextBackend backend;
+        GLFWwindow *window;
+        /* EGLDisplay and EGLContext, kept opaque to callers */
+        void *egl_display;
+        void *egl_context;
+        /* shares objects with another context, which owns the display */
+        bool shared;
+        int major;
+        int minor;
+        /* seconds from the first backend call until the context is current */
+        double create_time;
+};
+
+/* the name is "unknown" / the lookup returns -1 when out of range */
+const char *contextBackendName(ContextBackend backend);
+int contextBackendFromName(const char *name);
+/* false when the backend was not compiled in */
+bool contextBackendSupported(ContextBackend backend);
+
+/*
+ * Creates a context and makes it current. major == 0 asks for the default
+ * context, otherwise a forward compatible core profile of major.minor.
+ * width and height only size the GLFW window, visible shows it.
+ */
+bool contextCreate(GlContext *ctx, ContextBackend backend,
+        int width, int height, int major, int minor, bool visible);
+void contextDestroy(GlContext *ctx);
+
+/*
+ * Creates a context of the same backend and version that shares objects
+ * with share, for use on another thread. It is not made current.
+ */
+bool contextCreateShared(GlContext *ctx, const GlContext *share);
+/* binds ctx to / releases it from the calling thread */
+bool contextMakeCurrent(GlContext *ctx);
+void contextReleaseCurrent(GlContext *ctx);
+
+/* SHOW_IMAGE helpers, no-ops without a window */
+bool contextShouldClose(GlContext *ctx);
+void contextSwapBuffers(GlContext *ctx);
+
+#endif //__CONTEXT__H__
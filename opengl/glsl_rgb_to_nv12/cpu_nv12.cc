@@ -0,0 +1,376 @@
+#include <string.h>
+
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_NV12_X86
+#include <immintrin.h>
+#endif
+
+#include "cpu_nv12.h"
+
+/*****************************************************************************
+ * Coefficients
+ ****************************************************************************/
+/* rgb2yuv_mat from frag_rgb2yuv scaled by 1 << 14 */
+enum {
+        Q = 14,
+
+        Y_R = 4211,     /* 0.257 */
+        Y_G = 8258,     /* 0.504 */
+        Y_B = 1606,     /* 0.098 */
+
+        U_R = -2425,    /* -0.148 */
+        U_G = -4768,    /* -0.291 */
+        U_B = 7193,     /* 0.439 */
+
+        V_R = 7193,     /* 0.439 */
+        V_G = -6029,    /* -0.368 */
+        V_B = -1163,    /* -0.071 */
+
+        /* 0.0625 * 255 and 0.5 * 255, plus rounding */
+        Y_BIAS = 261120 + (1 << (Q - 1)),
+        /* chroma is computed from a 2x2 sum, hence the extra >> 2 */
+        C_BIAS = 4 * 2088960 + (1 << (Q + 1)),
+};
+
+static inline uint8_t lumaOf(int r, int g, int b) {
+        return (Y_R * r + Y_G * g + Y_B * b + Y_BIAS) >> Q;
+}
+
+static inline uint8_t cbOf(int rs, int gs, int bs) {
+        return (U_R * rs + U_G * gs + U_B * bs + C_BIAS) >> (Q + 2);
+}
+
+static inline uint8_t crOf(int rs, int gs, int bs) {
+        return (V_R * rs + V_G * gs + V_B * bs + C_BIAS) >> (Q + 2);
+}
+
+/*
+ * Every kernel converts one pair of source rows into two luma rows and
+ * one interleaved chroma row, starting at column x0 which is always even.
+ * For odd heights rgb1 == rgb0 and y1 is NULL.
+ */
+typedef int (*RowPairFn)(const uint8_t *rgb0, const uint8_t *rgb1,
+        uint8_t *y0, uint8_t *y1, uint8_t *uv, int width);
+
+/*****************************************************************************
+ * Scalar
+ ****************************************************************************/
+static void rowPairScalarFrom(const uint8_t *rgb0, const uint8_t *rgb1,
+        uint8_t *y0, uint8_t *y1, uint8_t *uv, int width, int x0)
+{
+        for (int x = x0; x < width; x += 2) {
+                int xn = (x + 1 < width) ? x + 1 : x;
+                const uint8_t *a = rgb0 + 3 * x, *b = rgb0 + 3 * xn;
+                const uint8_t *c = rgb1 + 3 * x, *d = rgb1 + 3 * xn;
+
+                y0[x] = lumaOf(a[0], a[1], a[2]);
+                if (xn != x) {
+                        y0[xn] = lumaOf(b[0], b[1], b[2]);
+                }
+                if (y1) {
+                        y1[x] = lumaOf(c[0], c[1], c[2]);
+                        if (xn != x) {
+                                y1[xn] = lumaOf(d[0], d[1], d[2]);
+                        }
+                }
+
+                int rs = a[0] + b[0] + c[0] + d[0];
+                int gs = a[1] + b[1] + c[1] + d[1];
+                int bs = a[2] + b[2] + c[2] + d[2];
+                uv[x] = cbOf(rs, gs, bs);
+                uv[x + 1] = crOf(rs, gs, bs);
+        }
+}
+
+static int rowPairScalar(const uint8_t *, const uint8_t *,
+        uint8_t *, uint8_t *, uint8_t *, int)
+{
+        return 0;
+}
+
+/*****************************************************************************
+ * SSSE3: 4 pixels of both rows per iteration
+ ****************************************************************************/
+#ifdef CPU_NV12_X86
+#define SSSE3_FN __attribute__((target("ssse3")))
+#define AVX2_FN __attribute__((target("avx2")))
+
+/* expand pixels 0,1 and 2,3 of a 12 byte group into 16 bit {R, G, B, 0} */
+#define SHUF_P01 -1, -1, -1, 5, -1, 4, -1, 3, -1, -1, -1, 2, -1, 1, -1, 0
+#define SHUF_P23 -1, -1, -1, 11, -1, 10, -1, 9, -1, -1, -1, 8, -1, 7, -1, 6
+#define COEF(r, g, b) 0, b, g, r, 0, b, g, r
+
+SSSE3_FN static inline __m128i sumRows4(__m128i p01, __m128i p23) {
+        /* [p0 + p1, p2 + p3] as {R, G, B, 0} pairs */
+        return _mm_add_epi16(_mm_unpacklo_epi64(p01, p23),
+                _mm_unpackhi_epi64(p01, p23));
+}
+
+SSSE3_FN static int rowPairSsse3(const uint8_t *rgb0, const uint8_t *rgb1,
+        uint8_t *y0, uint8_t *y1, uint8_t *uv, int width)
+{
+        const __m128i shuf_p01 = _mm_set_epi8(SHUF_P01);
+        const __m128i shuf_p23 = _mm_set_epi8(SHUF_P23);
+        const __m128i k_y = _mm_set_epi16(COEF(Y_R, Y_G, Y_B));
+        const __m128i k_u = _mm_set_epi16(COEF(U_R, U_G, U_B));
+        const __m128i k_v = _mm_set_epi16(COEF(V_R, V_G, V_B));
+        const __m128i y_bias = _mm_set1_epi32(Y_BIAS);
+        const __m128i c_bias = _mm_set1_epi32(C_BIAS);
+
+        int x = 0;
+        /* each iteration reads 16 bytes but consumes only 12 */
+        for (; x + 6 <= width; x += 4) {
+                __m128i r0 = _mm_loadu_si128((const __m128i *)(rgb0 + 3 * x));
+                __m128i r1 = _mm_loadu_si128((const __m128i *)(rgb1 + 3 * x));
+                __m128i r0_01 = _mm_shuffle_epi8(r0, shuf_p01);
+                __m128i r0_23 = _mm_shuffle_epi8(r0, shuf_p23);
+                __m128i r1_01 = _mm_shuffle_epi8(r1, shuf_p01);
+                __m128i r1_23 = _mm_shuffle_epi8(r1, shuf_p23);
+
+                __m128i l0 = _mm_hadd_epi32(_mm_madd_epi16(r0_01, k_y),
+                        _mm_madd_epi16(r0_23, k_y));
+                __m128i l1 = _mm_hadd_epi32(_mm_madd_epi16(r1_01, k_y),
+                        _mm_madd_epi16(r1_23, k_y));
+                l0 = _mm_srai_epi32(_mm_add_epi32(l0, y_bias), Q);
+                l1 = _mm_srai_epi32(_mm_add_epi32(l1, y_bias), Q);
+                __m128i l = _mm_packs_epi32(l0, l1);
+                l = _mm_packus_epi16(l, l);
+
+                int32_t lo = _mm_cvtsi128_si32(l);
+                memcpy(y0 + x, &lo, 4);
+                if (y1) {
+                        int32_t hi = _mm_cvtsi128_si32(_mm_srli_si128(l, 4));
+                        memcpy(y1 + x, &hi, 4);
+                }
+
+                __m128i s = _mm_add_epi16(sumRows4(r0_01, r0_23),
+                        sumRows4(r1_01, r1_23));
+                __m128i c = _mm_hadd_epi32(_mm_madd_epi16(s, k_u),
+                        _mm_madd_epi16(s, k_v));
+                c = _mm_srai_epi32(_mm_add_epi32(c, c_bias), Q + 2);
+                /* [U0, U1, V0, V1] -> [U0, V0, U1, V1] */
+                c = _mm_shuffle_epi32(c, _MM_SHUFFLE(3, 1, 2, 0));
+                c = _mm_packs_epi32(c, c);
+                c = _mm_packus_epi16(c, c);
+
+                int32_t cv = _mm_cvtsi128_si32(c);
+                memcpy(uv + x, &cv, 4);
+        }
+        return x;
+}
+
+/*****************************************************************************
+ * AVX2: 8 pixels of both rows per iteration, one 12 byte group per lane
+ ****************************************************************************/
+AVX2_FN static inline __m256i loadGroups(const uint8_t *p) {
+        return _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+                _mm_loadu_si128((const __m128i *)(p + 12)), 1);
+}
+
+AVX2_FN static inline __m256i sumRows8(__m256i p01, __m256i p23) {
+        return _mm256_add_epi16(_mm256_unpacklo_epi64(p01, p23),
+                _mm256_unpackhi_epi64(p01, p23));
+}
+
+AVX2_FN static int rowPairAvx2(const uint8_t *rgb0, const uint8_t *rgb1,
+        uint8_t *y0, uint8_t *y1, uint8_t *uv, int width)
+{
+        const __m256i shuf_p01 = _mm256_broadcastsi128_si256(
+                _mm_set_epi8(SHUF_P01));
+        const __m256i shuf_p23 = _mm256_broadcastsi128_si256(
+                _mm_set_epi8(SHUF_P23));
+        const __m256i k_y = _mm256_broadcastsi128_si256(
+                _mm_set_epi16(COEF(Y_R, Y_G, Y_B)));
+        const __m256i k_u = _mm256_broadcastsi128_si256(
+                _mm_set_epi16(COEF(U_R, U_G, U_B)));
+        const __m256i k_v = _mm256_broadcastsi128_si256(
+                _mm_set_epi16(COEF(V_R, V_G, V_B)));
+        const __m256i y_bias = _mm256_set1_epi32(Y_BIAS);
+        const __m256i c_bias = _mm256_set1_epi32(C_BIAS);
+        /* gather dword 0 of each lane, then dword 1 of each lane */
+        const __m256i gather = _mm256_set_epi32(7, 6, 3, 2, 5, 1, 4, 0);
+
+        int x = 0;
+        /* the upper lane reads up to byte 3 * x + 28 */
+        for (; x + 10 <= width; x += 8) {
+                __m256i r0 = loadGroups(rgb0 + 3 * x);
+                __m256i r1 = loadGroups(rgb1 + 3 * x);
+                __m256i r0_01 = _mm256_shuffle_epi8(r0, shuf_p01);
+                __m256i r0_23 = _mm256_shuffle_epi8(r0, shuf_p23);
+                __m256i r1_01 = _mm256_shuffle_epi8(r1, shuf_p01);
+                __m256i r1_23 = _mm256_shuffle_epi8(r1, shuf_p23);
+
+                __m256i l0 = _mm256_hadd_epi32(_mm256_madd_epi16(r0_01, k_y),
+                        _mm256_madd_epi16(r0_23, k_y));
+                __m256i l1 = _mm256_hadd_epi32(_mm256_madd_epi16(r1_01, k_y),
+                        _mm256_madd_epi16(r1_23, k_y));
+                l0 = _mm256_srai_epi32(_mm256_add_epi32(l0, y_bias), Q);
+                l1 = _mm256_srai_epi32(_mm256_add_epi32(l1, y_bias), Q);
+                __m256i l = _mm256_packs_epi32(l0, l1);
+                l = _mm256_packus_epi16(l, l);
+                __m128i lg = _mm256_castsi256_si128(
+                        _mm256_permutevar8x32_epi32(l, gather));
+
+                _mm_storel_epi64((__m128i *)(y0 + x), lg);
+                if (y1) {
+                        _mm_storel_epi64((__m128i *)(y1 + x),
+                                _mm_srli_si128(lg, 8));
+                }
+
+                __m256i s = _mm256_add_epi16(sumRows8(r0_01, r0_23),
+                        sumRows8(r1_01, r1_23));
+                __m256i c = _mm256_hadd_epi32(_mm256_madd_epi16(s, k_u),
+                        _mm256_madd_epi16(s, k_v));
+                c = _mm256_srai_epi32(_mm256_add_epi32(c, c_bias), Q + 2);
+                c = _mm256_shuffle_epi32(c, _MM_SHUFFLE(3, 1, 2, 0));
+                c = _mm256_packs_epi32(c, c);
+                c = _mm256_packus_epi16(c, c);
+                __m128i cg = _mm256_castsi256_si128(
+                        _mm256_permutevar8x32_epi32(c, gather));
+
+                _mm_storel_epi64((__m128i *)(uv + x), cg);
+        }
+        return x;
+}
+#endif //CPU_NV12_X86
+
+/*****************************************************************************
+ * Dispatch
+ ****************************************************************************/
+static const char *kernel_names[CPU_KERNEL_COUNT] = {
+        "scalar",
+        "ssse3",
+        "avx2",
+};
+
+static RowPairFn kernelFn(CpuKernel kernel) {
+        switch (kernel) {
+#ifdef CPU_NV12_X86
+        case CPU_KERNEL_SSSE3:
+                return rowPairSsse3;
+        case CPU_KERNEL_AVX2:
+                return rowPairAvx2;
+#endif
+        default:
+                return rowPairScalar;
+        }
+}
+
+const char *cpuKernelName(CpuKernel kernel) {
+        if (kernel < 0 || kernel >= CPU_KERNEL_COUNT) {
+                return "auto";
+        }
+        return kernel_names[kernel];
+}
+
+CpuKernel cpuKernelFromName(const char *name) {
+        for (int i = 0; i < CPU_KERNEL_COUNT; i++) {
+                if (!strcmp(name, kernel_names[i])) {
+                        return (CpuKernel)i;
+                }
+        }
+        return CPU_KERNEL_AUTO;
+}
+
+bool cpuKernelSupported(CpuKernel kernel) {
+        switch (kernel) {
+        case CPU_KERNEL_SCALAR:
+                return true;
+#ifdef CPU_NV12_X86
+        case CPU_KERNEL_SSSE3:
+                return __builtin_cpu_supports("ssse3");
+        case CPU_KERNEL_AVX2:
+                return __builtin_cpu_supports("avx2");
+#endif
+        default:
+                return false;
+        }
+}
+
+CpuKernel cpuKernelBest(void) {
+        for (int i = CPU_KERNEL_COUNT - 1; i > CPU_KERNEL_SCALAR; i--) {
+                if (cpuKernelSupported((CpuKernel)i)) {
+                        return (CpuKernel)i;
+                }
+        }
+        return CPU_KERNEL_SCALAR;
+}
+
+int cpuDefaultThreads(void) {
+        unsigned n = std::thread::hardware_concurrency();
+        return n ? n : 1;
+}
+
+/*****************************************************************************
+ * Row bands
+ ****************************************************************************/
+struct Band {
+        const uint8_t *rgb;
+        size_t rgb_stride;
+        uint8_t *y;
+        size_t y_stride;
+        uint8_t *uv;
+        size_t uv_stride;
+        int width;
+        int height;
+        int pair_begin;
+        int pair_end;
+        RowPairFn fn;
+};
+
+static void convertBand(const Band &b) {
+        for (int p = b.pair_begin; p < b.pair_end; p++) {
+                int row = 2 * p;
+                bool has_next = row + 1 < b.height;
+                const uint8_t *rgb0 = b.rgb + row * b.rgb_stride;
+                const uint8_t *rgb1 = has_next ? rgb0 + b.rgb_stride : rgb0;
+                uint8_t *y0 = b.y + row * b.y_stride;
+                uint8_t *y1 = has_next ? y0 + b.y_stride : NULL;
+                uint8_t *uv = b.uv + p * b.uv_stride;
+
+                int x = b.fn(rgb0, rgb1, y0, y1, uv, b.width);
+                rowPairScalarFrom(rgb0, rgb1, y0, y1, uv, b.width, x);
+        }
+}
+
+void cpuRgbToNv12(const uint8_t *rgb, size_t rgb_stride,
+        uint8_t *y, size_t y_stride,
+        uint8_t *uv, size_t uv_stride,
+        int width, int height,
+        CpuKernel kernel, int num_threads)
+{
+        if (kernel == CPU_KERNEL_AUTO || !cpuKernelSupported(kernel)) {
+                kernel = cpuKernelBest();
+        }
+
+        int num_pairs = (height + 1) / 2;
+        if (num_threads < 1) {
+                num_threads = 1;
+        }
+        if (num_threads > num_pairs) {
+                num_threads = num_pairs;
+        }
+
+        Band band = {
+                rgb, rgb_stride, y, y_stride, uv, uv_stride,
+                width, height, 0, num_pairs, kernelFn(kernel),
+        };
+        if (num_threads <= 1) {
+                convertBand(band);
+                return;
+        }
+
+        std::vector<std::thread> workers;
+        for (int i = 0; i < num_threads; i++) {
+                band.pair_begin = num_pairs * i / num_threads;
+                band.pair_end = num_pairs * (i + 1) / num_threads;
+                workers.push_back(std::thread(convertBand, band));
+        }
+        for (size_t i = 0; i < workers.size(); i++) {
+                workers[i].join();
+        }
+}
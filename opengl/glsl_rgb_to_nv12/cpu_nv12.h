@@ -0,0 +1,39 @@
+#ifndef __CPU_NV12__H__
+#define __CPU_NV12__H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*****************************************************************************
+ * CPU reference RGB -> NV12 converter
+ *
+ * Uses the same coefficients as rgb2yuv_mat in frag_rgb2yuv (BT.601,
+ * limited range) in Q14 fixed point, and averages chroma over 2x2 blocks.
+ * All kernels produce bit-identical output.
+ ****************************************************************************/
+enum CpuKernel {
+        CPU_KERNEL_AUTO = -1,
+        CPU_KERNEL_SCALAR = 0,
+        CPU_KERNEL_SSSE3,
+        CPU_KERNEL_AVX2,
+        CPU_KERNEL_COUNT,
+};
+
+const char *cpuKernelName(CpuKernel kernel);
+CpuKernel cpuKernelFromName(const char *name);
+bool cpuKernelSupported(CpuKernel kernel);
+CpuKernel cpuKernelBest(void);
+int cpuDefaultThreads(void);
+
+/*
+ * Converts packed RGB24 into NV12. Odd widths and heights are handled by
+ * replicating the last column/row into the chroma average, so the UV plane
+ * is (width + 1) / 2 pairs wide and (height + 1) / 2 rows high.
+ */
+void cpuRgbToNv12(const uint8_t *rgb, size_t rgb_stride,
+        uint8_t *y, size_t y_stride,
+        uint8_t *uv, size_t uv_stride,
+        int width, int height,
+        CpuKernel kernel, int num_threads);
+
+#endif //__CPU_NV12__H__
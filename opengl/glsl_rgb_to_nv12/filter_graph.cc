@@ -0,0 +1,836 @@
+#include <string.h>
+
+#include <string>
+
+#include "opengl_utils.h"
+#include "filter_graph.h"
+
+/*****************************************************************************
+ * Quad
+ ****************************************************************************/
+static const GLfloat QuadSide = 1.0f;
+
+static const GLfloat QuadData[2][20] = {
+        {
+                //vertex coordinates
+                QuadSide, QuadSide, 0.0f,
+                -QuadSide, QuadSide, 0.0f,
+                -QuadSide, -QuadSide, 0.0f,
+                QuadSide, -QuadSide, 0.0f,
+
+                //texture coordinates
+                0, 0,
+                1, 0,
+                1, 1,
+                0, 1,
+        },
+        {
+                //vertex coordinates
+                -QuadSide, -QuadSide, 0.0f,
+                QuadSide, -QuadSide, 0.0f,
+                QuadSide, QuadSide, 0.0f,
+                -QuadSide, QuadSide, 0.0f,
+
+                //texture coordinates
+                0, 0,
+                1, 0,
+                1, 1,
+                0, 1,
+        },
+};
+
+static const GLuint QuadIndices[] = {
+        0, 1, 2,
+        0, 2, 3,
+};
+
+static const GLuint PositionAttr = 0;
+static const GLuint TexCoordAttr = 1;
+
+static const size_t VertexStride = 3;
+static const size_t TexCoordStride = 2;
+
+static const size_t CoordOffset = 0;
+static const size_t TexCoordOffset = 12;
+
+static const size_t NumIndices = 6;
+
+void filterQuadInit(FilterQuad *quad) {
+        ogl(glGenVertexArrays(2, quad->vao));
+        ogl(glGenBuffers(2, quad->vbo));
+        ogl(glGenBuffers(1, &quad->ibo));
+
+        for (int i = 0; i < 2; i++) {
+                ogl(glBindVertexArray(quad->vao[i]));
+                ogl(glBindBuffer(GL_ARRAY_BUFFER, quad->vbo[i]));
+                ogl(glBufferData(GL_ARRAY_BUFFER, sizeof(QuadData[i]),
+                        QuadData[i], GL_STATIC_DRAW));
+                /* the element binding is part of the VAO */
+                ogl(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad->ibo));
+                if (i == 0) {
+                        ogl(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                                sizeof(QuadIndices), QuadIndices,
+                                GL_STATIC_DRAW));
+                }
+
+                ogl(glVertexAttribPointer(PositionAttr, VertexStride,
+                        GL_FLOAT, GL_FALSE, 0,
+                        (GLvoid *) (CoordOffset * sizeof(GLfloat))));
+                ogl(glVertexAttribPointer(TexCoordAttr, TexCoordStride,
+                        GL_FLOAT, GL_FALSE, 0,
+                        (GLvoid *) (TexCoordOffset * sizeof(GLfloat))));
+                ogl(glEnableVertexAttribArray(PositionAttr));
+                ogl(glEnableVertexAttribArray(TexCoordAttr));
+        }
+        ogl(glBindVertexArray(0));
+        ogl(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        ogl(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+}
+
+void filterQuadDestroy(FilterQuad *quad) {
+        ogl(glDeleteVertexArrays(2, quad->vao));
+        ogl(glDeleteBuffers(2, quad->vbo));
+        ogl(glDeleteBuffers(1, &quad->ibo));
+}
+
+void filterQuadDraw(const FilterQuad *quad, bool inverted) {
+        ogl(glBindVertexArray(quad->vao[inverted ? 1 : 0]));
+        ogl(glDrawElements(GL_TRIANGLES, NumIndices, GL_UNSIGNED_INT, 0));
+        ogl(glBindVertexArray(0));
+}
+
+/*****************************************************************************
+ * Declaring graphs
+ ****************************************************************************/
+static void fail(const char *what, const char *name) {
+        printf("filter graph: %s %s\n", what, name ? name : "");
+        exit(-1);
+}
+
+static int findTexture(const FilterGraph *graph, const char *name) {
+        for (int i = 0; i < graph->num_textures; i++) {
+                if (!strcmp(graph->texture[i].name, name)) {
+                        return i;
+                }
+        }
+        fail("unknown texture", name);
+        return -1;
+}
+
+static FilterPass *getPass(FilterGraph *graph, int pass) {
+        if (pass < 0 || pass >= graph->num_passes) {
+                fail("no such pass", NULL);
+        }
+        return &graph->pass[pass];
+}
+
+void filterGraphInit(FilterGraph *graph, const FilterQuad *quad,
+        ProgramCache *programs)
+{
+        memset(graph, 0, sizeof(*graph));
+        graph->quad = quad;
+        graph->programs = programs;
+}
+
+void filterGraphDestroy(FilterGraph *graph) {
+        for (int i = 0; i < graph->num_passes; i++) {
+                if (graph->pass[i].fbo) {
+                        ogl(glDeleteFramebuffers(1, &graph->pass[i].fbo));
+                }
+        }
+        for (int i = 0; i < graph->num_physical; i++) {
+                ogl(glDeleteTextures(1, &graph->physical[i].texture));
+        }
+        filterGraphInit(graph, graph->quad, graph->programs);
+}
+
+void filterGraphSetFusion(FilterGraph *graph, int max_fetches) {
+        graph->fuse_fetches = max_fetches;
+}
+
+static FilterTexture *addTexture(FilterGraph *graph, const char *name) {
+        if (graph->num_textures == FILTER_MAX_TEXTURES) {
+                fail("too many textures at", name);
+        }
+        for (int i = 0; i < graph->num_textures; i++) {
+                if (!strcmp(graph->texture[i].name, name)) {
+                        fail("duplicate texture", name);
+                }
+        }
+        FilterTexture *tex = &graph->texture[graph->num_textures++];
+        memset(tex, 0, sizeof(*tex));
+        tex->name = name;
+        tex->first = -1;
+        tex->last = -1;
+        tex->physical = -1;
+        return tex;
+}
+
+void filterGraphAddInput(FilterGraph *graph, const char *name,
+        int width, int height)
+{
+        FilterTexture *tex = addTexture(graph, name);
+        tex->external = true;
+        tex->width = width;
+        tex->height = height;
+}
+
+void filterGraphAddTarget(FilterGraph *graph, const char *name,
+        int width, int height, GLenum internal_format)
+{
+        FilterTexture *tex = addTexture(graph, name);
+        tex->width = width;
+        tex->height = height;
+        tex->internal_format = internal_format;
+}
+
+int filterGraphAddPass(FilterGraph *graph, const char *name,
+        GLuint program, int flags)
+{
+        if (graph->num_passes == FILTER_MAX_PASSES) {
+                fail("too many passes at", name);
+        }
+        int index = graph->num_passes++;
+        FilterPass *pass = &graph->pass[index];
+        memset(pass, 0, sizeof(*pass));
+        pass->name = name;
+        pass->program = program;
+        pass->flags = flags;
+        pass->taps = 1;
+        pass->fetches = 1;
+        pass->chain_length = 1;
+        pass->chain[0] = index;
+        return index;
+}
+
+int filterGraphAddStage(FilterGraph *graph, const char *name,
+        const char *source, int taps, int flags)
+{
+        if (strlen(name) + 5 > FILTER_MAX_NAME) {
+                fail("stage name too long:", name);
+        }
+        int index = filterGraphAddPass(graph, name, 0, flags);
+        FilterPass *pass = &graph->pass[index];
+        pass->source = source;
+        pass->taps = taps;
+        pass->fetches = taps;
+        snprintf(pass->tex_uniform, sizeof(pass->tex_uniform), "%s_tex", name);
+        return index;
+}
+
+/* passes only see textures written by the passes before them */
+void filterPassRead(FilterGraph *graph, int pass, const char *texture,
+        const char *uniform, GLuint sampler)
+{
+        FilterPass *p = getPass(graph, pass);
+        int t = findTexture(graph, texture);
+        FilterTexture *tex = &graph->texture[t];
+        if (p->num_inputs == FILTER_MAX_INPUTS
+                || (p->source && p->num_inputs == 1))
+        {
+                fail("too many inputs in", p->name);
+        }
+        if (!tex->external && (tex->first < 0 || tex->first >= pass)) {
+                fail("reads a texture no earlier pass writes:", texture);
+        }
+        FilterInput *in = &p->input[p->num_inputs++];
+        in->texture = t;
+        in->bound = t;
+        in->uniform = p->source ? p->tex_uniform : uniform;
+        in->location = -1;
+        in->sampler = p->source ? 0 : sampler;
+}
+
+void filterPassWrite(FilterGraph *graph, int pass, const char *texture) {
+        FilterPass *p = getPass(graph, pass);
+        int t = findTexture(graph, texture);
+        FilterTexture *tex = &graph->texture[t];
+        if (p->num_outputs == FILTER_MAX_OUTPUTS
+                || (p->source && p->num_outputs == 1))
+        {
+                fail("too many outputs in", p->name);
+        }
+        if (tex->external || tex->first >= 0) {
+                fail("written twice or an input:", texture);
+        }
+        tex->first = pass;
+        tex->attachment = p->num_outputs;
+        p->output[p->num_outputs++] = t;
+}
+
+static FilterUniform *getUniform(FilterGraph *graph, int pass,
+        const char *name)
+{
+        FilterPass *p = getPass(graph, pass);
+        for (int i = 0; i < p->num_uniforms; i++) {
+                if (!strcmp(p->uniform[i].name, name)) {
+                        return &p->uniform[i];
+                }
+        }
+        if (p->num_uniforms == FILTER_MAX_UNIFORMS || graph->compiled) {
+                fail("cannot add the uniform", name);
+        }
+        FilterUniform *u = &p->uniform[p->num_uniforms++];
+        memset(u, 0, sizeof(*u));
+        u->name = name;
+        return u;
+}
+
+void filterPassUniform(FilterGraph *graph, int pass, const char *name,
+        int size, const GLfloat *value)
+{
+        FilterUniform *u = getUniform(graph, pass, name);
+        u->size = size;
+        u->integer = false;
+        memcpy(u->f, value, size * sizeof(value[0]));
+}
+
+void filterPassUniform2f(FilterGraph *graph, int pass, const char *name,
+        GLfloat x, GLfloat y)
+{
+        GLfloat value[] = { x, y };
+        filterPassUniform(graph, pass, name, 2, value);
+}
+
+void filterPassUniform1i(FilterGraph *graph, int pass, const char *name,
+        GLint value)
+{
+        FilterUniform *u = getUniform(graph, pass, name);
+        u->size = 1;
+        u->integer = true;
+        u->i[0] = value;
+}
+
+/*****************************************************************************
+ * Targets
+ ****************************************************************************/
+static GLenum baseFormat(GLenum internal_format) {
+        switch (internal_format) {
+        case GL_R8:
+        case GL_R16F:
+        case GL_R32F:
+                return GL_RED;
+        case GL_RG8:
+        case GL_RG16F:
+        case GL_RG32F:
+                return GL_RG;
+        case GL_RGB8:
+        case GL_RGB16F:
+        case GL_RGB32F:
+                return GL_RGB;
+        default:
+                return GL_RGBA;
+        }
+}
+
+static size_t texelSize(GLenum internal_format) {
+        switch (internal_format) {
+        case GL_R8:
+                return 1;
+        case GL_RG8:
+        case GL_R16F:
+                return 2;
+        case GL_RGB8:
+                return 3;
+        case GL_RGBA16F:
+        case GL_RG32F:
+                return 8;
+        case GL_RGB16F:
+                return 6;
+        case GL_RGB32F:
+                return 12;
+        case GL_RGBA32F:
+                return 16;
+        default:
+                return 4;
+        }
+}
+
+static GLenum baseType(GLenum internal_format) {
+        switch (internal_format) {
+        case GL_R16F:
+        case GL_RG16F:
+        case GL_RGB16F:
+        case GL_RGBA16F:
+        case GL_R32F:
+        case GL_RG32F:
+        case GL_RGB32F:
+        case GL_RGBA32F:
+                return GL_FLOAT;
+        default:
+                return GL_UNSIGNED_BYTE;
+        }
+}
+
+static GLuint createTexture(const FilterPhysical *phys) {
+        GLuint texture;
+        ogl(glGenTextures(1, &texture));
+        ogl(glBindTexture(GL_TEXTURE_2D, texture));
+        ogl(glTexImage2D(GL_TEXTURE_2D, 0, phys->internal_format,
+                phys->width, phys->height, 0,
+                baseFormat(phys->internal_format),
+                baseType(phys->internal_format), NULL));
+        ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+        ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+        ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
+                GL_CLAMP_TO_EDGE));
+        ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
+                GL_CLAMP_TO_EDGE));
+        ogl(glBindTexture(GL_TEXTURE_2D, 0));
+        return texture;
+}
+
+/*****************************************************************************
+ * Fusion
+ ****************************************************************************/
+static const char *StageVertex =
+        "#version 150\n"
+        "in vec4 position;\n"
+        "void main(void) {\n"
+        "        gl_Position = position;\n"
+        "}\n";
+
+/* one program cannot define a stage function twice */
+static bool inChain(const FilterGraph *graph, const FilterPass *pass,
+        const char *name)
+{
+        for (int c = 0; c < pass->chain_length; c++) {
+                if (!strcmp(graph->pass[pass->chain[c]].name, name)) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+static bool readsTexture(const FilterPass *pass, int texture) {
+        for (int i = 0; i < pass->num_inputs; i++) {
+                if (pass->input[i].texture == texture) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+/*
+ * Stages are visited in order, so the fetches of a stage already include
+ * whatever was fused into it when its readers are considered.
+ */
+static void fuseStages(FilterGraph *graph) {
+        for (int a = 0; a < graph->num_passes; a++) {
+                FilterPass *producer = &graph->pass[a];
+                if (!producer->source) {
+                        continue;
+                }
+                int out = producer->output[0];
+                int readers = 0;
+                bool fusable = true;
+                for (int b = a + 1; b < graph->num_passes; b++) {
+                        const FilterPass *reader = &graph->pass[b];
+                        if (!readsTexture(reader, out)) {
+                                continue;
+                        }
+                        readers++;
+                        fusable = fusable && reader->source
+                                && reader->taps * producer->fetches
+                                        <= graph->fuse_fetches
+                                && producer->chain_length < FILTER_MAX_CHAIN
+                                && !inChain(graph, producer, reader->name);
+                }
+                /* outputs have to be rendered */
+                if (!readers || !fusable) {
+                        continue;
+                }
+
+                producer->fused = true;
+                for (int b = a + 1; b < graph->num_passes; b++) {
+                        FilterPass *reader = &graph->pass[b];
+                        if (!readsTexture(reader, out)) {
+                                continue;
+                        }
+                        reader->fetches = reader->taps * producer->fetches;
+                        reader->chain_length = 1 + producer->chain_length;
+                        memcpy(&reader->chain[1], producer->chain,
+                                producer->chain_length * sizeof(int));
+                        reader->input[0].bound = producer->input[0].bound;
+                        reader->input[0].uniform = producer->input[0].uniform;
+                }
+        }
+}
+
+/*
+ * The innermost stage samples the bound texture, every other stage's
+ * NAME_src() calls the stage it fused.
+ */
+static std::string stageSource(const FilterGraph *graph,
+        const FilterPass *pass)
+{
+        std::string src = "#version 150\n";
+        const FilterPass *inner = &graph->pass[pass->chain[pass->chain_length - 1]];
+        src += std::string("uniform sampler2D ") + inner->tex_uniform + ";\n";
+        for (int c = pass->chain_length - 1; c >= 0; c--) {
+                const FilterPass *stage = &graph->pass[pass->chain[c]];
+                std::string name = stage->name;
+                src += "uniform vec2 " + name + "_src_size;\n";
+                src += "vec4 " + name + "_src(vec2 pixel) {\n";
+                if (c == pass->chain_length - 1) {
+                        src += std::string("        return texture(")
+                                + stage->tex_uniform + ", pixel / "
+                                + name + "_src_size);\n";
+                }
+                else {
+                        src += std::string("        return ")
+                                + graph->pass[pass->chain[c + 1]].name
+                                + "(pixel);\n";
+                }
+                src += "}\n";
+                src += stage->source;
+                src += "\n";
+        }
+        src += "out vec4 filter_color;\n";
+        src += std::string("void main(void) {\n        filter_color = ")
+                + pass->name + "(gl_FragCoord.xy);\n}\n";
+        return src;
+}
+
+static void requestStagePrograms(FilterGraph *graph) {
+        for (int p = 0; p < graph->num_passes; p++) {
+                FilterPass *pass = &graph->pass[p];
+                if (!pass->source || pass->fused) {
+                        continue;
+                }
+                if (!graph->programs) {
+                        fail("no program cache for the stage", pass->name);
+                }
+                std::string frag = stageSource(graph, pass);
+                const char *frag_source = frag.c_str();
+                ProgramDesc desc;
+                programDescInit(&desc);
+                programDescAddStage(&desc, GL_VERTEX_SHADER, 1, &StageVertex);
+                programDescAddStage(&desc, GL_FRAGMENT_SHADER, 1,
+                        &frag_source);
+                desc.attrib[0] = "position";
+                desc.frag_out = "filter_color";
+                /* the source is copied before the request returns */
+                pass->program = programCacheRequest(graph->programs, &desc);
+        }
+        if (graph->programs) {
+                programCacheFinish(graph->programs);
+        }
+}
+
+/*****************************************************************************
+ * Compiling
+ ****************************************************************************/
+/* lifetimes of the targets the passes left after fusion read and write */
+static void computeLifetimes(FilterGraph *graph) {
+        for (int p = 0; p < graph->num_passes; p++) {
+                const FilterPass *pass = &graph->pass[p];
+                if (pass->fused) {
+                        continue;
+                }
+                for (int i = 0; i < pass->num_inputs; i++) {
+                        graph->texture[pass->input[i].bound].last = p;
+                }
+        }
+}
+
+/*
+ * Targets are placed in the order they are written. One goes into the
+ * first texture of its size and format whose targets are all read by
+ * earlier passes, a pass never samples the texture it renders to.
+ */
+static void allocateTargets(FilterGraph *graph) {
+        for (int p = 0; p < graph->num_passes; p++) {
+                const FilterPass *pass = &graph->pass[p];
+                if (pass->fused) {
+                        continue;
+                }
+                for (int o = 0; o < pass->num_outputs; o++) {
+                        FilterTexture *tex = &graph->texture[pass->output[o]];
+                        /* outputs are never reused */
+                        int last = tex->last < 0 ? graph->num_passes : tex->last;
+                        int found = -1;
+                        for (int i = 0; i < graph->num_physical; i++) {
+                                const FilterPhysical *phys = &graph->physical[i];
+                                if (phys->last < p && phys->width == tex->width
+                                        && phys->height == tex->height
+                                        && phys->internal_format
+                                                == tex->internal_format)
+                                {
+                                        found = i;
+                                        break;
+                                }
+                        }
+                        if (found < 0) {
+                                found = graph->num_physical++;
+                                FilterPhysical *phys = &graph->physical[found];
+                                phys->width = tex->width;
+                                phys->height = tex->height;
+                                phys->internal_format = tex->internal_format;
+                                phys->texture = createTexture(phys);
+                        }
+                        graph->physical[found].last = last;
+                        tex->physical = found;
+                        tex->texture = graph->physical[found].texture;
+                }
+        }
+}
+
+static void createFramebuffer(FilterGraph *graph, FilterPass *pass) {
+        GLenum buffers[FILTER_MAX_OUTPUTS];
+        ogl(glGenFramebuffers(1, &pass->fbo));
+        ogl(glBindFramebuffer(GL_FRAMEBUFFER, pass->fbo));
+        for (int o = 0; o < pass->num_outputs; o++) {
+                const FilterTexture *tex = &graph->texture[pass->output[o]];
+                buffers[o] = GL_COLOR_ATTACHMENT0 + o;
+                ogl(glFramebufferTexture2D(GL_FRAMEBUFFER, buffers[o],
+                        GL_TEXTURE_2D, tex->texture, 0));
+        }
+        /* part of the framebuffer state, set once */
+        ogl(glDrawBuffers(pass->num_outputs, buffers));
+
+        GLenum status;
+        ogl(status = glCheckFramebufferStatus(GL_FRAMEBUFFER));
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+                fail("incomplete framebuffer in", pass->name);
+        }
+        ogl(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+
+        /* the render area is the smallest attachment anyway */
+        const FilterTexture *first = &graph->texture[pass->output[0]];
+        pass->width = first->width;
+        pass->height = first->height;
+}
+
+/* the uniforms of every stage in the chain are set on the fused program */
+static void findLocations(FilterGraph *graph, FilterPass *pass) {
+        for (int i = 0; i < pass->num_inputs; i++) {
+                FilterInput *in = &pass->input[i];
+                ogl(in->location = glGetUniformLocation(pass->program,
+                        in->uniform));
+        }
+        for (int c = 0; c < pass->chain_length; c++) {
+                const FilterPass *stage = &graph->pass[pass->chain[c]];
+                for (int i = 0; i < stage->num_uniforms; i++) {
+                        ogl(pass->location[c][i] = glGetUniformLocation(
+                                pass->program, stage->uniform[i].name));
+                }
+                pass->size_location[c] = -1;
+                if (stage->source) {
+                        char name[FILTER_MAX_NAME + 16];
+                        snprintf(name, sizeof(name), "%s_src_size",
+                                stage->name);
+                        ogl(pass->size_location[c] = glGetUniformLocation(
+                                pass->program, name));
+                }
+        }
+}
+
+void filterGraphCompile(FilterGraph *graph) {
+        for (int t = 0; t < graph->num_textures; t++) {
+                const FilterTexture *tex = &graph->texture[t];
+                if (!tex->external && tex->first < 0) {
+                        fail("no pass writes", tex->name);
+                }
+        }
+        for (int p = 0; p < graph->num_passes; p++) {
+                const FilterPass *pass = &graph->pass[p];
+                if (!pass->num_outputs
+                        || (pass->source && pass->num_inputs != 1))
+                {
+                        fail("no outputs or stage input in", pass->name);
+                }
+        }
+
+        if (graph->fuse_fetches > 0) {
+                fuseStages(graph);
+        }
+        requestStagePrograms(graph);
+        computeLifetimes(graph);
+        allocateTargets(graph);
+        for (int p = 0; p < graph->num_passes; p++) {
+                FilterPass *pass = &graph->pass[p];
+                if (pass->fused) {
+                        continue;
+                }
+                createFramebuffer(graph, pass);
+                findLocations(graph, pass);
+        }
+        graph->compiled = true;
+}
+
+/*****************************************************************************
+ * Running
+ ****************************************************************************/
+void filterGraphSetInput(FilterGraph *graph, const char *name,
+        GLuint texture)
+{
+        FilterTexture *tex = &graph->texture[findTexture(graph, name)];
+        if (!tex->external) {
+                fail("not an input:", name);
+        }
+        tex->texture = texture;
+}
+
+static void setUniform(GLint location, const FilterUniform *u) {
+        if (u->integer) {
+                ogl(glUniform1i(location, u->i[0]));
+                return;
+        }
+        switch (u->size) {
+        case 1:
+                ogl(glUniform1fv(location, 1, u->f));
+                break;
+        case 2:
+                ogl(glUniform2fv(location, 1, u->f));
+                break;
+        case 3:
+                ogl(glUniform3fv(location, 1, u->f));
+                break;
+        default:
+                ogl(glUniform4fv(location, 1, u->f));
+                break;
+        }
+}
+
+static void runPass(const FilterGraph *graph, const FilterPass *pass) {
+        ogl(glBindFramebuffer(GL_FRAMEBUFFER, pass->fbo));
+        ogl(glViewport(0, 0, pass->width, pass->height));
+        if (pass->flags & FILTER_CLEAR) {
+                ogl(glClear(GL_COLOR_BUFFER_BIT));
+        }
+
+        ogl(glUseProgram(pass->program));
+        for (int i = 0; i < pass->num_inputs; i++) {
+                const FilterInput *in = &pass->input[i];
+                ogl(glActiveTexture(GL_TEXTURE0 + i));
+                ogl(glBindTexture(GL_TEXTURE_2D,
+                        graph->texture[in->bound].texture));
+                if (in->sampler) {
+                        ogl(glBindSampler(i, in->sampler));
+                }
+                ogl(glUniform1i(in->location, i));
+        }
+        for (int c = 0; c < pass->chain_length; c++) {
+                const FilterPass *stage = &graph->pass[pass->chain[c]];
+                for (int i = 0; i < stage->num_uniforms; i++) {
+                        setUniform(pass->location[c][i], &stage->uniform[i]);
+                }
+                if (stage->source) {
+                        const FilterTexture *in =
+                                &graph->texture[stage->input[0].texture];
+                        ogl(glUniform2f(pass->size_location[c],
+                                in->width, in->height));
+                }
+        }
+
+        filterQuadDraw(graph->quad, pass->flags & FILTER_INVERTED);
+
+        for (int i = 0; i < pass->num_inputs; i++) {
+                if (pass->input[i].sampler) {
+                        ogl(glBindSampler(i, 0));
+                }
+        }
+        ogl(glActiveTexture(GL_TEXTURE0));
+}
+
+void filterGraphRun(const FilterGraph *graph) {
+        filterGraphRunPasses(graph, 0, graph->num_passes);
+}
+
+/* fused passes are part of their readers and skipped */
+void filterGraphRunPasses(const FilterGraph *graph, int first, int count) {
+        for (int p = first; p < first + count && p < graph->num_passes; p++) {
+                if (!graph->pass[p].fused) {
+                        runPass(graph, &graph->pass[p]);
+                }
+        }
+}
+
+GLuint filterGraphTexture(const FilterGraph *graph, const char *name) {
+        return graph->texture[findTexture(graph, name)].texture;
+}
+
+/* true when a target written after tex reuses its texture */
+static bool overwrittenLater(const FilterGraph *graph,
+        const FilterTexture *tex)
+{
+        for (int t = 0; t < graph->num_textures; t++) {
+                const FilterTexture *other = &graph->texture[t];
+                if (other != tex && other->physical == tex->physical
+                        && other->first > tex->first)
+                {
+                        return true;
+                }
+        }
+        return false;
+}
+
+void filterGraphBindRead(const FilterGraph *graph, const char *name) {
+        const FilterTexture *tex = &graph->texture[findTexture(graph, name)];
+        if (tex->external || tex->physical < 0) {
+                fail("not a rendered target:", name);
+        }
+        if (overwrittenLater(graph, tex)) {
+                fail("target shares its texture with a later one:", name);
+        }
+        ogl(glBindFramebuffer(GL_READ_FRAMEBUFFER,
+                graph->pass[tex->first].fbo));
+        ogl(glReadBuffer(GL_COLOR_ATTACHMENT0 + tex->attachment));
+}
+
+static size_t textureBytes(const FilterTexture *tex) {
+        return (size_t)tex->width * tex->height
+                * texelSize(tex->internal_format);
+}
+
+/* a full write of every output and a full read of every target input */
+size_t filterGraphTraffic(const FilterGraph *graph) {
+        size_t bytes = 0;
+        for (int p = 0; p < graph->num_passes; p++) {
+                const FilterPass *pass = &graph->pass[p];
+                if (pass->fused) {
+                        continue;
+                }
+                for (int o = 0; o < pass->num_outputs; o++) {
+                        bytes += textureBytes(&graph->texture[pass->output[o]]);
+                }
+                for (int i = 0; i < pass->num_inputs; i++) {
+                        const FilterTexture *tex =
+                                &graph->texture[pass->input[i].bound];
+                        if (!tex->external) {
+                                bytes += textureBytes(tex);
+                        }
+                }
+        }
+        return bytes;
+}
+
+void filterGraphPrintStats(const FilterGraph *graph, const char *label) {
+        int targets = 0;
+        int fused = 0;
+        size_t declared = 0;
+        size_t allocated = 0;
+        for (int t = 0; t < graph->num_textures; t++) {
+                const FilterTexture *tex = &graph->texture[t];
+                if (!tex->external && tex->physical >= 0) {
+                        targets++;
+                        declared += textureBytes(tex);
+                }
+        }
+        for (int i = 0; i < graph->num_physical; i++) {
+                const FilterPhysical *phys = &graph->physical[i];
+                allocated += (size_t)phys->width * phys->height
+                        * texelSize(phys->internal_format);
+        }
+        for (int p = 0; p < graph->num_passes; p++) {
+                fused += graph->pass[p].fused;
+        }
+        fprintf(stderr, "%s graph: %d passes, %d fused, %d targets in %d "
+                "textures, %.1f MB (%.1f MB saved by aliasing), "
+                "%.1f MB/frame of target traffic\n",
+                label, graph->num_passes - fused, fused, targets,
+                graph->num_physical, allocated / 1048576.0,
+                (declared - allocated) / 1048576.0,
+                filterGraphTraffic(graph) / 1048576.0);
+}
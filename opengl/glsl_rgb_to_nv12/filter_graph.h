@@ -0,0 +1,227 @@
+#ifndef __FILTER_GRAPH__H__
+#define __FILTER_GRAPH__H__
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "program_cache.h"
+
+/*****************************************************************************
+ * Full-screen filter graphs
+ *
+ * A graph is a list of named shader passes drawing the full-screen quad.
+ * Passes read named textures, either inputs the caller sets before each
+ * run or targets written by earlier passes, and render into named targets.
+ * filterGraphCompile() allocates the targets and their framebuffers once:
+ * a target is live from the pass writing it to the last pass reading it,
+ * and targets whose lifetimes do not overlap share one texture. Targets no
+ * pass reads are the outputs of the graph and live until the end.
+ *
+ * The quad is created once per context and shared by every graph drawing
+ * with it. Programs come from the caller, usually a ProgramCache, with
+ * "position" bound to location 0 and "texcoord" to location 1. Uniform
+ * locations are looked up at compile time and the values set on every run,
+ * so graphs may share programs.
+ ****************************************************************************/
+
+/*****************************************************************************
+ * Stages and fusion
+ *
+ * A stage is a pass the graph builds the program of. Its GLSL 1.50 source
+ * defines vec4 NAME(vec2 pixel), the color of the output pixel centered at
+ * pixel, and reads its one input with NAME_src(vec2 pixel) in the input's
+ * pixel coordinates. NAME_src_size holds the input size. taps is how many
+ * NAME_src() calls a pixel makes at most.
+ *
+ * With fusion on, a stage whose output only feeds stages is not run.
+ * Instead its source is chained into theirs, so their NAME_src() calls
+ * compute it, and its target is never written or read. That trades a
+ * round trip through memory for computing it again per tap: a stage is
+ * fused only while each reader's fetches per pixel, its taps times the
+ * fetches of what it reads, stay within the budget. The stages of one
+ * chain share a program and must not define the same globals. Passes of
+ * the same stage may repeat with different uniforms, they share their
+ * program and are never fused with each other.
+ ****************************************************************************/
+enum {
+        FILTER_MAX_TEXTURES = 40,
+        FILTER_MAX_PASSES = 24,
+        FILTER_MAX_INPUTS = 4,
+        FILTER_MAX_OUTPUTS = 4,
+        FILTER_MAX_UNIFORMS = 8,
+        /* stages computed by one fused program */
+        FILTER_MAX_CHAIN = 4,
+        FILTER_MAX_NAME = 48,
+};
+
+/* pass flags */
+enum {
+        /* texture coordinates with t = 0 at the bottom row */
+        FILTER_INVERTED = 1,
+        /* clears the targets to the current clear color first */
+        FILTER_CLEAR = 2,
+};
+
+struct FilterQuad {
+        /* upright and inverted texture coordinates */
+        GLuint vao[2];
+        GLuint vbo[2];
+        GLuint ibo;
+};
+
+struct FilterTexture {
+        const char *name;
+        /* set by the caller, not allocated by the graph */
+        bool external;
+        int width;
+        int height;
+        GLenum internal_format;
+
+        /* writing and last reading pass, -1 when there is none */
+        int first;
+        int last;
+        /* index into FilterGraph::physical, -1 when not allocated */
+        int physical;
+        GLuint texture;
+        /* the color attachment of its pass */
+        int attachment;
+};
+
+struct FilterInput {
+        /* as declared, and what is bound once stages are fused */
+        int texture;
+        int bound;
+        const char *uniform;
+        GLint location;
+        /* 0 samples with the texture's own parameters */
+        GLuint sampler;
+};
+
+struct FilterUniform {
+        const char *name;
+        int size;
+        bool integer;
+        GLfloat f[4];
+        GLint i[4];
+};
+
+struct FilterPass {
+        const char *name;
+        GLuint program;
+        int flags;
+        int num_inputs;
+        FilterInput input[FILTER_MAX_INPUTS];
+        int num_outputs;
+        int output[FILTER_MAX_OUTPUTS];
+        int num_uniforms;
+        FilterUniform uniform[FILTER_MAX_UNIFORMS];
+
+        /* stages only, NULL for passes with their own program */
+        const char *source;
+        int taps;
+        char tex_uniform[FILTER_MAX_NAME];
+        /* computed by its readers instead of run */
+        bool fused;
+        int fetches;
+        /* this pass and the stages fused into it, innermost last */
+        int chain_length;
+        int chain[FILTER_MAX_CHAIN];
+        GLint size_location[FILTER_MAX_CHAIN];
+        GLint location[FILTER_MAX_CHAIN][FILTER_MAX_UNIFORMS];
+
+        /* the render area is the size of the first output */
+        GLuint fbo;
+        int width;
+        int height;
+};
+
+struct FilterPhysical {
+        GLuint texture;
+        int width;
+        int height;
+        GLenum internal_format;
+        /* the last pass reading any target stored in it */
+        int last;
+};
+
+struct FilterGraph {
+        const FilterQuad *quad;
+        /* builds the stage programs, may be NULL without stages */
+        ProgramCache *programs;
+        /* 0 keeps every stage a pass of its own */
+        int fuse_fetches;
+        int num_textures;
+        FilterTexture texture[FILTER_MAX_TEXTURES];
+        int num_passes;
+        FilterPass pass[FILTER_MAX_PASSES];
+        int num_physical;
+        FilterPhysical physical[FILTER_MAX_TEXTURES];
+        bool compiled;
+};
+
+void filterQuadInit(FilterQuad *quad);
+void filterQuadDestroy(FilterQuad *quad);
+/* draws with the program in use */
+void filterQuadDraw(const FilterQuad *quad, bool inverted);
+
+void filterGraphInit(FilterGraph *graph, const FilterQuad *quad,
+        ProgramCache *programs);
+void filterGraphDestroy(FilterGraph *graph);
+/* fetches per pixel a fused stage may reach, 0 turns fusion off */
+void filterGraphSetFusion(FilterGraph *graph, int max_fetches);
+
+/*
+ * Declarations keep the name pointers, they have to outlive the graph.
+ * Unknown names and overflowing limits are fatal, like shader errors.
+ */
+void filterGraphAddInput(FilterGraph *graph, const char *name,
+        int width, int height);
+void filterGraphAddTarget(FilterGraph *graph, const char *name,
+        int width, int height, GLenum internal_format);
+/* returns the pass index for the filterPass*() calls */
+int filterGraphAddPass(FilterGraph *graph, const char *name,
+        GLuint program, int flags);
+/* name must be a GLSL identifier, see Stages above */
+int filterGraphAddStage(FilterGraph *graph, const char *name,
+        const char *source, int taps, int flags);
+/*
+ * Inputs take texture units in the order they are declared. Stages read
+ * one input and ignore uniform and sampler.
+ */
+void filterPassRead(FilterGraph *graph, int pass, const char *texture,
+        const char *uniform, GLuint sampler);
+/* outputs take color attachments in the order they are declared */
+void filterPassWrite(FilterGraph *graph, int pass, const char *texture);
+/* declared before compiling, may be called again after to change values */
+void filterPassUniform(FilterGraph *graph, int pass, const char *name,
+        int size, const GLfloat *value);
+void filterPassUniform2f(FilterGraph *graph, int pass, const char *name,
+        GLfloat x, GLfloat y);
+void filterPassUniform1i(FilterGraph *graph, int pass, const char *name,
+        GLint value);
+
+/* needs the caller's programs linked, see programCacheFinish() */
+void filterGraphCompile(FilterGraph *graph);
+
+void filterGraphSetInput(FilterGraph *graph, const char *name,
+        GLuint texture);
+void filterGraphRun(const FilterGraph *graph);
+void filterGraphRunPasses(const FilterGraph *graph, int first, int count);
+
+GLuint filterGraphTexture(const FilterGraph *graph, const char *name);
+/*
+ * Binds the framebuffer and read buffer holding a target for glReadPixels.
+ * Outputs can always be read. A target that later passes read can only be
+ * read if no later target reuses its texture, otherwise this fails.
+ */
+void filterGraphBindRead(const FilterGraph *graph, const char *name);
+
+/* bytes rendered into and sampled from targets per run */
+size_t filterGraphTraffic(const FilterGraph *graph);
+/* passes, fused stages, targets, their textures and the memory traffic */
+void filterGraphPrintStats(const FilterGraph *graph, const char *label);
+
+#endif //__FILTER_GRAPH__H__
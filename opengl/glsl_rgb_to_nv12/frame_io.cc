@@ -0,0 +1,435 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "frame_io.h"
+
+static const char y4m_magic[] = "YUV4MPEG2";
+
+/* reads one '\n' terminated header line, returns false on EOF/overflow */
+static bool readLine(FILE *file, char *line, size_t size) {
+        if (!fgets(line, size, file)) {
+                return false;
+        }
+        return strchr(line, '\n') != NULL;
+}
+
+static bool parseY4mHeader(FrameReader *reader, char *line) {
+        /* without a C tag the frames are 4:2:0 */
+        bool c444 = false;
+        char *save = NULL;
+        strtok_r(line, " \n", &save);
+        for (char *tok = strtok_r(NULL, " \n", &save); tok;
+                tok = strtok_r(NULL, " \n", &save))
+        {
+                switch (tok[0]) {
+                case 'W':
+                        reader->width = atoi(tok + 1);
+                        break;
+                case 'H':
+                        reader->height = atoi(tok + 1);
+                        break;
+                case 'C':
+                        c444 = !strcmp(tok + 1, "444");
+                        break;
+                case 'I':
+                        if (tok[1] != 'p' && tok[1] != '?') {
+                                fprintf(stderr, "y4m: interlaced input "
+                                        "is not supported\n");
+                                return false;
+                        }
+                        break;
+                case 'X':
+                        if (!strcmp(tok + 1, "COLORRANGE=FULL")) {
+                                reader->y4m_full_range = true;
+                        }
+                        break;
+                default:
+                        break;
+                }
+        }
+        if (!c444) {
+                fprintf(stderr, "y4m: unsupported colorspace, need C444\n");
+                return false;
+        }
+        return reader->width > 0 && reader->height > 0;
+}
+
+static inline unsigned char clampByte(int v) {
+        return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+/*
+ * One planar y4m frame into RGB24 rows of the reader's stride, BT.601 in
+ * 16.16 fixed point.
+ */
+static void y4mToRgb(const FrameReader *reader, const unsigned char *planes,
+        void *rgb)
+{
+        /* Y scale and offset, Cr to R, Cb and Cr to G, Cb to B */
+        static const int limited[6] = { 76309, 16, 104597, 25675, 53279,
+                132201 };
+        static const int full[6] = { 65536, 0, 91881, 22554, 46802, 116130 };
+        const int *k = reader->y4m_full_range ? full : limited;
+
+        size_t plane_size = (size_t)reader->width * reader->height;
+        const unsigned char *py = planes;
+        const unsigned char *pcb = planes + plane_size;
+        const unsigned char *pcr = planes + 2 * plane_size;
+        unsigned char *row = (unsigned char*)rgb;
+        for (int y = 0; y < reader->height; y++) {
+                unsigned char *out = row;
+                for (int x = 0; x < reader->width; x++) {
+                        int l = (*py++ - k[1]) * k[0] + 32768;
+                        int cb = *pcb++ - 128;
+                        int cr = *pcr++ - 128;
+                        out[0] = clampByte((l + k[2] * cr) >> 16);
+                        out[1] = clampByte((l - k[3] * cb - k[4] * cr) >> 16);
+                        out[2] = clampByte((l + k[5] * cb) >> 16);
+                        out += 3;
+                }
+                row += reader->stride;
+        }
+}
+
+/* maps regular files, anything else keeps going through stdio */
+static void mapInput(FrameReader *reader) {
+        struct stat st;
+        int fd = fileno(reader->file);
+        if (reader->file == stdin || fstat(fd, &st) || !S_ISREG(st.st_mode)
+                || st.st_size == 0)
+        {
+                return;
+        }
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+                return;
+        }
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        reader->map = (const char*)map;
+        reader->map_size = st.st_size;
+        /* the y4m header was already read through the stream */
+        reader->map_pos = ftell(reader->file);
+}
+
+/* the mapped counterpart of readLine() */
+static bool readMappedLine(FrameReader *reader, char *line, size_t size) {
+        const char *start = reader->map + reader->map_pos;
+        size_t left = reader->map_size - reader->map_pos;
+        const char *end = (const char*)memchr(start, '\n',
+                left < size ? left : size - 1);
+        if (!end) {
+                return false;
+        }
+        size_t len = end - start + 1;
+        memcpy(line, start, len);
+        line[len] = '\0';
+        reader->map_pos += len;
+        return true;
+}
+
+/* skips the FRAME line of a y4m frame, false at the end of the stream */
+static bool nextFrameHeader(FrameReader *reader) {
+        if (!reader->y4m) {
+                return true;
+        }
+        char line[256];
+        bool ok = reader->map ? readMappedLine(reader, line, sizeof(line))
+                : readLine(reader->file, line, sizeof(line));
+        if (!ok) {
+                return false;
+        }
+        if (strncmp(line, "FRAME", 5)) {
+                fprintf(stderr, "y4m: lost frame sync\n");
+                return false;
+        }
+        return true;
+}
+
+/* rows from the mapping into a caller's buffer, spread out for y4m */
+static bool copyMappedFrame(FrameReader *reader, void *rgb) {
+        size_t file_size = reader->file_stride * reader->height;
+        size_t left = reader->map_size - reader->map_pos;
+        if (left < file_size) {
+                if (left) {
+                        fprintf(stderr, "dropping truncated frame "
+                                "(%zu of %zu bytes)\n", left, file_size);
+                }
+                reader->map_pos = reader->map_size;
+                return false;
+        }
+
+        const char *src = reader->map + reader->map_pos;
+        if (reader->y4m) {
+                y4mToRgb(reader, (const unsigned char*)src, rgb);
+        }
+        else if (reader->file_stride == reader->stride) {
+                memcpy(rgb, src, file_size);
+        }
+        else {
+                char *row = (char*)rgb;
+                for (int y = 0; y < reader->height; y++) {
+                        memcpy(row, src, reader->file_stride);
+                        src += reader->file_stride;
+                        row += reader->stride;
+                }
+        }
+        reader->map_pos += file_size;
+        return true;
+}
+
+bool frameReaderOpen(FrameReader *reader, const char *path,
+        int width, int height, size_t stride)
+{
+        memset(reader, 0, sizeof(*reader));
+        reader->width = width;
+        reader->height = height;
+
+        if (!strcmp(path, "-")) {
+                reader->file = stdin;
+        }
+        else {
+                reader->file = fopen(path, "rb");
+        }
+        if (!reader->file) {
+                perror(path);
+                return false;
+        }
+
+        int c = fgetc(reader->file);
+        if (c != EOF) {
+                ungetc(c, reader->file);
+        }
+        if (c == y4m_magic[0]) {
+                char line[256];
+                if (!readLine(reader->file, line, sizeof(line))
+                        || strncmp(line, y4m_magic, strlen(y4m_magic))
+                        || !parseY4mHeader(reader, line))
+                {
+                        fprintf(stderr, "%s: bad y4m header\n", path);
+                        frameReaderClose(reader);
+                        return false;
+                }
+                reader->y4m = true;
+        }
+
+        size_t row_size = (size_t)reader->width * 3;
+        reader->stride = (stride > row_size) ? stride : row_size;
+        reader->file_stride = reader->y4m ? row_size : reader->stride;
+        reader->frame_size = reader->stride * reader->height;
+        mapInput(reader);
+        /* the same size as packed RGB24, 3 planes of a byte per pixel */
+        if (reader->y4m && !reader->map) {
+                reader->planes = (unsigned char*)malloc(row_size
+                        * reader->height);
+                if (!reader->planes) {
+                        perror("malloc");
+                        frameReaderClose(reader);
+                        return false;
+                }
+        }
+        return true;
+}
+
+bool frameReaderNext(FrameReader *reader, void *rgb) {
+        if (!nextFrameHeader(reader)) {
+                return false;
+        }
+        if (reader->map) {
+                return copyMappedFrame(reader, rgb);
+        }
+
+        if (reader->y4m) {
+                size_t size = reader->file_stride * reader->height;
+                size_t got = fread(reader->planes, 1, size, reader->file);
+                if (got != size) {
+                        if (got) {
+                                fprintf(stderr, "dropping truncated frame "
+                                        "(%zu of %zu bytes)\n", got, size);
+                        }
+                        return false;
+                }
+                y4mToRgb(reader, reader->planes, rgb);
+                return true;
+        }
+
+        if (reader->file_stride == reader->stride) {
+                size_t got = fread(rgb, 1, reader->frame_size, reader->file);
+                if (got != reader->frame_size) {
+                        if (got) {
+                                fprintf(stderr, "dropping truncated frame "
+                                        "(%zu of %zu bytes)\n",
+                                        got, reader->frame_size);
+                        }
+                        return false;
+                }
+                return true;
+        }
+
+        /* tight rows from the stream into a padded buffer */
+        char *row = (char*)rgb;
+        for (int y = 0; y < reader->height; y++) {
+                size_t got = fread(row, 1, reader->file_stride, reader->file);
+                if (got != reader->file_stride) {
+                        if (got || y) {
+                                fprintf(stderr, "dropping truncated frame "
+                                        "(%d of %d rows)\n",
+                                        y, reader->height);
+                        }
+                        return false;
+                }
+                row += reader->stride;
+        }
+        return true;
+}
+
+const void *frameReaderNextMapped(FrameReader *reader) {
+        if (!frameReaderMapped(reader) || !nextFrameHeader(reader)) {
+                return NULL;
+        }
+        size_t left = reader->map_size - reader->map_pos;
+        if (left < reader->frame_size) {
+                if (left) {
+                        fprintf(stderr, "dropping truncated frame "
+                                "(%zu of %zu bytes)\n",
+                                left, reader->frame_size);
+                }
+                reader->map_pos = reader->map_size;
+                return NULL;
+        }
+        const void *frame = reader->map + reader->map_pos;
+        reader->map_pos += reader->frame_size;
+        return frame;
+}
+
+void frameReaderClose(FrameReader *reader) {
+        free(reader->planes);
+        reader->planes = NULL;
+        if (reader->map) {
+                munmap((void*)reader->map, reader->map_size);
+                reader->map = NULL;
+        }
+        if (reader->file && reader->file != stdin) {
+                fclose(reader->file);
+        }
+        reader->file = NULL;
+}
+
+bool frameWriterOpen(FrameWriter *writer, const char *path) {
+        if (!strcmp(path, "-")) {
+                writer->file = stdout;
+        }
+        else {
+                writer->file = fopen(path, "wb");
+        }
+        if (!writer->file) {
+                perror(path);
+                return false;
+        }
+        return true;
+}
+
+bool frameWriterWrite(FrameWriter *writer, const void *data, size_t size) {
+        if (1 != fwrite(data, size, 1, writer->file)) {
+                perror("fwrite");
+                return false;
+        }
+        return true;
+}
+
+void frameWriterClose(FrameWriter *writer) {
+        if (!writer->file) {
+                return;
+        }
+        if (writer->file == stdout) {
+                fflush(stdout);
+        }
+        else {
+                fclose(writer->file);
+        }
+        writer->file = NULL;
+}
+
+bool mappedFileCreate(MappedFile *file, const char *path, size_t size) {
+        file->data = NULL;
+        file->size = size;
+        file->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (file->fd < 0) {
+                perror(path);
+                return false;
+        }
+        if (ftruncate(file->fd, size)) {
+                perror("ftruncate");
+                mappedFileClose(file);
+                return false;
+        }
+        if (!size) {
+                return true;
+        }
+        void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                file->fd, 0);
+        if (data == MAP_FAILED) {
+                perror("mmap");
+                mappedFileClose(file);
+                return false;
+        }
+        file->data = (char*)data;
+        return true;
+}
+
+bool mappedFileExport(const MappedFile *file, const char *path,
+        size_t offset, size_t size)
+{
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+                perror(path);
+                return false;
+        }
+
+        loff_t src = offset;
+        size_t left = size;
+        while (left) {
+                ssize_t n = copy_file_range(file->fd, &src, fd, NULL, left, 0);
+                if (n > 0) {
+                        left -= n;
+                        continue;
+                }
+                if (n < 0 && errno != EXDEV && errno != ENOSYS
+                        && errno != EINVAL && errno != EOPNOTSUPP)
+                {
+                        perror("copy_file_range");
+                        close(fd);
+                        return false;
+                }
+                /* no in-kernel copy between these files, or a short file */
+                break;
+        }
+        /* whatever is left goes out of the mapping */
+        const char *data = file->data + (size - left) + offset;
+        while (left) {
+                ssize_t n = write(fd, data, left);
+                if (n <= 0) {
+                        perror("write");
+                        close(fd);
+                        return false;
+                }
+                data += n;
+                left -= n;
+        }
+        return !close(fd);
+}
+
+void mappedFileClose(MappedFile *file) {
+        if (file->data) {
+                munmap(file->data, file->size);
+                file->data = NULL;
+        }
+        if (file->fd >= 0) {
+                close(file->fd);
+                file->fd = -1;
+        }
+}
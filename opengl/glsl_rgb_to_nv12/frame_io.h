@@ -0,0 +1,89 @@
+#ifndef __FRAME_IO__H__
+#define __FRAME_IO__H__
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*****************************************************************************
+ * Frame streams
+ *
+ * Input is either headerless packed RGB24 or a YUV4MPEG2 stream of 8-bit
+ * 4:4:4 frames (C444), whose Y, Cb and Cr planes are converted to RGB24 on
+ * read: BT.601 limited range, full range with XCOLORRANGE=FULL. "-" selects
+ * stdin/stdout. Regular input files are mapped, frames are then copied out
+ * of the page cache or, with frameReaderNextMapped(), not copied at all.
+ ****************************************************************************/
+struct FrameReader {
+        FILE *file;
+        bool y4m;
+        bool y4m_full_range;
+        /* one planar y4m frame read from a stream, before its conversion */
+        unsigned char *planes;
+        int width;
+        int height;
+        /* bytes per row in the caller's buffer and in the stream */
+        size_t stride;
+        size_t file_stride;
+        size_t frame_size;
+        /* whole input file, NULL for pipes; map_pos is the next frame */
+        const char *map;
+        size_t map_size;
+        size_t map_pos;
+};
+
+struct FrameWriter {
+        FILE *file;
+};
+
+/*
+ * width and height are the expected geometry for raw input; Y4M input
+ * overrides them from its header. stride is the row pitch of the frames
+ * handed to frameReaderNext(), 0 or anything below width * 3 means tight.
+ * Raw input carries the same padding on disk, Y4M rows are always tight
+ * and get spread out while reading.
+ */
+bool frameReaderOpen(FrameReader *reader, const char *path,
+        int width, int height, size_t stride);
+/* reads frame_size bytes into rgb, returns false at the end of the stream */
+bool frameReaderNext(FrameReader *reader, void *rgb);
+
+/* true when frames can be used in place, see frameReaderNextMapped() */
+static inline bool frameReaderMapped(const FrameReader *reader) {
+        return reader->map && !reader->y4m
+                && reader->file_stride == reader->stride;
+}
+
+/*
+ * Same as frameReaderNext(), but returns the frame inside the mapping,
+ * valid until frameReaderClose(). NULL at the end of the stream or when
+ * the input is not frameReaderMapped().
+ */
+const void *frameReaderNextMapped(FrameReader *reader);
+void frameReaderClose(FrameReader *reader);
+
+bool frameWriterOpen(FrameWriter *writer, const char *path);
+bool frameWriterWrite(FrameWriter *writer, const void *data, size_t size);
+void frameWriterClose(FrameWriter *writer);
+
+/*****************************************************************************
+ * Mapped output files
+ *
+ * A file of a fixed size, created zero filled and written through a shared
+ * mapping, so a frame lands in the page cache without a bounce buffer.
+ * Ranges of it are exported as files of their own with copy_file_range(),
+ * which shares the extents on filesystems with reflinks and stays in the
+ * kernel elsewhere.
+ ****************************************************************************/
+struct MappedFile {
+        int fd;
+        char *data;
+        size_t size;
+};
+
+bool mappedFileCreate(MappedFile *file, const char *path, size_t size);
+/* size bytes at offset of file become the file at path */
+bool mappedFileExport(const MappedFile *file, const char *path,
+        size_t offset, size_t size);
+void mappedFileClose(MappedFile *file);
+
+#endif //__FRAME_IO__H__
@@ -0,0 +1,206 @@
+#include <algorithm>
+
+#include "opengl_utils.h"
+#include "gpu_timer.h"
+
+void gpuTimerInit(GpuTimer *timer, int depth, bool enabled) {
+        if (depth < 1) {
+                depth = 1;
+        }
+        if (depth > GPU_TIMER_MAX_DEPTH) {
+                depth = GPU_TIMER_MAX_DEPTH;
+        }
+        if (enabled && !GLEW_ARB_timer_query) {
+                fprintf(stderr, "no ARB_timer_query, GPU timers are off\n");
+                enabled = false;
+        }
+
+        timer->enabled = enabled;
+        timer->depth = depth;
+        timer->head = -1;
+        timer->num_stages = 0;
+        timer->stalls = 0;
+        for (int s = 0; s < GPU_TIMER_MAX_STAGES; s++) {
+                timer->name[s] = NULL;
+                timer->samples[s].clear();
+        }
+        if (!enabled) {
+                return;
+        }
+
+        for (int f = 0; f < depth; f++) {
+                GpuTimerFrame *frame = &timer->frame[f];
+                ogl(glGenQueries(GPU_TIMER_MAX_STAGES * 2,
+                        &frame->query[0][0]));
+                frame->pending = false;
+        }
+}
+
+void gpuTimerDestroy(GpuTimer *timer) {
+        if (!timer->enabled) {
+                return;
+        }
+        for (int f = 0; f < timer->depth; f++) {
+                ogl(glDeleteQueries(GPU_TIMER_MAX_STAGES * 2,
+                        &timer->frame[f].query[0][0]));
+        }
+        timer->enabled = false;
+}
+
+int gpuTimerAddStage(GpuTimer *timer, const char *name) {
+        if (timer->num_stages == GPU_TIMER_MAX_STAGES) {
+                puts("too many GPU timer stages");
+                exit(-1);
+        }
+        timer->name[timer->num_stages] = name;
+        return timer->num_stages++;
+}
+
+static void collectFrame(GpuTimer *timer, GpuTimerFrame *frame,
+        bool flushing)
+{
+        if (!frame->pending) {
+                return;
+        }
+
+        /* queries complete in order, the last stop query is the latest */
+        GLuint last = 0;
+        for (int s = 0; s < timer->num_stages; s++) {
+                if (frame->used[s]) {
+                        last = frame->query[s][1];
+                }
+        }
+        GLint available = 1;
+        if (last) {
+                ogl(glGetQueryObjectiv(last, GL_QUERY_RESULT_AVAILABLE,
+                        &available));
+        }
+        if (!available && !flushing) {
+                timer->stalls++;
+        }
+
+        for (int s = 0; s < timer->num_stages; s++) {
+                if (!frame->used[s]) {
+                        continue;
+                }
+                GLuint64 start, stop;
+                ogl(glGetQueryObjectui64v(frame->query[s][0],
+                        GL_QUERY_RESULT, &start));
+                ogl(glGetQueryObjectui64v(frame->query[s][1],
+                        GL_QUERY_RESULT, &stop));
+                timer->samples[s].push_back((stop - start) * 1e-6);
+        }
+        frame->pending = false;
+}
+
+void gpuTimerBeginFrame(GpuTimer *timer) {
+        if (!timer->enabled) {
+                return;
+        }
+        timer->head = (timer->head + 1) % timer->depth;
+        GpuTimerFrame *frame = &timer->frame[timer->head];
+        collectFrame(timer, frame, false);
+        for (int s = 0; s < GPU_TIMER_MAX_STAGES; s++) {
+                frame->used[s] = false;
+        }
+        frame->pending = true;
+}
+
+void gpuTimerStart(GpuTimer *timer, int stage) {
+        if (!timer->enabled || timer->head < 0) {
+                return;
+        }
+        GpuTimerFrame *frame = &timer->frame[timer->head];
+        ogl(glQueryCounter(frame->query[stage][0], GL_TIMESTAMP));
+}
+
+void gpuTimerStop(GpuTimer *timer, int stage) {
+        if (!timer->enabled || timer->head < 0) {
+                return;
+        }
+        GpuTimerFrame *frame = &timer->frame[timer->head];
+        ogl(glQueryCounter(frame->query[stage][1], GL_TIMESTAMP));
+        frame->used[stage] = true;
+}
+
+void gpuTimerFlush(GpuTimer *timer) {
+        if (!timer->enabled) {
+                return;
+        }
+        /* oldest first, so the samples stay in frame order */
+        for (int i = 1; i <= timer->depth; i++) {
+                int f = (timer->head + i) % timer->depth;
+                collectFrame(timer, &timer->frame[f], true);
+        }
+}
+
+struct StageSummary {
+        size_t count;
+        double min;
+        double median;
+        double p99;
+};
+
+static StageSummary summarize(const std::vector<double> &samples) {
+        StageSummary sum = { samples.size(), 0.0, 0.0, 0.0 };
+        if (samples.empty()) {
+                return sum;
+        }
+        std::vector<double> sorted(samples);
+        std::sort(sorted.begin(), sorted.end());
+        size_t n = sorted.size();
+        size_t p99 = (n * 99 + 99) / 100;
+        sum.min = sorted[0];
+        sum.median = sorted[n / 2];
+        sum.p99 = sorted[(p99 ? p99 : 1) - 1];
+        return sum;
+}
+
+void gpuTimerPrintStats(const GpuTimer *timer) {
+        if (!timer->enabled) {
+                return;
+        }
+        fprintf(stderr, "GPU stages (ms):  %-10s %8s %8s %8s %8s\n",
+                "stage", "frames", "min", "median", "p99");
+        for (int s = 0; s < timer->num_stages; s++) {
+                StageSummary sum = summarize(timer->samples[s]);
+                if (!sum.count) {
+                        continue;
+                }
+                fprintf(stderr, "                  %-10s %8zu %8.3f %8.3f "
+                        "%8.3f\n", timer->name[s], sum.count,
+                        sum.min, sum.median, sum.p99);
+        }
+        fprintf(stderr, "GPU timer pool depth %d, %d frames stalled on "
+                "results\n", timer->depth, timer->stalls);
+}
+
+bool gpuTimerWriteCsv(const GpuTimer *timer, const char *path,
+        const char *label)
+{
+        if (!timer->enabled) {
+                return false;
+        }
+        FILE *out = fopen(path, "w");
+        if (!out) {
+                perror("fopen");
+                return false;
+        }
+
+        const char *renderer = (const char *)glGetString(GL_RENDERER);
+        const char *version = (const char *)glGetString(GL_VERSION);
+        fprintf(out, "renderer,version,label,stage,frames,min_ms,median_ms,"
+                "p99_ms\n");
+        for (int s = 0; s < timer->num_stages; s++) {
+                StageSummary sum = summarize(timer->samples[s]);
+                if (!sum.count) {
+                        continue;
+                }
+                fprintf(out, "\"%s\",\"%s\",%s,%s,%zu,%.4f,%.4f,%.4f\n",
+                        renderer, version, label, timer->name[s], sum.count,
+                        sum.min, sum.median, sum.p99);
+        }
+        bool ok = !ferror(out);
+        fclose(out);
+        return ok;
+}
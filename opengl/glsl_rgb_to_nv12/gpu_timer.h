@@ -0,0 +1,66 @@
+#ifndef __GPU_TIMER__H__
+#define __GPU_TIMER__H__
+
+#include <stdio.h>
+
+#include <vector>
+
+#include <GL/glew.h>
+
+/*****************************************************************************
+ * Per-stage GPU timers
+ *
+ * Every stage of a frame is bracketed by two GL_TIMESTAMP queries, so
+ * stages may contain GL_TIME_ELAPSED queries of their own. The queries of
+ * a frame come from a pool of depth frames and are only read back when
+ * the pool wraps around, by which time the GPU has long finished them.
+ ****************************************************************************/
+enum {
+        GPU_TIMER_MAX_STAGES = 8,
+        GPU_TIMER_MAX_DEPTH = 32,
+};
+
+struct GpuTimerFrame {
+        GLuint query[GPU_TIMER_MAX_STAGES][2];
+        bool used[GPU_TIMER_MAX_STAGES];
+        bool pending;
+};
+
+struct GpuTimer {
+        bool enabled;
+        int depth;
+        int head;
+        GpuTimerFrame frame[GPU_TIMER_MAX_DEPTH];
+
+        int num_stages;
+        const char *name[GPU_TIMER_MAX_STAGES];
+        /* milliseconds per frame */
+        std::vector<double> samples[GPU_TIMER_MAX_STAGES];
+        /* pool wrap-arounds that had to wait for the GPU */
+        int stalls;
+};
+
+/* a disabled timer turns every other call into a no-op */
+void gpuTimerInit(GpuTimer *timer, int depth, bool enabled);
+void gpuTimerDestroy(GpuTimer *timer);
+
+/* registers a stage, returns its id */
+int gpuTimerAddStage(GpuTimer *timer, const char *name);
+
+/*
+ * Starts the next frame of the pool, collecting the results of the frame
+ * that used its queries before. Each stage is timed at most once a frame.
+ */
+void gpuTimerBeginFrame(GpuTimer *timer);
+void gpuTimerStart(GpuTimer *timer, int stage);
+void gpuTimerStop(GpuTimer *timer, int stage);
+
+/* waits for and collects every pending frame */
+void gpuTimerFlush(GpuTimer *timer);
+
+void gpuTimerPrintStats(const GpuTimer *timer);
+/* one row per stage: min, median and p99 in ms, tagged with the driver */
+bool gpuTimerWriteCsv(const GpuTimer *timer, const char *path,
+        const char *label);
+
+#endif //__GPU_TIMER__H__
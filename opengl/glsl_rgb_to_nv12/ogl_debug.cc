@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mutex>
+
+#include "opengl_utils.h"
+#include "ogl_debug.h"
+
+thread_local OglSite ogl_site;
+
+enum {
+        OGL_DEBUG_MAX_ENTRIES = 64,
+        OGL_DEBUG_MAX_MESSAGE = 256,
+};
+
+struct OglDebugEntry {
+        GLenum type;
+        GLenum severity;
+        GLuint id;
+        OglSite site;
+        int count;
+        char message[OGL_DEBUG_MAX_MESSAGE];
+};
+
+/* the driver may call back from its own threads */
+static std::mutex log_lock;
+static OglDebugEntry log_entry[OGL_DEBUG_MAX_ENTRIES];
+static int num_entries;
+static int dropped;
+static int errors;
+static bool at_exit;
+
+#ifdef GL_DEBUG_OUTPUT
+static const char *severityName(GLenum severity) {
+        switch (severity) {
+        case GL_DEBUG_SEVERITY_HIGH:
+                return "high";
+        case GL_DEBUG_SEVERITY_MEDIUM:
+                return "medium";
+        case GL_DEBUG_SEVERITY_LOW:
+                return "low";
+        default:
+                return "note";
+        }
+}
+
+static const char *typeName(GLenum type) {
+        switch (type) {
+        case GL_DEBUG_TYPE_ERROR:
+                return "error";
+        case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+                return "deprecated";
+        case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
+                return "undefined behavior";
+        case GL_DEBUG_TYPE_PORTABILITY:
+                return "portability";
+        case GL_DEBUG_TYPE_PERFORMANCE:
+                return "performance";
+        default:
+                return "message";
+        }
+}
+
+static void printEntry(const OglDebugEntry *e) {
+        if (e->site.func) {
+                fprintf(stderr, "GL %s %s at %d, %s: %s\n",
+                        severityName(e->severity), typeName(e->type),
+                        e->site.line, e->site.func, e->message);
+        }
+        else {
+                fprintf(stderr, "GL %s %s: %s\n", severityName(e->severity),
+                        typeName(e->type), e->message);
+        }
+}
+
+static void GLAPIENTRY onMessage(GLenum source, GLenum type, GLuint id,
+        GLenum severity, GLsizei length, const GLchar *message,
+        const void *user)
+{
+        OglSite site = ogl_site;
+        std::lock_guard<std::mutex> guard(log_lock);
+        if (type == GL_DEBUG_TYPE_ERROR) {
+                errors++;
+        }
+        for (int i = 0; i < num_entries; i++) {
+                OglDebugEntry *e = &log_entry[i];
+                if (e->id == id && e->type == type && e->site.func == site.func
+                        && e->site.line == site.line)
+                {
+                        e->count++;
+                        return;
+                }
+        }
+        if (num_entries == OGL_DEBUG_MAX_ENTRIES) {
+                dropped++;
+                return;
+        }
+
+        OglDebugEntry *e = &log_entry[num_entries++];
+        e->type = type;
+        e->severity = severity;
+        e->id = id;
+        e->site = site;
+        e->count = 1;
+        snprintf(e->message, sizeof(e->message), "%.*s",
+                length < 0 ? (int)strlen(message) : (int)length, message);
+        printEntry(e);
+}
+#endif
+
+bool oglDebugInit(void) {
+#ifdef GL_DEBUG_OUTPUT
+        if (!GLEW_KHR_debug) {
+#ifdef OGL_RELEASE
+                fprintf(stderr, "no KHR_debug, GL errors go unreported\n");
+#endif
+                return false;
+        }
+        ogl(glEnable(GL_DEBUG_OUTPUT));
+#ifdef OGL_RELEASE
+        /* messages from the driver's threads then come without a site */
+        ogl(glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS));
+#else
+        ogl(glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS));
+#endif
+        /* notifications are the driver thinking aloud */
+        ogl(glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE,
+                GL_DEBUG_SEVERITY_NOTIFICATION, 0, NULL, GL_FALSE));
+        ogl(glDebugMessageCallback(onMessage, NULL));
+
+        std::lock_guard<std::mutex> guard(log_lock);
+        if (!at_exit) {
+                atexit(oglDebugPrintLog);
+                at_exit = true;
+        }
+        return true;
+#else
+        return false;
+#endif
+}
+
+int oglDebugErrors(void) {
+        std::lock_guard<std::mutex> guard(log_lock);
+        return errors;
+}
+
+void oglDebugPrintLog(void) {
+#ifdef GL_DEBUG_OUTPUT
+        std::lock_guard<std::mutex> guard(log_lock);
+        if (!num_entries) {
+                return;
+        }
+        fprintf(stderr, "GL debug log, %d errors:\n", errors);
+        for (int i = 0; i < num_entries; i++) {
+                fprintf(stderr, "%6dx ", log_entry[i].count);
+                printEntry(&log_entry[i]);
+        }
+        if (dropped) {
+                fprintf(stderr, "%d more messages at other sites\n", dropped);
+        }
+#endif
+}
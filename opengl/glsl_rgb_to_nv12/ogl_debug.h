@@ -0,0 +1,42 @@
+#ifndef __OGL_DEBUG__H__
+#define __OGL_DEBUG__H__
+
+/*****************************************************************************
+ * KHR_debug reporting
+ *
+ * With debug output on, the driver calls back with its errors and warnings.
+ * oglDebugInit() turns it on for the current context, so every context a
+ * thread makes GL calls on needs its own call. Each message is printed the
+ * first time it comes up at a call site, repeats are counted, and the log
+ * is printed with the counts at exit.
+ *
+ * The call site is the last ogl() the reporting thread made, which only
+ * OGL_RELEASE builds note, see opengl_utils.h. Since ogl_site is per
+ * thread, it is only filled in when the driver calls back on the thread
+ * that made the GL call. Synchronous output guarantees that, but release
+ * builds leave the output asynchronous to keep the driver from
+ * serializing, so a driver may call back late, from any thread. Messages
+ * it reports from its own threads have no site. The site of one reported
+ * on the calling thread is the failing call or one shortly after it.
+ * Strict builds have glGetError() name the call and make the output
+ * synchronous, so the driver's message comes right before ogl() exits.
+ ****************************************************************************/
+struct OglSite {
+        const char *func;
+        int line;
+};
+
+/*
+ * the last ogl() call of the thread, NULL func in strict builds and on
+ * threads that never made one, such as the driver's
+ */
+extern thread_local OglSite ogl_site;
+
+/* false without KHR_debug, release builds then report no errors at all */
+bool oglDebugInit(void);
+/* GL_DEBUG_TYPE_ERROR messages so far, repeats included */
+int oglDebugErrors(void);
+/* every message with its site, severity and count to stderr, if any */
+void oglDebugPrintLog(void);
+
+#endif //__OGL_DEBUG__H__
@@ -0,0 +1,140 @@
+#ifndef __OPENGL_UTILS__H__
+#define __OPENGL_UTILS__H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include "ogl_debug.h"
+
+/*****************************************************************************
+ * OpenGL Helpers
+ *
+ * ogl(x) checks glGetError() after x and exits at the first error. The
+ * check can be a round trip to the driver on every call, so OGL_RELEASE
+ * builds (make OGL=release) only note the call site for the KHR_debug
+ * callback, see ogl_debug.h.
+ ****************************************************************************/
+#ifndef OGL_RELEASE
+#define ogl(x) do { \
+        x; \
+        int _err = glGetError(); \
+        if (_err) { \
+                printf("GL Error %d at %d, %s\n", _err, __LINE__, __func__); \
+                exit (-1); \
+        } \
+} while (0)
+#else
+#define ogl(x) do { \
+        ogl_site.func = __func__; \
+        ogl_site.line = __LINE__; \
+        x; \
+} while (0)
+#endif
+
+static inline void oglProgramLog(int pid)
+{
+        GLint logLen;
+        GLsizei realLen;
+
+        glGetProgramiv(pid, GL_INFO_LOG_LENGTH, &logLen);
+        if (!logLen) {
+                return;
+        }
+        char *log = (char *)malloc(logLen);
+        if (!log) {
+                perror("malloc");
+                return;
+        }
+        glGetProgramInfoLog(pid, logLen, &realLen, log);
+        if (realLen) {
+                printf("program %d log %s\n", pid, log);
+        }
+        free(log);
+}
+
+static inline void oglShaderLog(int sid) {
+        GLint logLen;
+        GLsizei realLen;
+
+        glGetShaderiv(sid, GL_INFO_LOG_LENGTH, &logLen);
+        if (!logLen) {
+                return;
+        }
+        char *log = (char *)malloc(logLen);
+        if (!log) {
+                perror("malloc");
+                return;
+        }
+        glGetShaderInfoLog(sid, logLen, &realLen, log);
+        if (realLen) {
+                printf("shader %d log %s\n", sid, log);
+        }
+        free(log);
+}
+
+static inline double nowSeconds(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* the largest square texture the context can render into */
+static inline int oglMaxRenderSize(void) {
+        GLint texture = 0, renderbuffer = 0, viewport[2] = { 0, 0 };
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &texture);
+        glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &renderbuffer);
+        glGetIntegerv(GL_MAX_VIEWPORT_DIMS, viewport);
+        int size = texture < renderbuffer ? texture : renderbuffer;
+        size = viewport[0] < size ? viewport[0] : size;
+        return viewport[1] < size ? viewport[1] : size;
+}
+
+/*
+ * Expresses a row pitch in bytes as pixel store state: a row length when
+ * it is a whole number of pixels, otherwise the alignment that pads
+ * width * bpp up to it. Returns false if neither can.
+ */
+static inline bool oglRowStrideParams(int width, int bpp, size_t stride,
+        GLint *row_length, GLint *alignment)
+{
+        size_t row_size = (size_t)width * bpp;
+        *row_length = 0;
+        *alignment = 1;
+        if (stride == row_size) {
+                return true;
+        }
+        if (stride > row_size && stride % bpp == 0) {
+                *row_length = stride / bpp;
+                return true;
+        }
+        for (GLint a = 2; a <= 8; a *= 2) {
+                if (stride == (row_size + a - 1) / a * a) {
+                        *alignment = a;
+                        return true;
+                }
+        }
+        return false;
+}
+
+/* row_length_pname/alignment_pname pick the pack or the unpack state */
+static inline void oglSetRowStride(GLenum row_length_pname,
+        GLenum alignment_pname, int width, int bpp, size_t stride)
+{
+        GLint row_length, alignment;
+        if (!oglRowStrideParams(width, bpp, stride, &row_length, &alignment)) {
+                printf("stride %zu does not fit %d pixels of %d bytes\n",
+                        stride, width, bpp);
+                exit(-1);
+        }
+        ogl(glPixelStorei(row_length_pname, row_length));
+        ogl(glPixelStorei(alignment_pname, alignment));
+}
+
+#endif //__OPENGL_UTILS__H__
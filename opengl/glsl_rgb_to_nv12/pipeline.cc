@@ -0,0 +1,301 @@
+#include "opengl_utils.h"
+#include "pipeline.h"
+
+/*****************************************************************************
+ * Queues
+ ****************************************************************************/
+static void queueInit(PipelineQueue *queue) {
+        queue->head = 0;
+        queue->tail = 0;
+}
+
+/* the producer side, a queue never holds more than the pipeline depth */
+static void queuePush(PipelineQueue *queue, PipelineFrame frame) {
+        unsigned tail = queue->tail.load(std::memory_order_relaxed);
+        queue->item[tail % PIPELINE_MAX_DEPTH] = frame;
+        queue->tail.store(tail + 1, std::memory_order_release);
+}
+
+static bool queuePop(PipelineQueue *queue, PipelineFrame *frame) {
+        unsigned head = queue->head.load(std::memory_order_relaxed);
+        if (head == queue->tail.load(std::memory_order_acquire)) {
+                return false;
+        }
+        *frame = queue->item[head % PIPELINE_MAX_DEPTH];
+        queue->head.store(head + 1, std::memory_order_release);
+        return true;
+}
+
+/*
+ * Spins until a frame arrives, the time goes to the stage's wait. Returns
+ * false when another stage failed instead.
+ */
+static bool queueWait(Pipeline *pipe, PipelineQueue *queue,
+        PipelineStage *stage, PipelineFrame *frame)
+{
+        double start = nowSeconds();
+        bool ok = true;
+        while (!queuePop(queue, frame)) {
+                if (pipe->failed) {
+                        ok = false;
+                        break;
+                }
+                std::this_thread::yield();
+        }
+        stage->wait += nowSeconds() - start;
+        return ok;
+}
+
+static void deleteFence(GLsync fence) {
+        if (fence) {
+                ogl(glDeleteSync(fence));
+        }
+}
+
+/*****************************************************************************
+ * Upload and writer threads
+ ****************************************************************************/
+static void uploadThread(Pipeline *pipe) {
+        PipelineStage *stage = &pipe->stage[PIPELINE_UPLOAD];
+        /* mapped input is uploaded in place */
+        bool mapped = frameReaderMapped(pipe->reader);
+        void *rgb = mapped ? NULL : malloc(pipe->reader->frame_size);
+        if ((!mapped && !rgb) || !contextMakeCurrent(&pipe->upload_ctx)) {
+                puts("pipeline upload thread failed to start");
+                pipe->failed = true;
+                free(rgb);
+                queuePush(&pipe->filled, PipelineFrame{ -1, 0 });
+                return;
+        }
+        /* debug output and pixel store state are per context */
+        oglDebugInit();
+        oglSetRowStride(GL_UNPACK_ROW_LENGTH, GL_UNPACK_ALIGNMENT,
+                pipe->width, 3, pipe->reader->stride);
+
+        PipelineFrame frame;
+        while (!pipe->failed && queueWait(pipe, &pipe->used, stage, &frame)) {
+                double start = nowSeconds();
+                const void *data = rgb;
+                if (mapped) {
+                        data = frameReaderNextMapped(pipe->reader);
+                }
+                else if (!frameReaderNext(pipe->reader, rgb)) {
+                        data = NULL;
+                }
+                if (!data) {
+                        deleteFence(frame.fence);
+                        break;
+                }
+
+                /* the last render sampling this texture must be done */
+                if (frame.fence) {
+                        ogl(glWaitSync(frame.fence, 0, GL_TIMEOUT_IGNORED));
+                        ogl(glDeleteSync(frame.fence));
+                }
+                ogl(glBindTexture(GL_TEXTURE_2D, pipe->texture[frame.slot]));
+                ogl(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+                        pipe->width, pipe->height,
+                        GL_RGB, GL_UNSIGNED_BYTE, data));
+                ogl(glBindTexture(GL_TEXTURE_2D, 0));
+                ogl(frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,
+                        0));
+                /* other contexts can only wait on flushed fences */
+                ogl(glFlush());
+
+                stage->busy += nowSeconds() - start;
+                stage->frames++;
+                queuePush(&pipe->filled, frame);
+        }
+        queuePush(&pipe->filled, PipelineFrame{ -1, 0 });
+
+        free(rgb);
+        contextReleaseCurrent(&pipe->upload_ctx);
+}
+
+static void writerThread(Pipeline *pipe) {
+        PipelineStage *stage = &pipe->stage[PIPELINE_WRITE];
+        if (!contextMakeCurrent(&pipe->writer_ctx)) {
+                puts("pipeline writer thread failed to start");
+                pipe->failed = true;
+                return;
+        }
+        oglDebugInit();
+
+        double start = nowSeconds();
+        for (;;) {
+                /* render_done is read first, so an empty ring stays empty */
+                bool done = pipe->render_done;
+                if (readbackRingEmpty(pipe->ring)) {
+                        if (done) {
+                                break;
+                        }
+                        std::this_thread::yield();
+                        continue;
+                }
+                double now = nowSeconds();
+                stage->wait += now - start;
+                start = now;
+
+                /* after a failed write the ring is still drained */
+                const void *data = readbackRingMapOldest(pipe->ring);
+                if (!pipe->failed && !frameWriterWrite(pipe->writer, data,
+                        pipe->out_size))
+                {
+                        pipe->failed = true;
+                }
+                readbackRingReleaseOldest(pipe->ring);
+
+                now = nowSeconds();
+                stage->busy += now - start;
+                stage->frames++;
+                start = now;
+        }
+        contextReleaseCurrent(&pipe->writer_ctx);
+}
+
+/*****************************************************************************
+ * Pipeline
+ ****************************************************************************/
+bool pipelineInit(Pipeline *pipe, GlContext *main, int depth,
+        int width, int height)
+{
+        if (depth < 2) {
+                depth = 2;
+        }
+        if (depth > PIPELINE_MAX_DEPTH) {
+                depth = PIPELINE_MAX_DEPTH;
+        }
+        pipe->depth = depth;
+        pipe->width = width;
+        pipe->height = height;
+
+        if (!contextCreateShared(&pipe->upload_ctx, main)) {
+                return false;
+        }
+        if (!contextCreateShared(&pipe->writer_ctx, main)) {
+                contextDestroy(&pipe->upload_ctx);
+                return false;
+        }
+
+        ogl(glGenTextures(depth, pipe->texture));
+        for (int i = 0; i < depth; i++) {
+                ogl(glBindTexture(GL_TEXTURE_2D, pipe->texture[i]));
+                ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                        GL_NEAREST));
+                ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                        GL_NEAREST));
+                ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
+                        GL_CLAMP_TO_EDGE));
+                ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
+                        GL_CLAMP_TO_EDGE));
+                if (GLEW_ARB_texture_storage) {
+                        ogl(glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGB8,
+                                width, height));
+                }
+                else {
+                        ogl(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8,
+                                width, height, 0, GL_RGB,
+                                GL_UNSIGNED_BYTE, NULL));
+                }
+        }
+        ogl(glBindTexture(GL_TEXTURE_2D, 0));
+        /* the other contexts must see complete textures */
+        ogl(glFinish());
+        return true;
+}
+
+void pipelineDestroy(Pipeline *pipe) {
+        ogl(glDeleteTextures(pipe->depth, pipe->texture));
+        contextDestroy(&pipe->writer_ctx);
+        contextDestroy(&pipe->upload_ctx);
+}
+
+int pipelineRun(Pipeline *pipe, FrameReader *reader, FrameWriter *writer,
+        size_t out_size, ReadbackRing *ring, PipelineRenderFunc render)
+{
+        PipelineStage *stage = &pipe->stage[PIPELINE_RENDER];
+
+        pipe->reader = reader;
+        pipe->writer = writer;
+        pipe->out_size = out_size;
+        pipe->ring = ring;
+        pipe->render_done = false;
+        pipe->failed = false;
+        for (int s = 0; s < PIPELINE_STAGE_COUNT; s++) {
+                pipe->stage[s] = PipelineStage{ 0.0, 0.0, 0 };
+        }
+        queueInit(&pipe->filled);
+        queueInit(&pipe->used);
+        for (int i = 0; i < pipe->depth; i++) {
+                queuePush(&pipe->used, PipelineFrame{ i, 0 });
+        }
+
+        double start = nowSeconds();
+        pipe->upload_thread = std::thread(uploadThread, pipe);
+        pipe->writer_thread = std::thread(writerThread, pipe);
+
+        PipelineFrame frame;
+        while (queueWait(pipe, &pipe->filled, stage, &frame)) {
+                if (frame.slot < 0) {
+                        break;
+                }
+
+                /* a writer that failed to start never drains the ring */
+                double wait_start = nowSeconds();
+                while (readbackRingFull(ring) && !pipe->failed) {
+                        std::this_thread::yield();
+                }
+                if (pipe->failed) {
+                        ogl(glDeleteSync(frame.fence));
+                        break;
+                }
+                double busy_start = nowSeconds();
+                stage->wait += busy_start - wait_start;
+
+                ogl(glWaitSync(frame.fence, 0, GL_TIMEOUT_IGNORED));
+                ogl(glDeleteSync(frame.fence));
+                render(pipe->texture[frame.slot]);
+                ogl(frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,
+                        0));
+                /* flushes the readback fence to the writer as well */
+                ogl(glFlush());
+                queuePush(&pipe->used, frame);
+
+                stage->busy += nowSeconds() - busy_start;
+                stage->frames++;
+        }
+        pipe->render_done = true;
+
+        pipe->upload_thread.join();
+        pipe->writer_thread.join();
+        pipe->elapsed = nowSeconds() - start;
+
+        /* fences of frames still queued when the pipeline stopped */
+        while (queuePop(&pipe->used, &frame)) {
+                deleteFence(frame.fence);
+        }
+        while (queuePop(&pipe->filled, &frame)) {
+                deleteFence(frame.fence);
+        }
+        return pipe->failed ? -1 : pipe->stage[PIPELINE_RENDER].frames;
+}
+
+void pipelinePrintStats(const Pipeline *pipe) {
+        static const char *names[PIPELINE_STAGE_COUNT] = {
+                "upload",
+                "render",
+                "write",
+        };
+
+        fprintf(stderr, "pipeline depth %d, stage occupancy:\n", pipe->depth);
+        for (int s = 0; s < PIPELINE_STAGE_COUNT; s++) {
+                const PipelineStage *stage = &pipe->stage[s];
+                double elapsed = pipe->elapsed > 0 ? pipe->elapsed : 1.0;
+                fprintf(stderr, "  %-6s busy %5.1f%%, waiting %5.1f%%, "
+                        "%.3f ms/frame over %d frames\n", names[s],
+                        stage->busy * 100.0 / elapsed,
+                        stage->wait * 100.0 / elapsed,
+                        stage->frames ? stage->busy * 1e3 / stage->frames
+                        : 0.0, stage->frames);
+        }
+}
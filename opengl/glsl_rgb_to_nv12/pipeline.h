@@ -0,0 +1,108 @@
+#ifndef __PIPELINE__H__
+#define __PIPELINE__H__
+
+#include <stddef.h>
+
+#include <atomic>
+#include <thread>
+
+#include <GL/glew.h>
+
+#include "context.h"
+#include "frame_io.h"
+#include "readback.h"
+
+/*****************************************************************************
+ * Three-stage conversion pipeline
+ *
+ * An upload thread reads frames and uploads them into a pool of input
+ * textures, the render thread converts them and queues their readback, and
+ * a writer thread maps the readbacks and writes them out. The upload and
+ * writer threads own contexts sharing objects with the render context.
+ *
+ * Frames move through single producer, single consumer queues without
+ * locks. Each hand-over carries a fence: the render thread glWaitSync()s on
+ * the upload fence, the upload thread on the fence of the last render that
+ * sampled a texture before replacing it. Readbacks go through the
+ * ReadbackRing, whose fences the writer waits on.
+ ****************************************************************************/
+enum {
+        PIPELINE_MAX_DEPTH = 16,
+};
+
+struct PipelineFrame {
+        /* input texture index, -1 marks the end of the stream */
+        int slot;
+        GLsync fence;
+};
+
+/* bounded, lock-free, one producer and one consumer thread */
+struct PipelineQueue {
+        PipelineFrame item[PIPELINE_MAX_DEPTH];
+        std::atomic<unsigned> head;
+        std::atomic<unsigned> tail;
+};
+
+enum PipelineStageId {
+        PIPELINE_UPLOAD,
+        PIPELINE_RENDER,
+        PIPELINE_WRITE,
+        PIPELINE_STAGE_COUNT,
+};
+
+struct PipelineStage {
+        /* seconds working and seconds blocked on a queue */
+        double busy;
+        double wait;
+        int frames;
+};
+
+/* converts the frame in texture and queues its readback */
+typedef void (*PipelineRenderFunc)(GLuint texture);
+
+struct Pipeline {
+        GlContext upload_ctx;
+        GlContext writer_ctx;
+        GLuint texture[PIPELINE_MAX_DEPTH];
+        int depth;
+        int width;
+        int height;
+        size_t out_size;
+
+        /* upload -> render with filled slots, render -> upload with used */
+        PipelineQueue filled;
+        PipelineQueue used;
+        ReadbackRing *ring;
+        std::atomic<bool> render_done;
+        std::atomic<bool> failed;
+
+        FrameReader *reader;
+        FrameWriter *writer;
+        std::thread upload_thread;
+        std::thread writer_thread;
+
+        PipelineStage stage[PIPELINE_STAGE_COUNT];
+        double elapsed;
+};
+
+/*
+ * Creates the shared contexts and depth input textures of width x height.
+ * Must be called with the render context, main, current.
+ */
+bool pipelineInit(Pipeline *pipe, GlContext *main, int depth,
+        int width, int height);
+void pipelineDestroy(Pipeline *pipe);
+
+/*
+ * Streams every frame of reader through render into writer, out_size bytes
+ * a frame, and returns the number of frames or -1 when a stage failed.
+ * render runs on the calling thread and must read back into ring, which
+ * has to be empty.
+ */
+int pipelineRun(Pipeline *pipe, FrameReader *reader, FrameWriter *writer,
+        size_t out_size, ReadbackRing *ring, PipelineRenderFunc render);
+
+/* busy share of the wall time per stage, the bottleneck is close to 100% */
+void pipelinePrintStats(const Pipeline *pipe);
+
+#endif //__PIPELINE__H__
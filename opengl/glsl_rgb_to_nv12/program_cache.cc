@@ -0,0 +1,370 @@
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "opengl_utils.h"
+#include "program_cache.h"
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+/* bumped whenever the file layout changes */
+static const uint32_t BinaryMagic = 0x31424750; /* "PGB1" */
+
+struct BinaryHeader {
+        uint32_t magic;
+        uint32_t format;
+        uint64_t key;
+        uint64_t length;
+};
+
+/*****************************************************************************
+ * Keys
+ ****************************************************************************/
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+        const uint8_t *p = (const uint8_t*)data;
+        for (size_t i = 0; i < size; i++) {
+                hash ^= p[i];
+                hash *= 0x100000001b3ull;
+        }
+        return hash;
+}
+
+/* strings keep their terminator, so "ab" "c" differs from "a" "bc" */
+static uint64_t hashString(uint64_t hash, const char *str) {
+        if (!str) {
+                return hashBytes(hash, "", 1);
+        }
+        return hashBytes(hash, str, strlen(str) + 1);
+}
+
+static uint64_t hashDesc(const ProgramCache *cache, const ProgramDesc *desc) {
+        uint64_t hash = cache->driver;
+        for (int s = 0; s < desc->num_stages; s++) {
+                hash = hashBytes(hash, &desc->type[s], sizeof(desc->type[s]));
+                for (int i = 0; i < desc->num_sources[s]; i++) {
+                        hash = hashString(hash, desc->source[s][i]);
+                }
+        }
+        hash = hashString(hash, desc->defines);
+        for (int i = 0; i < PROGRAM_MAX_ATTRIBS; i++) {
+                hash = hashString(hash, desc->attrib[i]);
+        }
+        return hashString(hash, desc->frag_out);
+}
+
+void programDescInit(ProgramDesc *desc) {
+        memset(desc, 0, sizeof(*desc));
+}
+
+void programDescAddStage(ProgramDesc *desc, GLenum type, int count,
+        const char *const *source)
+{
+        if (desc->num_stages == PROGRAM_MAX_STAGES
+                || count > PROGRAM_MAX_SOURCES)
+        {
+                puts("too many program stages or sources");
+                exit(-1);
+        }
+        int s = desc->num_stages++;
+        desc->type[s] = type;
+        desc->num_sources[s] = count;
+        for (int i = 0; i < count; i++) {
+                desc->source[s][i] = source[i];
+        }
+}
+
+/*****************************************************************************
+ * Binaries on disk
+ ****************************************************************************/
+const char *programCacheDefaultDir(void) {
+        static char path[1024];
+        const char *xdg = getenv("XDG_CACHE_HOME");
+        const char *home = getenv("HOME");
+        if (xdg && xdg[0]) {
+                snprintf(path, sizeof(path), "%s/glsl-programs", xdg);
+        }
+        else if (home && home[0]) {
+                snprintf(path, sizeof(path), "%s/.cache/glsl-programs", home);
+        }
+        else {
+                return NULL;
+        }
+        return path;
+}
+
+/* mkdir -p */
+static bool makeDirs(const std::string &dir) {
+        for (size_t i = 1; i <= dir.size(); i++) {
+                if (i < dir.size() && dir[i] != '/') {
+                        continue;
+                }
+                std::string part = dir.substr(0, i);
+                if (mkdir(part.c_str(), 0755) && errno != EEXIST) {
+                        perror(part.c_str());
+                        return false;
+                }
+        }
+        return true;
+}
+
+static std::string binaryPath(const ProgramCache *cache, uint64_t key) {
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)key);
+        return cache->dir + name;
+}
+
+/* returns 0 when there is no usable binary for key */
+static GLuint loadBinary(ProgramCache *cache, uint64_t key) {
+        std::string path = binaryPath(cache, key);
+        FILE *file = fopen(path.c_str(), "rb");
+        if (!file) {
+                return 0;
+        }
+
+        BinaryHeader header;
+        std::vector<char> data;
+        bool ok = (1 == fread(&header, sizeof(header), 1, file))
+                && header.magic == BinaryMagic && header.key == key
+                && header.length > 0 && header.length < (1u << 30);
+        if (ok) {
+                data.resize(header.length);
+                ok = (1 == fread(&data[0], data.size(), 1, file));
+        }
+        fclose(file);
+
+        GLuint program = 0;
+        GLint status = 0;
+        if (ok) {
+                ogl(program = glCreateProgram());
+                /* a driver update may reject it, that is not an error */
+                glProgramBinary(program, header.format, &data[0],
+                        data.size());
+                glGetError();
+                ogl(glGetProgramiv(program, GL_LINK_STATUS, &status));
+        }
+        if (!status) {
+                if (program) {
+                        ogl(glDeleteProgram(program));
+                }
+                unlink(path.c_str());
+                return 0;
+        }
+        return program;
+}
+
+/* written next to the final name and renamed, so readers never see half */
+static void storeBinary(ProgramCache *cache, const ProgramCacheEntry *entry) {
+        GLint length = 0;
+        ogl(glGetProgramiv(entry->program, GL_PROGRAM_BINARY_LENGTH, &length));
+        if (length <= 0) {
+                return;
+        }
+        std::vector<char> data(length);
+        BinaryHeader header = { BinaryMagic, 0, entry->key, 0 };
+        GLsizei written = 0;
+        ogl(glGetProgramBinary(entry->program, length, &written,
+                &header.format, &data[0]));
+        header.length = written;
+
+        std::string path = binaryPath(cache, entry->key);
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".%d", (int)getpid());
+        std::string tmp = path + suffix;
+        FILE *file = fopen(tmp.c_str(), "wb");
+        if (!file) {
+                return;
+        }
+        bool ok = (1 == fwrite(&header, sizeof(header), 1, file))
+                && (1 == fwrite(&data[0], written, 1, file));
+        ok = !fclose(file) && ok;
+        if (ok && !rename(tmp.c_str(), path.c_str())) {
+                cache->stores++;
+        }
+        else {
+                unlink(tmp.c_str());
+        }
+}
+
+/*****************************************************************************
+ * Cache
+ ****************************************************************************/
+void programCacheInit(ProgramCache *cache, const char *dir) {
+        cache->entries.clear();
+        cache->dir.clear();
+        cache->memory_hits = 0;
+        cache->disk_hits = 0;
+        cache->compiles = 0;
+        cache->stores = 0;
+        cache->load_time = 0.0;
+        cache->compile_time = 0.0;
+
+        uint64_t driver = 0xcbf29ce484222325ull;
+        driver = hashString(driver, (const char*)glGetString(GL_VENDOR));
+        driver = hashString(driver, (const char*)glGetString(GL_RENDERER));
+        driver = hashString(driver, (const char*)glGetString(GL_VERSION));
+        cache->driver = driver;
+
+        GLint formats = 0;
+        ogl(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats));
+        if (dir && formats > 0 && makeDirs(dir)) {
+                cache->dir = dir;
+        }
+
+        cache->parallel = false;
+#ifdef GLEW_KHR_parallel_shader_compile
+        if (GLEW_KHR_parallel_shader_compile) {
+                ogl(glMaxShaderCompilerThreadsKHR(0xffffffff));
+                cache->parallel = true;
+        }
+#endif
+#ifdef GLEW_ARB_parallel_shader_compile
+        if (!cache->parallel && GLEW_ARB_parallel_shader_compile) {
+                ogl(glMaxShaderCompilerThreadsARB(0xffffffff));
+                cache->parallel = true;
+        }
+#endif
+}
+
+void programCacheDestroy(ProgramCache *cache) {
+        programCacheFinish(cache);
+        for (size_t i = 0; i < cache->entries.size(); i++) {
+                ogl(glDeleteProgram(cache->entries[i].program));
+        }
+        cache->entries.clear();
+}
+
+/* the #version line has to stay first, the defines go right after it */
+static GLuint compileStage(const ProgramDesc *desc, int s) {
+        const char *source[PROGRAM_MAX_SOURCES + 2];
+        GLint length[PROGRAM_MAX_SOURCES + 2];
+        int count = 0;
+        for (int i = 0; i < desc->num_sources[s]; i++) {
+                const char *src = desc->source[s][i];
+                const char *eol = strchr(src, '\n');
+                if (i == 0 && desc->defines && eol
+                        && !strncmp(src, "#version", 8))
+                {
+                        source[count] = src;
+                        length[count++] = eol + 1 - src;
+                        source[count] = desc->defines;
+                        length[count++] = -1;
+                        src = eol + 1;
+                }
+                source[count] = src;
+                length[count++] = -1;
+        }
+
+        GLuint shader;
+        ogl(shader = glCreateShader(desc->type[s]));
+        ogl(glShaderSource(shader, count, source, length));
+        ogl(glCompileShader(shader));
+        return shader;
+}
+
+static void compileProgram(ProgramCache *cache, const ProgramDesc *desc,
+        ProgramCacheEntry *entry)
+{
+        ogl(entry->program = glCreateProgram());
+        for (int s = 0; s < desc->num_stages; s++) {
+                entry->shader[s] = compileStage(desc, s);
+                ogl(glAttachShader(entry->program, entry->shader[s]));
+        }
+        for (int i = 0; i < PROGRAM_MAX_ATTRIBS; i++) {
+                if (desc->attrib[i]) {
+                        ogl(glBindAttribLocation(entry->program, i,
+                                desc->attrib[i]));
+                }
+        }
+        if (desc->frag_out) {
+                ogl(glBindFragDataLocation(entry->program, 0,
+                        desc->frag_out));
+        }
+        if (!cache->dir.empty()) {
+                ogl(glProgramParameteri(entry->program,
+                        GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+        }
+        ogl(glLinkProgram(entry->program));
+        entry->pending = true;
+}
+
+static void finishEntry(ProgramCache *cache, ProgramCacheEntry *entry) {
+        /* querying the logs waits for the compiler threads */
+        for (int s = 0; s < PROGRAM_MAX_STAGES && entry->shader[s]; s++) {
+                oglShaderLog(entry->shader[s]);
+                ogl(glDetachShader(entry->program, entry->shader[s]));
+                ogl(glDeleteShader(entry->shader[s]));
+                entry->shader[s] = 0;
+        }
+        oglProgramLog(entry->program);
+        entry->pending = false;
+        if (!cache->dir.empty() && programCacheLinked(entry->program)) {
+                storeBinary(cache, entry);
+        }
+}
+
+GLuint programCacheRequest(ProgramCache *cache, const ProgramDesc *desc) {
+        uint64_t key = hashDesc(cache, desc);
+        for (size_t i = 0; i < cache->entries.size(); i++) {
+                if (cache->entries[i].key == key) {
+                        cache->memory_hits++;
+                        return cache->entries[i].program;
+                }
+        }
+
+        ProgramCacheEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.key = key;
+
+        double start = nowSeconds();
+        if (!cache->dir.empty()) {
+                entry.program = loadBinary(cache, key);
+        }
+        if (entry.program) {
+                cache->disk_hits++;
+                cache->load_time += nowSeconds() - start;
+        }
+        else {
+                compileProgram(cache, desc, &entry);
+                if (!cache->parallel) {
+                        finishEntry(cache, &entry);
+                }
+                cache->compiles++;
+                cache->compile_time += nowSeconds() - start;
+        }
+        cache->entries.push_back(entry);
+        return entry.program;
+}
+
+void programCacheFinish(ProgramCache *cache) {
+        double start = nowSeconds();
+        bool waited = false;
+        for (size_t i = 0; i < cache->entries.size(); i++) {
+                if (cache->entries[i].pending) {
+                        finishEntry(cache, &cache->entries[i]);
+                        waited = true;
+                }
+        }
+        if (waited) {
+                cache->compile_time += nowSeconds() - start;
+        }
+}
+
+bool programCacheLinked(GLuint program) {
+        GLint status = 0;
+        ogl(glGetProgramiv(program, GL_LINK_STATUS, &status));
+        return status;
+}
+
+void programCachePrintStats(const ProgramCache *cache) {
+        bool warm = cache->compiles == 0;
+        fprintf(stderr, "program cache (%s start): %d compiled in %.1f ms%s, "
+                "%d loaded in %.1f ms, %d stored, %d memory hits\n",
+                warm ? "warm" : "cold", cache->compiles,
+                cache->compile_time * 1e3,
+                cache->parallel ? " in parallel" : "",
+                cache->disk_hits, cache->load_time * 1e3, cache->stores,
+                cache->memory_hits);
+}
@@ -0,0 +1,91 @@
+#ifndef __PROGRAM_CACHE__H__
+#define __PROGRAM_CACHE__H__
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+/*****************************************************************************
+ * Program cache
+ *
+ * Linked programs are kept by a hash of their sources, defines, pre-link
+ * bindings and the driver, so asking twice for the same program returns
+ * the same object. With a directory the program binaries are stored there
+ * as well and loaded on the next run instead of compiling.
+ *
+ * With KHR_parallel_shader_compile a request only starts compiling, and
+ * programCacheFinish() collects every pending program. Without it requests
+ * complete right away. Programs belong to the cache, callers must not
+ * delete them.
+ ****************************************************************************/
+enum {
+        PROGRAM_MAX_STAGES = 2,
+        PROGRAM_MAX_SOURCES = 4,
+        PROGRAM_MAX_ATTRIBS = 4,
+};
+
+struct ProgramDesc {
+        int num_stages;
+        GLenum type[PROGRAM_MAX_STAGES];
+        int num_sources[PROGRAM_MAX_STAGES];
+        const char *source[PROGRAM_MAX_STAGES][PROGRAM_MAX_SOURCES];
+        /* '\n' terminated lines put after each stage's #version, or NULL */
+        const char *defines;
+        /* attrib[i] is bound to location i, NULL entries are skipped */
+        const char *attrib[PROGRAM_MAX_ATTRIBS];
+        const char *frag_out;
+};
+
+struct ProgramCacheEntry {
+        uint64_t key;
+        GLuint program;
+        GLuint shader[PROGRAM_MAX_STAGES];
+        bool pending;
+};
+
+struct ProgramCache {
+        std::vector<ProgramCacheEntry> entries;
+        /* empty when binaries are not stored */
+        std::string dir;
+        uint64_t driver;
+        bool parallel;
+
+        int memory_hits;
+        int disk_hits;
+        int compiles;
+        int stores;
+        double load_time;
+        double compile_time;
+};
+
+void programDescInit(ProgramDesc *desc);
+void programDescAddStage(ProgramDesc *desc, GLenum type, int count,
+        const char *const *source);
+
+/*
+ * $XDG_CACHE_HOME/glsl-programs or ~/.cache/glsl-programs, NULL without
+ * either variable. The string is static.
+ */
+const char *programCacheDefaultDir(void);
+
+/* needs a current context, dir NULL keeps programs in memory only */
+void programCacheInit(ProgramCache *cache, const char *dir);
+void programCacheDestroy(ProgramCache *cache);
+
+/* the program may still be compiling, see programCacheFinish() */
+GLuint programCacheRequest(ProgramCache *cache, const ProgramDesc *desc);
+/* waits for every pending program, prints its logs and stores its binary */
+void programCacheFinish(ProgramCache *cache);
+bool programCacheLinked(GLuint program);
+
+/* warm when every program came from memory or disk */
+void programCachePrintStats(const ProgramCache *cache);
+
+#endif //__PROGRAM_CACHE__H__
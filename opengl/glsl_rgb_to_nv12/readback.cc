@@ -0,0 +1,144 @@
+#include "opengl_utils.h"
+#include "readback.h"
+
+void readbackRingInit(ReadbackRing *ring, int depth, size_t size) {
+        if (depth < 1) {
+                depth = 1;
+        }
+        if (depth > READBACK_MAX_DEPTH) {
+                depth = READBACK_MAX_DEPTH;
+        }
+
+        ring->depth = depth;
+        ring->queued = 0;
+        ring->released = 0;
+        ring->size = size;
+        ring->wait_total = 0.0;
+        ring->wait_max = 0.0;
+        ring->waits = 0;
+        ring->stalls = 0;
+
+        ogl(glGenBuffers(depth, ring->pbo));
+        for (int i = 0; i < depth; i++) {
+                ring->fence[i] = 0;
+                ogl(glBindBuffer(GL_PIXEL_PACK_BUFFER, ring->pbo[i]));
+                ogl(glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL,
+                        GL_STREAM_READ));
+        }
+        ogl(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+}
+
+void readbackRingDestroy(ReadbackRing *ring) {
+        for (int i = 0; i < ring->depth; i++) {
+                if (ring->fence[i]) {
+                        ogl(glDeleteSync(ring->fence[i]));
+                        ring->fence[i] = 0;
+                }
+        }
+        ogl(glDeleteBuffers(ring->depth, ring->pbo));
+        ring->queued = 0;
+        ring->released = 0;
+}
+
+void readbackRingRead(ReadbackRing *ring, size_t offset, GLint x, GLint y,
+        GLsizei width, GLsizei height, GLenum format, GLenum type)
+{
+        if (readbackRingFull(ring)) {
+                puts("readback ring overflow");
+                exit(-1);
+        }
+
+        int slot = ring->queued % ring->depth;
+        ogl(glBindBuffer(GL_PIXEL_PACK_BUFFER, ring->pbo[slot]));
+        ogl(glReadPixels(x, y, width, height, format, type,
+                (GLvoid *)offset));
+        ogl(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+}
+
+void readbackRingCopy(ReadbackRing *ring, size_t offset, GLuint buffer,
+        size_t src_offset, size_t size)
+{
+        if (readbackRingFull(ring)) {
+                puts("readback ring overflow");
+                exit(-1);
+        }
+
+        int slot = ring->queued % ring->depth;
+        ogl(glBindBuffer(GL_COPY_READ_BUFFER, buffer));
+        ogl(glBindBuffer(GL_COPY_WRITE_BUFFER, ring->pbo[slot]));
+        ogl(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                src_offset, offset, size));
+        ogl(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+        ogl(glBindBuffer(GL_COPY_READ_BUFFER, 0));
+}
+
+void readbackRingCommit(ReadbackRing *ring) {
+        int slot = ring->queued % ring->depth;
+        ogl(ring->fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        ring->queued++;
+}
+
+void readbackRingQueue(ReadbackRing *ring, GLint x, GLint y,
+        GLsizei width, GLsizei height, GLenum format, GLenum type)
+{
+        readbackRingRead(ring, 0, x, y, width, height, format, type);
+        readbackRingCommit(ring);
+}
+
+const void *readbackRingMapOldest(ReadbackRing *ring) {
+        if (readbackRingEmpty(ring)) {
+                return NULL;
+        }
+
+        int slot = ring->released % ring->depth;
+        double start = nowSeconds();
+        GLenum status;
+        bool stalled = false;
+        do {
+                ogl(status = glClientWaitSync(ring->fence[slot],
+                        GL_SYNC_FLUSH_COMMANDS_BIT, 1000000));
+                if (status == GL_WAIT_FAILED) {
+                        puts("glClientWaitSync failed");
+                        exit(-1);
+                }
+                if (status != GL_ALREADY_SIGNALED) {
+                        stalled = true;
+                }
+        } while (status == GL_TIMEOUT_EXPIRED);
+        double waited = nowSeconds() - start;
+
+        ring->wait_total += waited;
+        if (waited > ring->wait_max) {
+                ring->wait_max = waited;
+        }
+        ring->waits++;
+        if (stalled) {
+                ring->stalls++;
+        }
+
+        ogl(glDeleteSync(ring->fence[slot]));
+        ring->fence[slot] = 0;
+
+        void *data;
+        ogl(glBindBuffer(GL_PIXEL_PACK_BUFFER, ring->pbo[slot]));
+        ogl(data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, ring->size,
+                GL_MAP_READ_BIT));
+        ogl(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+        return data;
+}
+
+void readbackRingReleaseOldest(ReadbackRing *ring) {
+        int slot = ring->released % ring->depth;
+        ogl(glBindBuffer(GL_PIXEL_PACK_BUFFER, ring->pbo[slot]));
+        ogl(glUnmapBuffer(GL_PIXEL_PACK_BUFFER));
+        ogl(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+        ring->released++;
+}
+
+void readbackRingPrintStats(const ReadbackRing *ring, int frames) {
+        fprintf(stderr, "readback ring depth %d: fence wait %.2f ms total, "
+                "%.3f ms/frame, %.3f ms max, %d of %d maps stalled\n",
+                ring->depth, ring->wait_total * 1e3,
+                frames ? ring->wait_total * 1e3 / frames : 0.0,
+                ring->wait_max * 1e3, ring->stalls, ring->waits);
+}
@@ -0,0 +1,75 @@
+#ifndef __READBACK__H__
+#define __READBACK__H__
+
+#include <stddef.h>
+
+#include <atomic>
+
+#include <GL/glew.h>
+
+/*****************************************************************************
+ * Asynchronous readback ring
+ *
+ * glReadPixels goes into one of N GL_PIXEL_PACK_BUFFERs and is tracked by
+ * a fence, so frame k can be copied out while frame k + 1 renders. The
+ * caller only blocks when it maps the oldest slot before its fence fired.
+ *
+ * One thread may queue readbacks while another, with a shared context,
+ * maps and releases them. The producer must flush its context after a
+ * commit so the consumer's fence wait can complete.
+ ****************************************************************************/
+enum {
+        READBACK_MAX_DEPTH = 16,
+};
+
+struct ReadbackRing {
+        GLuint pbo[READBACK_MAX_DEPTH];
+        GLsync fence[READBACK_MAX_DEPTH];
+        int depth;
+        /* only advanced by the producer / the consumer */
+        std::atomic<unsigned> queued;
+        std::atomic<unsigned> released;
+        size_t size;
+
+        /* time spent in glClientWaitSync */
+        double wait_total;
+        double wait_max;
+        int waits;
+        int stalls;
+};
+
+void readbackRingInit(ReadbackRing *ring, int depth, size_t size);
+void readbackRingDestroy(ReadbackRing *ring);
+
+static inline bool readbackRingFull(const ReadbackRing *ring) {
+        return ring->queued - ring->released == (unsigned)ring->depth;
+}
+
+static inline bool readbackRingEmpty(const ReadbackRing *ring) {
+        return ring->queued == ring->released;
+}
+
+/*
+ * Reads a rectangle of the current read buffer into the next free slot at
+ * the given byte offset. Several reads may target one slot, which becomes
+ * pending on readbackRingCommit(). The ring must not be full.
+ */
+void readbackRingRead(ReadbackRing *ring, size_t offset, GLint x, GLint y,
+        GLsizei width, GLsizei height, GLenum format, GLenum type);
+void readbackRingCommit(ReadbackRing *ring);
+
+/* same as readbackRingRead, but copies size bytes of a buffer object */
+void readbackRingCopy(ReadbackRing *ring, size_t offset, GLuint buffer,
+        size_t src_offset, size_t size);
+
+/* single rectangle at offset 0 */
+void readbackRingQueue(ReadbackRing *ring, GLint x, GLint y,
+        GLsizei width, GLsizei height, GLenum format, GLenum type);
+
+/* waits for the oldest readback and maps it, NULL if the ring is empty */
+const void *readbackRingMapOldest(ReadbackRing *ring);
+void readbackRingReleaseOldest(ReadbackRing *ring);
+
+void readbackRingPrintStats(const ReadbackRing *ring, int frames);
+
+#endif //__READBACK__H__
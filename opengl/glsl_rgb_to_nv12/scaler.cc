@@ -0,0 +1,390 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opengl_utils.h"
+#include "scaler.h"
+
+/*****************************************************************************
+ * Filters
+ ****************************************************************************/
+static const char *filter_names[SCALE_FILTER_COUNT] = {
+        "bilinear",
+        "bicubic",
+        "lanczos3",
+};
+
+/* input pixels the kernel reaches on each side at 1:1 */
+static const double filter_radius[SCALE_FILTER_COUNT] = { 1.0, 2.0, 3.0 };
+
+const char *scaleFilterName(ScaleFilter filter) {
+        if (filter < 0 || filter >= SCALE_FILTER_COUNT) {
+                return NULL;
+        }
+        return filter_names[filter];
+}
+
+int scaleFilterFromName(const char *name) {
+        for (int i = 0; i < SCALE_FILTER_COUNT; i++) {
+                if (!strcmp(filter_names[i], name)) {
+                        return i;
+                }
+        }
+        return -1;
+}
+
+static double sinc(double x) {
+        if (x == 0.0) {
+                return 1.0;
+        }
+        x *= M_PI;
+        return sin(x) / x;
+}
+
+/* x in input pixels at 1:1 */
+static double filterWeight(ScaleFilter filter, double x) {
+        /* Catmull-Rom is Keys' cubic with a = -0.5 */
+        const double a = -0.5;
+        x = fabs(x);
+        switch (filter) {
+        case SCALE_BICUBIC:
+                if (x < 1.0) {
+                        return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+                }
+                if (x < 2.0) {
+                        return ((a * x - 5.0 * a) * x + 8.0 * a) * x - 4.0 * a;
+                }
+                return 0.0;
+        case SCALE_LANCZOS3:
+                return x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+        default:
+                return x < 1.0 ? 1.0 - x : 0.0;
+        }
+}
+
+/*****************************************************************************
+ * Weights
+ ****************************************************************************/
+static int weightTexels(const ScaleAxis *axis) {
+        return 1 + axis->taps / 4;
+}
+
+/*
+ * Output pixel d covers input pixels around (d + 0.5) * src / dst - 0.5.
+ * Taps outside the input are left to the clamping of the fetches, which
+ * repeats the edge pixels.
+ */
+static void initAxis(ScaleAxis *axis, ScaleFilter filter, int src, int dst) {
+        double scale = (double)src / dst;
+        double stretch = scale > 1.0 ? scale : 1.0;
+        double support = filter_radius[filter] * stretch;
+        /* every filter is 1 at 0 and 0 at the other whole pixels */
+        if (src == dst) {
+                support = 0.5;
+        }
+
+        axis->src_size = src;
+        axis->dst_size = dst;
+        axis->taps = ((int)ceil(2.0 * support) + 3) & ~3;
+        int texels = weightTexels(axis);
+        float *data = (float*)calloc((size_t)dst * texels * 4, sizeof(float));
+        if (!data) {
+                perror("calloc");
+                exit(-1);
+        }
+
+        for (int d = 0; d < dst; d++) {
+                double center = (d + 0.5) * scale - 0.5;
+                int first = (int)floor(center - support) + 1;
+                float *row = data + (size_t)d * texels * 4;
+                double sum = 0.0;
+                for (int t = 0; t < axis->taps; t++) {
+                        sum += filterWeight(filter,
+                                (first + t - center) / stretch);
+                }
+                row[0] = first;
+                for (int t = 0; t < axis->taps; t++) {
+                        row[4 + t] = filterWeight(filter,
+                                (first + t - center) / stretch) / sum;
+                }
+        }
+
+        ogl(glGenTextures(1, &axis->weights));
+        ogl(glBindTexture(GL_TEXTURE_2D, axis->weights));
+        ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+        ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+        ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
+                GL_CLAMP_TO_EDGE));
+        ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
+                GL_CLAMP_TO_EDGE));
+        /* the caller sets the unpack state for its frames afterwards */
+        ogl(glPixelStorei(GL_UNPACK_ROW_LENGTH, 0));
+        ogl(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+        ogl(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, texels, dst, 0,
+                GL_RGBA, GL_FLOAT, data));
+        ogl(glBindTexture(GL_TEXTURE_2D, 0));
+        free(data);
+}
+
+/*****************************************************************************
+ * Shaders
+ *
+ * Both passes are the prelude with the axis' taps as constants, followed
+ * by their main(). A pixel of an axis with N taps makes N fetches of the
+ * input and N / 4 + 1 of the weights.
+ ****************************************************************************/
+static const char *vert_position =
+        "#version 120\n"
+        "attribute vec4 position;\n"
+        "void main(void) {\n"
+        "        gl_Position = position;\n"
+        "}\n";
+
+static const char *prelude_format =
+        "#version 120\n"
+        "precision mediump float;\n"
+        "uniform sampler2D tex_input;\n"
+        "uniform sampler2D weights;\n"
+        "uniform vec2 src_size;\n"
+        /* output pixels along the axis, the rows of the weights */
+        "uniform float dst_length;\n"
+        "const int taps = %d;\n"
+        "const float texels = %d.0;\n"
+        "float firstTap(float i) {\n"
+        "        return texture2D(weights, vec2(0.5 / texels,\n"
+        "                (i + 0.5) / dst_length)).x;\n"
+        "}\n"
+        /* the weights of taps t to t + 3 */
+        "vec4 tapWeights(float i, int t) {\n"
+        "        return texture2D(weights, vec2((float(t / 4) + 1.5) / texels,\n"
+        "                (i + 0.5) / dst_length));\n"
+        "}\n"
+        "vec3 fetch(vec2 pixel) {\n"
+        "        return texture2D(tex_input,\n"
+        "                (pixel + vec2(0.5)) / src_size).rgb;\n"
+        "}\n";
+
+static const char *main_x =
+        "void main(void) {\n"
+        "        vec2 pixel = floor(gl_FragCoord.xy);\n"
+        "        float x = firstTap(pixel.x);\n"
+        "        vec3 sum = vec3(0.0);\n"
+        "        for (int t = 0; t < taps; t += 4) {\n"
+        "                vec4 w = tapWeights(pixel.x, t);\n"
+        "                float tx = x + float(t);\n"
+        "                sum += w.x * fetch(vec2(tx, pixel.y))\n"
+        "                        + w.y * fetch(vec2(tx + 1.0, pixel.y))\n"
+        "                        + w.z * fetch(vec2(tx + 2.0, pixel.y))\n"
+        "                        + w.w * fetch(vec2(tx + 3.0, pixel.y));\n"
+        "        }\n"
+        "        gl_FragData[0] = vec4(sum, 1.0);\n"
+        "}\n";
+
+static const char *main_y_nv12 =
+        "const vec4 y_coef = vec4(0.257, 0.504, 0.098, 0.0625);\n"
+        "const vec4 u_coef = vec4(-0.148, -0.291, 0.439, 0.5);\n"
+        "const vec4 v_coef = vec4(0.439, -0.368, -0.071, 0.5);\n"
+        /* output row of the pixels in columns x and x + 1 */
+        "void filterColumns(float row, float x, out vec4 left,\n"
+        "        out vec4 right)\n"
+        "{\n"
+        "        float y = firstTap(row);\n"
+        "        vec3 l = vec3(0.0);\n"
+        "        vec3 r = vec3(0.0);\n"
+        "        for (int t = 0; t < taps; t += 4) {\n"
+        "                vec4 w = tapWeights(row, t);\n"
+        "                vec4 ty = vec4(y + float(t)) + vec4(0.0, 1.0, 2.0, 3.0);\n"
+        "                l += w.x * fetch(vec2(x, ty.x))\n"
+        "                        + w.y * fetch(vec2(x, ty.y))\n"
+        "                        + w.z * fetch(vec2(x, ty.z))\n"
+        "                        + w.w * fetch(vec2(x, ty.w));\n"
+        "                r += w.x * fetch(vec2(x + 1.0, ty.x))\n"
+        "                        + w.y * fetch(vec2(x + 1.0, ty.y))\n"
+        "                        + w.z * fetch(vec2(x + 1.0, ty.z))\n"
+        "                        + w.w * fetch(vec2(x + 1.0, ty.w));\n"
+        "        }\n"
+        /* the lobes of bicubic and lanczos3 ring past the range */
+        "        left = vec4(clamp(l, 0.0, 1.0), 1.0);\n"
+        "        right = vec4(clamp(r, 0.0, 1.0), 1.0);\n"
+        "}\n"
+        "void main(void) {\n"
+        "        vec2 pixel = 2.0 * floor(gl_FragCoord.xy);\n"
+        "        vec4 top_left, top_right, bottom_left, bottom_right;\n"
+        "        filterColumns(pixel.y, pixel.x, top_left, top_right);\n"
+        "        filterColumns(pixel.y + 1.0, pixel.x, bottom_left,\n"
+        "                bottom_right);\n"
+        "        gl_FragData[0] = vec4(dot(y_coef, top_left),\n"
+        "                dot(y_coef, top_right), 0.0, 0.0);\n"
+        "        gl_FragData[1] = vec4(dot(y_coef, bottom_left),\n"
+        "                dot(y_coef, bottom_right), 0.0, 0.0);\n"
+        "        vec4 rgb = 0.25 * (top_left + top_right + bottom_left\n"
+        "                + bottom_right);\n"
+        "        gl_FragData[2] = vec4(dot(u_coef, rgb), dot(v_coef, rgb),\n"
+        "                0.0, 0.0);\n"
+        "}\n";
+
+static GLuint requestProgram(ProgramCache *programs, const ScaleAxis *axis,
+        const char *main)
+{
+        char prelude[2048];
+        snprintf(prelude, sizeof(prelude), prelude_format, axis->taps,
+                weightTexels(axis));
+        const char *frag_source[] = { prelude, main };
+        ProgramDesc desc;
+        programDescInit(&desc);
+        programDescAddStage(&desc, GL_VERTEX_SHADER, 1, &vert_position);
+        programDescAddStage(&desc, GL_FRAGMENT_SHADER, 2, frag_source);
+        desc.attrib[0] = "position";
+        return programCacheRequest(programs, &desc);
+}
+
+/*****************************************************************************
+ * Scaler
+ ****************************************************************************/
+void scalerInit(Scaler *scaler, ProgramCache *programs, ScaleFilter filter,
+        int src_width, int src_height, int dst_width, int dst_height)
+{
+        memset(scaler, 0, sizeof(*scaler));
+        scaler->filter = filter;
+        initAxis(&scaler->x, filter, src_width, dst_width);
+        initAxis(&scaler->y, filter, src_height, dst_height);
+        scaler->program_x = requestProgram(programs, &scaler->x, main_x);
+        scaler->program_y = requestProgram(programs, &scaler->y,
+                main_y_nv12);
+}
+
+void scalerDestroy(Scaler *scaler) {
+        ogl(glDeleteTextures(1, &scaler->x.weights));
+        ogl(glDeleteTextures(1, &scaler->y.weights));
+        memset(scaler, 0, sizeof(*scaler));
+}
+
+void scalerAddPasses(Scaler *scaler, FilterGraph *graph, const char *input,
+        const char *prefix)
+{
+        snprintf(scaler->weights_x, FILTER_MAX_NAME, "%sweights_x", prefix);
+        snprintf(scaler->weights_y, FILTER_MAX_NAME, "%sweights_y", prefix);
+        snprintf(scaler->rows, FILTER_MAX_NAME, "%srows", prefix);
+        snprintf(scaler->even, FILTER_MAX_NAME, "%seven", prefix);
+        snprintf(scaler->odd, FILTER_MAX_NAME, "%sodd", prefix);
+        snprintf(scaler->uv, FILTER_MAX_NAME, "%suv", prefix);
+
+        int width = scaler->x.dst_size;
+        int height = scaler->y.dst_size;
+        int rows = scaler->y.src_size;
+        filterGraphAddInput(graph, scaler->weights_x,
+                weightTexels(&scaler->x), width);
+        filterGraphAddInput(graph, scaler->weights_y,
+                weightTexels(&scaler->y), height);
+        /* signed, the lobes ring past the range until the second pass */
+        filterGraphAddTarget(graph, scaler->rows, width, rows, GL_RGBA32F);
+        filterGraphAddTarget(graph, scaler->even, width / 2, height / 2,
+                GL_RG8);
+        filterGraphAddTarget(graph, scaler->odd, width / 2, height / 2,
+                GL_RG8);
+        filterGraphAddTarget(graph, scaler->uv, width / 2, height / 2, GL_RG8);
+
+        GLfloat length = width;
+        int pass = filterGraphAddPass(graph, "scale_x", scaler->program_x, 0);
+        filterPassRead(graph, pass, input, "tex_input", 0);
+        filterPassRead(graph, pass, scaler->weights_x, "weights", 0);
+        filterPassWrite(graph, pass, scaler->rows);
+        filterPassUniform2f(graph, pass, "src_size", scaler->x.src_size, rows);
+        filterPassUniform(graph, pass, "dst_length", 1, &length);
+
+        length = height;
+        pass = filterGraphAddPass(graph, "scale_y_nv12", scaler->program_y, 0);
+        filterPassRead(graph, pass, scaler->rows, "tex_input", 0);
+        filterPassRead(graph, pass, scaler->weights_y, "weights", 0);
+        filterPassWrite(graph, pass, scaler->even);
+        filterPassWrite(graph, pass, scaler->odd);
+        filterPassWrite(graph, pass, scaler->uv);
+        filterPassUniform2f(graph, pass, "src_size", width, rows);
+        filterPassUniform(graph, pass, "dst_length", 1, &length);
+}
+
+void scalerSetInputs(const Scaler *scaler, FilterGraph *graph) {
+        filterGraphSetInput(graph, scaler->weights_x, scaler->x.weights);
+        filterGraphSetInput(graph, scaler->weights_y, scaler->y.weights);
+}
+
+void scalerReadback(const Scaler *scaler, const FilterGraph *graph,
+        ReadbackRing *ring, const YuvLayout *layout, size_t offset)
+{
+        const YuvPlane *y = &layout->plane[0];
+        const YuvPlane *uv = &layout->plane[1];
+        /* luma pairs of even and odd rows, interleaved like luma4 */
+        oglSetRowStride(GL_PACK_ROW_LENGTH, GL_PACK_ALIGNMENT,
+                uv->width, 2, 2 * y->stride);
+        filterGraphBindRead(graph, scaler->even);
+        readbackRingRead(ring, offset, 0, 0, uv->width, uv->height,
+                GL_RG, GL_UNSIGNED_BYTE);
+        filterGraphBindRead(graph, scaler->odd);
+        readbackRingRead(ring, offset + y->stride, 0, 0, uv->width, uv->height,
+                GL_RG, GL_UNSIGNED_BYTE);
+        filterGraphBindRead(graph, scaler->uv);
+        oglSetRowStride(GL_PACK_ROW_LENGTH, GL_PACK_ALIGNMENT,
+                uv->width, 2, uv->stride);
+        readbackRingRead(ring, offset + uv->offset, 0, 0, uv->width,
+                uv->height, GL_RG, GL_UNSIGNED_BYTE);
+}
+
+/*****************************************************************************
+ * Ladders
+ ****************************************************************************/
+void scaleLadderInit(ScaleLadder *ladder, ProgramCache *programs,
+        ScaleFilter filter, int src_width, int src_height, int count,
+        const int (*sizes)[2], bool chain)
+{
+        memset(ladder, 0, sizeof(*ladder));
+        ladder->count = count;
+        for (int i = 0; i < count; i++) {
+                ScaleRendition *r = &ladder->rendition[i];
+                int width = sizes[i][0];
+                int height = sizes[i][1];
+                r->source = chain && i > 0 && sizes[i - 1][0] >= width ?
+                        i - 1 : -1;
+                int rows_width = r->source < 0 ? src_width
+                        : sizes[r->source][0];
+                scalerInit(&r->scaler, programs, filter, rows_width,
+                        src_height, width, height);
+                yuvLayoutInit(&r->layout, YUV_NV12, width, height, 0, 0);
+                r->offset = ladder->size;
+                ladder->size += r->layout.size;
+                snprintf(r->prefix, sizeof(r->prefix), "r%d_", i);
+        }
+}
+
+void scaleLadderDestroy(ScaleLadder *ladder) {
+        for (int i = 0; i < ladder->count; i++) {
+                scalerDestroy(&ladder->rendition[i].scaler);
+        }
+        memset(ladder, 0, sizeof(*ladder));
+}
+
+void scaleLadderAddPasses(ScaleLadder *ladder, FilterGraph *graph,
+        const char *input)
+{
+        for (int i = 0; i < ladder->count; i++) {
+                ScaleRendition *r = &ladder->rendition[i];
+                const char *source = r->source < 0 ? input
+                        : ladder->rendition[r->source].scaler.rows;
+                scalerAddPasses(&r->scaler, graph, source, r->prefix);
+        }
+}
+
+void scaleLadderSetInputs(const ScaleLadder *ladder, FilterGraph *graph) {
+        for (int i = 0; i < ladder->count; i++) {
+                scalerSetInputs(&ladder->rendition[i].scaler, graph);
+        }
+}
+
+void scaleLadderReadback(const ScaleLadder *ladder, const FilterGraph *graph,
+        ReadbackRing *ring)
+{
+        for (int i = 0; i < ladder->count; i++) {
+                const ScaleRendition *r = &ladder->rendition[i];
+                scalerReadback(&r->scaler, graph, ring, &r->layout, r->offset);
+        }
+}
@@ -0,0 +1,138 @@
+#ifndef __SCALER__H__
+#define __SCALER__H__
+
+#include <GL/glew.h>
+
+#include "filter_graph.h"
+#include "program_cache.h"
+#include "readback.h"
+#include "yuv_engine.h"
+
+/*****************************************************************************
+ * Separable RGB -> NV12 scaler
+ *
+ * Resizes the input on its way to NV12 in two passes. The horizontal one
+ * filters each row into an RGBA32F target at the output width and the
+ * input height. The vertical one filters the columns of a 2x2 block of
+ * output pixels per fragment and converts them right away, writing two
+ * luma pairs and the block's UV pair into three RG8 targets, like luma4
+ * does with 4x2 blocks. The "even" and "odd" targets interleave into the
+ * Y plane through the pack row length, "uv" is the UV plane.
+ *
+ * The taps and weights of every output column and row are computed once
+ * on the CPU into a weight texture per axis, so any ratio runs the same
+ * shaders. Downscaling widens the kernel by the ratio, so every input
+ * pixel counts.
+ ****************************************************************************/
+enum ScaleFilter {
+        SCALE_BILINEAR,
+        /* Catmull-Rom */
+        SCALE_BICUBIC,
+        SCALE_LANCZOS3,
+        SCALE_FILTER_COUNT,
+};
+
+/* the name returns NULL / the lookup returns -1 when out of range */
+const char *scaleFilterName(ScaleFilter filter);
+int scaleFilterFromName(const char *name);
+
+struct ScaleAxis {
+        int src_size;
+        int dst_size;
+        /* weights per output pixel, a multiple of 4 */
+        int taps;
+        /*
+         * RGBA32F, a row per output pixel: the first input pixel in the
+         * first texel, then taps / 4 texels of weights.
+         */
+        GLuint weights;
+};
+
+struct Scaler {
+        ScaleFilter filter;
+        ScaleAxis x;
+        ScaleAxis y;
+        GLuint program_x;
+        GLuint program_y;
+        /* names in the graph, with the prefix given to scalerAddPasses() */
+        char weights_x[FILTER_MAX_NAME];
+        char weights_y[FILTER_MAX_NAME];
+        char rows[FILTER_MAX_NAME];
+        char even[FILTER_MAX_NAME];
+        char odd[FILTER_MAX_NAME];
+        char uv[FILTER_MAX_NAME];
+};
+
+/*
+ * Builds the weight textures and requests the programs, which the graph
+ * needs linked by the time it compiles, see programCacheFinish().
+ */
+void scalerInit(Scaler *scaler, ProgramCache *programs, ScaleFilter filter,
+        int src_width, int src_height, int dst_width, int dst_height);
+/* the programs belong to the program cache */
+void scalerDestroy(Scaler *scaler);
+
+/*
+ * Adds the passes from input into the "even", "odd" and "uv" targets and
+ * the "weights_x" and "weights_y" inputs, which scalerSetInputs() sets
+ * once the graph is compiled. Every name starts with prefix, so several
+ * scalers fit in one graph. The graph keeps pointers to the names.
+ */
+void scalerAddPasses(Scaler *scaler, FilterGraph *graph, const char *input,
+        const char *prefix);
+void scalerSetInputs(const Scaler *scaler, FilterGraph *graph);
+
+/*
+ * Queues the NV12 planes into the current slot of the ring, laid out as
+ * layout at offset. The caller commits the slot.
+ */
+void scalerReadback(const Scaler *scaler, const FilterGraph *graph,
+        ReadbackRing *ring, const YuvLayout *layout, size_t offset);
+
+/*****************************************************************************
+ * Ladders
+ *
+ * Several renditions of one frame, e.g. an ABR ladder, from one graph run
+ * into one readback slot. Chained, each rendition's horizontal pass reads
+ * the rows of the rendition before it when that one is at least as wide,
+ * so the smaller ones filter fewer, already narrowed pixels instead of the
+ * whole input. That filters them twice, which costs some sharpness, most
+ * at ratios close to 1. The vertical passes read their own rows.
+ ****************************************************************************/
+enum {
+        SCALE_MAX_RENDITIONS = 6,
+};
+
+struct ScaleRendition {
+        Scaler scaler;
+        /* tight NV12 at offset in the readback slot */
+        YuvLayout layout;
+        size_t offset;
+        /* the rendition whose rows the horizontal pass reads, -1 for input */
+        int source;
+        char prefix[8];
+};
+
+struct ScaleLadder {
+        int count;
+        ScaleRendition rendition[SCALE_MAX_RENDITIONS];
+        /* of all renditions */
+        size_t size;
+};
+
+/*
+ * sizes holds count width, height pairs, see scalerInit(). Unchained every
+ * rendition scales from the input, like a scaler of its own.
+ */
+void scaleLadderInit(ScaleLadder *ladder, ProgramCache *programs,
+        ScaleFilter filter, int src_width, int src_height, int count,
+        const int (*sizes)[2], bool chain);
+void scaleLadderDestroy(ScaleLadder *ladder);
+void scaleLadderAddPasses(ScaleLadder *ladder, FilterGraph *graph,
+        const char *input);
+void scaleLadderSetInputs(const ScaleLadder *ladder, FilterGraph *graph);
+/* every rendition into the current slot, which the caller commits */
+void scaleLadderReadback(const ScaleLadder *ladder, const FilterGraph *graph,
+        ReadbackRing *ring);
+
+#endif //__SCALER__H__
@@ -1,67 +1,38 @@
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 //#include <sys/error.h>
 
 #include <GL/glew.h>
-#include <GLFW/glfw3.h>
+
+#include "opengl_utils.h"
+#include "context.h"
+#include "cpu_nv12.h"
+#include "filter_graph.h"
+#include "frame_io.h"
+#include "gpu_timer.h"
+#include "pipeline.h"
+#include "program_cache.h"
+#include "readback.h"
+#include "scaler.h"
+#include "tiles.h"
+#include "upload.h"
+#include "yuv_engine.h"
 
 //#define SKIP_YUVCONV
 //#define SHOW_IMAGE
 
-/*****************************************************************************
- * OpenGL Helpers
- ****************************************************************************/
-#define ogl(x) do { \
-        x; \
-        int _err = glGetError(); \
-        if (_err) { \
-                printf("GL Error %d at %d, %s\n", _err, __LINE__, __func__); \
-                exit (-1); \
-        } \
-} while (0)
-
-static inline void oglProgramLog(int pid)
-{
-        GLint logLen;
-        GLsizei realLen;
-
-        glGetProgramiv(pid, GL_INFO_LOG_LENGTH, &logLen);
-        if (!logLen) {
-                return;
-        }
-        char *log = (char *)malloc(logLen);
-        if (!log) {
-                perror("malloc");
-                return;
-        }
-        glGetProgramInfoLog(pid, logLen, &realLen, log);
-        if (realLen) {
-                printf("program %d log %s\n", pid, log);
-        }
-        free(log);
-}
-
-static inline void oglShaderLog(int sid) {
-        GLint logLen;
-        GLsizei realLen;
-
-        glGetShaderiv(sid, GL_INFO_LOG_LENGTH, &logLen);
-        if (!logLen) {
-                return;
-        }
-        char *log = (char *)malloc(logLen);
-        if (!log) {
-                perror("malloc");
-                return;
-        }
-        glGetShaderInfoLog(sid, logLen, &realLen, log);
-        if (realLen) {
-                printf("shader %d log %s\n", sid, log);
-        }
-        free(log);
-}
+#ifdef SHOW_IMAGE
+static const bool ShowImage = true;
+#else
+static const bool ShowImage = false;
+#endif
 
 #define SHADER(name, text) static const char *name = "#version 120\nprecision mediump float;\n" #text
+#define COMPUTE_SHADER(name, text) static const char *name = "#version 430\n" #text
 
 /*****************************************************************************
  * RGB -> YUV
@@ -104,6 +75,13 @@ SHADER(frag_rgb2yuv,
                 return texture2D(tex_input, mod(coord, vec2(1.0)));
         }
 
+        /* pixel idx of the frame in raster order, wrapping into later rows */
+        vec4 linearTexel(float idx) {
+                float row = floor((idx + 0.5) / framesize.x);
+                vec2 coord = vec2(idx - row * framesize.x, row);
+                return texture2D(tex_input, (coord + vec2(0.5)) / framesize);
+        }
+
         void main(void) {
                 vec2 xy_offset = vec2(1.0, 1.0) / framesize;
                 vec2 x_offset = vec2(1.0, 0.0) / framesize;
@@ -112,12 +90,12 @@ SHADER(frag_rgb2yuv,
                 if (frag_texcoord.y <= y_size) {
                         vec2 real_coord = floor(frag_texcoord * framesize);
                         float idx = 3.0 * (real_coord.y * framesize.x + real_coord.x);
-                        vec2 coord = vec2(mod(idx, framesize.x), idx / framesize.x) / framesize;
 
+                        /* the 3 pixels may straddle a row for any width */
                         mat3x4 rgbs = mat3x4(
-                                wrappedTexel(coord),
-                                wrappedTexel(coord + x_offset),
-                                wrappedTexel(coord + 2.0 * x_offset)
+                                linearTexel(idx),
+                                linearTexel(idx + 1.0),
+                                linearTexel(idx + 2.0)
                         );
                         mat3x4 yuvs = rgb2yuv_mat * rgbs;
                         gl_FragColor = vec4(yuvs[0].x, yuvs[1].x, yuvs[2].x, 0.0);
@@ -165,311 +143,2342 @@ SHADER(frag_rgb2yuv,
 );
 
 /*****************************************************************************
- * Rendering the texture to framebuffer
+ * RGB -> planar NV12
+ *
+ * These sample the input texture directly with gl_FragCoord, so they
+ * skip the intermediate copy and write a real Y/UV layout instead of the
+ * packed 3-luma-per-texel one above.
+ ****************************************************************************/
+/* Y plane, one R8 texel per pixel */
+SHADER(frag_rgb2y,
+        uniform sampler2D tex_input;
+        uniform vec2 framesize;
+
+        const vec4 y_coef = vec4(0.257, 0.504, 0.098, 0.0625);
+
+        void main(void) {
+                vec3 rgb = texture2D(tex_input, gl_FragCoord.xy / framesize).rgb;
+                gl_FragData[0] = vec4(dot(y_coef, vec4(rgb, 1.0)));
+        }
+);
+
+/*
+ * UV plane at half resolution, one RG8 texel per 2x2 block. The block
+ * corner shared by its four pixels is 2 * gl_FragCoord, so a single
+ * bilinear fetch there returns their average.
+ */
+SHADER(frag_rgb2uv,
+        uniform sampler2D tex_input;
+        uniform vec2 framesize;
+
+        const vec4 u_coef = vec4(-0.148, -0.291, 0.439, 0.5);
+        const vec4 v_coef = vec4(0.439, -0.368, -0.071, 0.5);
+
+        void main(void) {
+                vec2 corner = 2.0 * gl_FragCoord.xy / framesize;
+                vec4 rgb = vec4(texture2D(tex_input, corner).rgb, 1.0);
+                gl_FragData[0] = vec4(dot(u_coef, rgb), dot(v_coef, rgb),
+                        0.0, 0.0);
+        }
+);
+
+/*
+ * Everything in one pass over a (width / 4) x (height / 2) grid with three
+ * RGBA8 targets: four luma samples of an even row, four of the following
+ * odd row, and the two UV pairs of the 4x2 block. RGBA8 keeps the
+ * readback on the fast path of every driver.
+ */
+SHADER(frag_rgb2nv12_luma4,
+        uniform sampler2D tex_input;
+        uniform vec2 framesize;
+
+        const vec4 y_coef = vec4(0.257, 0.504, 0.098, 0.0625);
+        const vec4 u_coef = vec4(-0.148, -0.291, 0.439, 0.5);
+        const vec4 v_coef = vec4(0.439, -0.368, -0.071, 0.5);
+
+        vec4 fetch(vec2 pixel) {
+                return vec4(texture2D(tex_input,
+                        (pixel + vec2(0.5)) / framesize).rgb, 1.0);
+        }
+
+        void main(void) {
+                vec2 base = floor(gl_FragCoord.xy) * vec2(4.0, 2.0);
+                mat4 top = mat4(
+                        fetch(base),
+                        fetch(base + vec2(1.0, 0.0)),
+                        fetch(base + vec2(2.0, 0.0)),
+                        fetch(base + vec2(3.0, 0.0))
+                );
+                mat4 bottom = mat4(
+                        fetch(base + vec2(0.0, 1.0)),
+                        fetch(base + vec2(1.0, 1.0)),
+                        fetch(base + vec2(2.0, 1.0)),
+                        fetch(base + vec2(3.0, 1.0))
+                );
+                gl_FragData[0] = y_coef * top;
+                gl_FragData[1] = y_coef * bottom;
+
+                vec4 left = 0.25 * (top[0] + top[1] + bottom[0] + bottom[1]);
+                vec4 right = 0.25 * (top[2] + top[3] + bottom[2] + bottom[3]);
+                gl_FragData[2] = vec4(dot(u_coef, left), dot(v_coef, left),
+                        dot(u_coef, right), dot(v_coef, right));
+        }
+);
+
+/*****************************************************************************
+ * RGB -> NV12 in a compute shader
+ *
+ * Each invocation converts one 2x2 block with the integer arithmetic of
+ * cpu_nv12.cc and writes its 4 Y bytes and the UV pair straight into a
+ * shader storage buffer laid out like the NV12 output, strides included.
+ * Bytes of neighbouring blocks share words, so they are OR-ed into a
+ * buffer cleared before every dispatch.
+ ****************************************************************************/
+COMPUTE_SHADER(comp_rgb2nv12,
+        layout(local_size_x = 8, local_size_y = 8) in;
+        layout(std430, binding = 0) buffer Nv12 {
+                uint nv12[];
+        };
+        uniform sampler2D tex_input;
+        uniform ivec2 framesize;
+        uniform int y_stride;
+        uniform int uv_stride;
+        uniform int uv_offset;
+
+        /* cpu_nv12.cc's Q14 coefficients, biases include the rounding */
+        const ivec3 y_coef = ivec3(4211, 8258, 1606);
+        const ivec3 u_coef = ivec3(-2425, -4768, 7193);
+        const ivec3 v_coef = ivec3(7193, -6029, -1163);
+        const int y_bias = 269312;
+        const int c_bias = 8388608;
+
+        /* edge pixels are replicated like the CPU reference does */
+        ivec3 pixel(ivec2 p) {
+                vec3 rgb = texelFetch(tex_input, min(p, framesize - 1), 0).rgb;
+                return ivec3(rgb * 255.0 + 0.5);
+        }
+
+        int luma(ivec3 rgb) {
+                return (y_coef.r * rgb.r + y_coef.g * rgb.g + y_coef.b * rgb.b
+                        + y_bias) >> 14;
+        }
+
+        /* sum of a 2x2 block, hence the extra >> 2 */
+        int chroma(ivec3 coef, ivec3 sum) {
+                return (coef.r * sum.r + coef.g * sum.g + coef.b * sum.b
+                        + c_bias) >> 16;
+        }
+
+        void putByte(int offset, int value) {
+                atomicOr(nv12[offset >> 2],
+                        uint(value) << uint(8 * (offset & 3)));
+        }
+
+        void putPair(int offset, int first, int second) {
+                if ((offset & 3) == 3) {
+                        putByte(offset, first);
+                        putByte(offset + 1, second);
+                }
+                else {
+                        atomicOr(nv12[offset >> 2], uint(first | (second << 8))
+                                << uint(8 * (offset & 3)));
+                }
+        }
+
+        void putRow(int offset, bool pair, ivec3 left, ivec3 right) {
+                if (pair) {
+                        putPair(offset, luma(left), luma(right));
+                }
+                else {
+                        putByte(offset, luma(left));
+                }
+        }
+
+        void main(void) {
+                ivec2 block = ivec2(gl_GlobalInvocationID.xy);
+                ivec2 p = 2 * block;
+                if (p.x >= framesize.x || p.y >= framesize.y) {
+                        return;
+                }
+
+                ivec3 a = pixel(p);
+                ivec3 b = pixel(p + ivec2(1, 0));
+                ivec3 c = pixel(p + ivec2(0, 1));
+                ivec3 d = pixel(p + ivec2(1, 1));
+                bool pair = p.x + 1 < framesize.x;
+
+                putRow(p.y * y_stride + p.x, pair, a, b);
+                if (p.y + 1 < framesize.y) {
+                        putRow((p.y + 1) * y_stride + p.x, pair, c, d);
+                }
+
+                ivec3 sum = a + b + c + d;
+                putPair(uv_offset + block.y * uv_stride + p.x,
+                        chroma(u_coef, sum), chroma(v_coef, sum));
+        }
+);
+
+/*****************************************************************************
+ * Frame geometry
+ *
+ * Frame size and the row pitch of every plane are runtime values. Padded
+ * strides go through GL_UNPACK_ROW_LENGTH and GL_PACK_ROW_LENGTH, so rows
+ * are never repacked on the CPU on either side of the GPU.
  ****************************************************************************/
 enum {
-        TEX_WIDTH = 1024,
-        TEX_HEIGHT = 768,
+        DEFAULT_WIDTH = 1024,
+        DEFAULT_HEIGHT = 768,
+        /* tiles of frames too large for one texture, see --tile */
+        DEFAULT_TILE = 2048,
+        /* the 2x2 block a chroma sample averages reaches a pixel over */
+        CHROMA_HALO = 1,
 };
 
-static const GLfloat QuadSide = 1.0f;
+static const char *DefaultInput = "cat_1024_768.rgb";
 
-static GLfloat QuadData[] = {
-        //vertex coordinates
-        QuadSide, QuadSide, 0.0f,
-        -QuadSide, QuadSide, 0.0f,
-        -QuadSide, -QuadSide, 0.0f,
-        QuadSide, -QuadSide, 0.0f,
+/* frames of GPU timer queries in flight before the oldest is read */
+static const int TimerDepth = 8;
 
-        //texture coordinates
-        0, 0,
-        1, 0,
-        1, 1,
-        0, 1,
+struct FrameGeometry {
+        int width;
+        int height;
+        /* bytes per row of the RGB24 input and the Y and UV planes, 0 = tight */
+        size_t in_stride;
+        size_t y_stride;
+        size_t uv_stride;
 };
 
-static GLfloat QuadData_inverted[] = {
-        //vertex coordinates
-        -QuadSide, -QuadSide, 0.0f,
-        QuadSide, -QuadSide, 0.0f,
-        QuadSide, QuadSide, 0.0f,
-        -QuadSide, QuadSide, 0.0f,
-
-        //texture coordinates
-        0, 0,
-        1, 0,
-        1, 1,
-        0, 1,
-};
+static FrameGeometry _geo = { DEFAULT_WIDTH, DEFAULT_HEIGHT, 0, 0, 0 };
 
-static GLuint QuadIndices[] = {
-        0, 1, 2,
-        0, 2, 3,
-};
+static int chromaWidth(void) {
+        return (_geo.width + 1) / 2;
+}
 
-static const size_t VertexStride = 3;
-static const size_t TexCoordStride = 2;
+static int chromaHeight(void) {
+        return (_geo.height + 1) / 2;
+}
 
-static const size_t CoordOffset = 0;
-static const size_t TexCoordOffset = 12;
+static size_t inputSize(void) {
+        return _geo.in_stride * _geo.height;
+}
 
-static const size_t NumVertices = 4;
-static const size_t NumIndices = 6;
+static size_t ySize(void) {
+        return _geo.y_stride * _geo.height;
+}
 
-static GLuint _program_id;
-static GLuint _texture;
-static GLuint _fb_rgb2yuv;
-static GLuint _texture_rgb2yuv_fb;
+static size_t uvSize(void) {
+        return _geo.uv_stride * chromaHeight();
+}
 
-static GLuint _vao;
-static GLuint _vbo;
-static GLuint _vbo_idx;
+static void setTightStrides(void) {
+        if (!_geo.in_stride) {
+                _geo.in_stride = (size_t)_geo.width * 3;
+        }
+        if (!_geo.y_stride) {
+                _geo.y_stride = _geo.width;
+        }
+        if (!_geo.uv_stride) {
+                _geo.uv_stride = (size_t)chromaWidth() * 2;
+        }
+}
 
-static GLuint _position_attr;
-static GLuint _tex_coord_attr;
-static GLuint _frame_size_attr;
-static GLuint _texture_location_in_shader;
+/*****************************************************************************
+ * Output modes
+ ****************************************************************************/
+enum OutputMode {
+        /* frag_rgb2yuv, 3 luma per RGB texel in the top third */
+        OUTPUT_PACKED,
+        /* full resolution R8 Y target + half resolution RG8 UV target */
+        OUTPUT_PLANAR,
+        /* one MRT pass into RGBA8 targets, 4 luma per texel */
+        OUTPUT_LUMA4,
+        /* comp_rgb2nv12 into a shader storage buffer, needs GL 4.3 */
+        OUTPUT_COMPUTE,
+        /* yuv_engine.cc, any --format, --matrix and --range */
+        OUTPUT_ENGINE,
+        /* scaler.cc, NV12 at the --scale size through the --filter */
+        OUTPUT_SCALED,
+        /* scaler.cc, NV12 at every --ladder size from one graph run */
+        OUTPUT_LADDER,
+        OUTPUT_MODE_COUNT,
+};
 
-static void setGlProgram(const char *frag_source, const char *vert_source) {
-        ogl(_program_id = glCreateProgram());
+static const char *output_mode_names[OUTPUT_MODE_COUNT] = {
+        "packed",
+        "planar",
+        "luma4",
+        "compute",
+        "engine",
+        "scaled",
+        "ladder",
+};
 
-        GLuint vert, frag;
-        ogl(vert = glCreateShader(GL_VERTEX_SHADER));
-        ogl(frag = glCreateShader(GL_FRAGMENT_SHADER));
+static OutputMode _output_mode = OUTPUT_PACKED;
 
-        const char **vsrc = const_cast<const char**>(&vert_source);
-        const char **fsrc = const_cast<const char**>(&frag_source);
+static YuvFormat _yuv_format = YUV_NV12;
+static YuvMatrix _yuv_matrix = YUV_BT601;
+static YuvRange _yuv_range = YUV_RANGE_LIMITED;
+/* strides as requested, the engine's layout picks tight ones per format */
+static size_t _yuv_y_stride;
+static size_t _yuv_uv_stride;
+static YuvLayout _layout;
 
-        ogl(glShaderSource(vert, 1, vsrc, NULL));
-        ogl(glCompileShader(vert));
-        oglShaderLog(vert);
+static void setYuvLayout(YuvFormat format) {
+        _yuv_format = format;
+        yuvLayoutInit(&_layout, format, _geo.width, _geo.height,
+                _yuv_y_stride, _yuv_uv_stride);
+}
 
-        ogl(glShaderSource(frag, 1, fsrc, NULL));
-        ogl(glCompileShader(frag));
-        oglShaderLog(frag);
+/* the output size of the scaled mode, 0 without --scale */
+static int _scale_width;
+static int _scale_height;
+static ScaleFilter _scale_filter = SCALE_BICUBIC;
+/* the requested strides apply to the scaled planes */
+static YuvLayout _scaled_layout;
 
-        ogl(glAttachShader(_program_id, frag));
-        ogl(glAttachShader(_program_id, vert));
+static void setScaledLayout(void) {
+        yuvLayoutInit(&_scaled_layout, YUV_NV12, _scale_width, _scale_height,
+                _yuv_y_stride, _yuv_uv_stride);
+}
 
-        ogl(glBindAttribLocation(_program_id, 0, "position"));
-        ogl(glBindAttribLocation(_program_id, 1, "texcoord"));
-        ogl(glBindFragDataLocation(_program_id, 0, "out_color"));
+/* the renditions of the ladder mode in --ladder order, none without it */
+static int _ladder_count;
+static int _ladder_sizes[SCALE_MAX_RENDITIONS][2];
+/* renditions read the rows of a wider one, see ScaleLadder */
+static bool _ladder_chain = true;
+
+/* tight NV12 renditions one after the other, like ScaleLadder lays out */
+static size_t ladderSize(void) {
+        size_t size = 0;
+        for (int i = 0; i < _ladder_count; i++) {
+                YuvLayout layout;
+                yuvLayoutInit(&layout, YUV_NV12, _ladder_sizes[i][0],
+                        _ladder_sizes[i][1], 0, 0);
+                size += layout.size;
+        }
+        return size;
+}
 
-        ogl(glLinkProgram(_program_id));
-        ogl(oglProgramLog(_program_id));
-        
-        ogl(_position_attr = glGetAttribLocation(_program_id, "position"));
-        ogl(_tex_coord_attr = glGetAttribLocation(_program_id, "texcoord"));
+/* a comma separated list of WxH */
+static bool parseLadder(const char *list) {
+        _ladder_count = 0;
+        while (*list) {
+                int *size = _ladder_sizes[_ladder_count];
+                int length = 0;
+                if (_ladder_count == SCALE_MAX_RENDITIONS
+                        || 2 != sscanf(list, "%dx%d%n", &size[0], &size[1],
+                                &length)
+                        || size[0] < 1 || size[1] < 1)
+                {
+                        return false;
+                }
+                _ladder_count++;
+                list += length;
+                if (*list == ',') {
+                        list++;
+                }
+                else if (*list) {
+                        return false;
+                }
+        }
+        return _ladder_count > 0;
 }
 
-static void setGlProgramForRgb2Yuv(void) {
+/* rows of the default framebuffer holding the packed frame */
+static int packedRows(void) {
 #ifndef SKIP_YUVCONV
-        setGlProgram(frag_rgb2yuv, vert_passthru);
+        return _geo.height / 2;
 #else
-        setGlProgram(frag_texture, vert_passthru);
+        return _geo.height;
 #endif
-        ogl(glUseProgram(_program_id));
-        ogl(_frame_size_attr = glGetUniformLocation(_program_id, "framesize"));
-        ogl(glUniform2f(_frame_size_attr, TEX_WIDTH, TEX_HEIGHT));
 }
 
-static void initializeContext(void) {
-        ogl(glGenVertexArrays(1, &_vao));
-        ogl(glBindVertexArray(_vao));
-        ogl(glGenBuffers(1, &_vbo));
-        ogl(glGenBuffers(1, &_vbo_idx));
-        ogl(glGenTextures(1, &_texture));
-
-        setGlProgram(frag_texture, vert_passthru);
+static size_t outputSize(void) {
+        if (_output_mode == OUTPUT_PACKED) {
+                return (size_t)_geo.width * packedRows() * 3;
+        }
+        if (_output_mode == OUTPUT_ENGINE) {
+                return _layout.size;
+        }
+        if (_output_mode == OUTPUT_SCALED) {
+                return _scaled_layout.size;
+        }
+        if (_output_mode == OUTPUT_LADDER) {
+                return ladderSize();
+        }
+        return ySize() + uvSize();
+}
 
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+static const char *inputStrideError(void) {
+        GLint row_length, alignment;
+        if (_geo.in_stride < (size_t)_geo.width * 3) {
+                return "input stride shorter than a row";
+        }
+        if (!oglRowStrideParams(_geo.width, 3, _geo.in_stride,
+                &row_length, &alignment))
+        {
+                return "input stride is not a multiple of 3 or an alignment";
+        }
+        return NULL;
+}
 
-        ogl(glGenFramebuffers(1, &_fb_rgb2yuv));
-        ogl(glGenTextures(1, &_texture_rgb2yuv_fb));
-        ogl(glBindTexture(GL_TEXTURE_2D, _texture_rgb2yuv_fb));
-        ogl(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, TEX_WIDTH, TEX_HEIGHT, 0,
-                GL_RGB, GL_UNSIGNED_BYTE, NULL));
-        ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
-        ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
-        ogl(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP));
-        ogl(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP));
-        ogl(glBindTexture(GL_TEXTURE_2D, 0));
+static const char *strideError(void) {
+        if (_geo.y_stride < (size_t)_geo.width
+                || _geo.uv_stride < (size_t)chromaWidth() * 2)
+        {
+                return "stride shorter than a row";
+        }
+        return inputStrideError();
 }
 
-static void renderTexturedQuad(bool inverted) {
-        ogl(glClearColor(0, 1, 0, 1));
-        ogl(glUseProgram(_program_id));
+/* returns why mode cannot produce the current geometry, NULL if it can */
+static const char *geometryError(OutputMode mode) {
+        GLint row_length, alignment;
+        if (mode == OUTPUT_ENGINE) {
+                /* the plane strides depend on the format */
+                if (inputStrideError()) {
+                        return inputStrideError();
+                }
+                return yuvLayoutError(&_layout);
+        }
+        if (mode == OUTPUT_SCALED) {
+                if (!_scale_width) {
+                        return "scaled needs --scale";
+                }
+                /* a fragment converts a 2x2 block */
+                if (_scale_width % 2 || _scale_height % 2) {
+                        return "scaled needs an even --scale";
+                }
+                if (inputStrideError()) {
+                        return inputStrideError();
+                }
+                return yuvLayoutError(&_scaled_layout);
+        }
+        if (mode == OUTPUT_LADDER) {
+                if (!_ladder_count) {
+                        return "ladder needs --ladder";
+                }
+                for (int i = 0; i < _ladder_count; i++) {
+                        if (_ladder_sizes[i][0] % 2
+                                || _ladder_sizes[i][1] % 2)
+                        {
+                                return "ladder needs even --ladder sizes";
+                        }
+                }
+                if (_yuv_y_stride || _yuv_uv_stride) {
+                        return "ladder renditions have tight rows";
+                }
+                return inputStrideError();
+        }
+        if (strideError()) {
+                return strideError();
+        }
+
+        switch (mode) {
+        case OUTPUT_PACKED:
+                /* packed rows hold 3 luma, the UV section starts at h / 3 */
+                if (_geo.width % 2 || _geo.height % 6) {
+                        return "packed needs an even width and height % 6 == 0";
+                }
+                if (_geo.y_stride != (size_t)_geo.width
+                        || _geo.uv_stride != (size_t)_geo.width)
+                {
+                        return "packed output cannot be padded";
+                }
+                /* the shader's linear pixel index is a float */
+                if ((size_t)_geo.width * _geo.height * 3 > (1 << 24)) {
+                        return "packed is limited to 5.5 Mpixel frames";
+                }
+                return NULL;
+        case OUTPUT_PLANAR:
+                if (!oglRowStrideParams(chromaWidth(), 2, _geo.uv_stride,
+                        &row_length, &alignment))
+                {
+                        return "UV stride must be even";
+                }
+                return NULL;
+        case OUTPUT_LUMA4:
+                if (_geo.width % 4 || _geo.height % 2) {
+                        return "luma4 needs width % 4 == 0 and an even height";
+                }
+                /* even and odd luma rows interleave at twice the Y stride */
+                if (_geo.y_stride % 2 || _geo.uv_stride % 4) {
+                        return "luma4 needs an even Y stride and UV stride "
+                                "% 4 == 0";
+                }
+                return NULL;
+        default:
+                return NULL;
+        }
+}
 
-        ogl(_texture_location_in_shader = glGetUniformLocation(_program_id, "tex_input"));
-        ogl(glUniform1i(_texture_location_in_shader, 0));
+static GLuint _program_texture;
+static GLuint _program_rgb2yuv;
+static GLuint _program_rgb2y;
+static GLuint _program_rgb2uv;
+static GLuint _program_luma4;
+static GLuint _texture;
+static GLuint _sampler_linear;
+
+/* 0 when the context has no compute shaders */
+static GLuint _program_compute;
+static GLuint _ssbo_nv12;
+
+/* the fragment shader modes, all drawing the one quad */
+static FilterQuad _quad;
+static FilterGraph _graph_packed;
+static FilterGraph _graph_planar;
+static FilterGraph _graph_luma4;
+/* only built with --scale */
+static FilterGraph _graph_scaled;
+static Scaler _scaler;
+/* only built with --ladder */
+static FilterGraph _graph_ladder;
+static ScaleLadder _ladder;
+
+static ReadbackRing _readback;
+static YuvEngine _engine;
+/* owns every program, see --program-cache */
+static ProgramCache _programs;
+
+/* GPU time of each stage of a frame, see --timing */
+static GpuTimer _timer;
+static int _stage_upload;
+static int _stage_copy;
+static int _stage_convert;
+static int _stage_readback;
+
+/* starts compiling, the graphs look up the uniforms once it is linked */
+static GLuint setGlProgram(const char *frag_source, const char *vert_source) {
+        ProgramDesc desc;
+        programDescInit(&desc);
+        programDescAddStage(&desc, GL_VERTEX_SHADER, 1, &vert_source);
+        programDescAddStage(&desc, GL_FRAGMENT_SHADER, 1, &frag_source);
+        desc.attrib[0] = "position";
+        desc.attrib[1] = "texcoord";
+        desc.frag_out = "out_color";
+        return programCacheRequest(&_programs, &desc);
+}
 
-        ogl(glBindVertexArray(_vao));
+static void setGlProgramForRgb2Yuv(void) {
+#ifndef SKIP_YUVCONV
+        _program_rgb2yuv = setGlProgram(frag_rgb2yuv, vert_passthru);
+#else
+        _program_rgb2yuv = setGlProgram(frag_texture, vert_passthru);
+#endif
+}
 
-        ogl(glBindBuffer(GL_ARRAY_BUFFER, _vbo));
-        if (inverted) {
-                ogl(glBufferData(GL_ARRAY_BUFFER, sizeof(QuadData),
-                        QuadData_inverted, GL_STATIC_DRAW));
+/*
+ * Every program is requested before the first one is used, so they all
+ * compile at once where the driver has compiler threads.
+ */
+static void initializePrograms(void) {
+        _program_texture = setGlProgram(frag_texture, vert_passthru);
+        setGlProgramForRgb2Yuv();
+        _program_rgb2y = setGlProgram(frag_rgb2y, vert_passthru);
+        _program_rgb2uv = setGlProgram(frag_rgb2uv, vert_passthru);
+        _program_luma4 = setGlProgram(frag_rgb2nv12_luma4, vert_passthru);
+        if (_scale_width) {
+                scalerInit(&_scaler, &_programs, _scale_filter,
+                        _geo.width, _geo.height, _scale_width, _scale_height);
         }
-        else {
-                ogl(glBufferData(GL_ARRAY_BUFFER, sizeof(QuadData),
-                        QuadData, GL_STATIC_DRAW));
+        if (_ladder_count) {
+                scaleLadderInit(&_ladder, &_programs, _scale_filter,
+                        _geo.width, _geo.height, _ladder_count,
+                        _ladder_sizes, _ladder_chain);
         }
+        _program_compute = 0;
+        if (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object) {
+                ProgramDesc desc;
+                programDescInit(&desc);
+                programDescAddStage(&desc, GL_COMPUTE_SHADER, 1,
+                        &comp_rgb2nv12);
+                _program_compute = programCacheRequest(&_programs, &desc);
+        }
+        programCacheFinish(&_programs);
 
-        ogl(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _vbo_idx));
-        ogl(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                sizeof(QuadIndices), QuadIndices, GL_STATIC_DRAW));
+        if (_program_compute && !programCacheLinked(_program_compute)) {
+                _program_compute = 0;
+        }
+}
 
-        ogl(glVertexAttribPointer(_position_attr, VertexStride,
-                GL_FLOAT, GL_FALSE, 0,
-                (GLvoid *) (CoordOffset * sizeof(GLfloat))));
-        ogl(glVertexAttribPointer(_tex_coord_attr, TexCoordStride,
-                GL_FLOAT, GL_FALSE, 0,
-                (GLvoid *) (TexCoordOffset * sizeof(GLfloat))));
+/* a pass converting "input" into the given targets at frame size */
+static int addConversionPass(FilterGraph *graph, const char *name,
+        GLuint program, int flags, GLuint sampler)
+{
+        int pass = filterGraphAddPass(graph, name, program, flags);
+        filterPassRead(graph, pass, "input", "tex_input", sampler);
+        filterPassUniform2f(graph, pass, "framesize",
+                _geo.width, _geo.height);
+        return pass;
+}
 
-        ogl(glEnableVertexAttribArray(_position_attr));
-        ogl(glEnableVertexAttribArray(_tex_coord_attr));
+/*
+ * One graph per fragment shader mode. Each reads the "input" texture and
+ * leaves the frame in targets queueReadback() reads by name.
+ */
+static void initializeGraphs(void) {
+        /* the input stays GL_NEAREST, only the chroma fetch filters */
+        ogl(glGenSamplers(1, &_sampler_linear));
+        ogl(glSamplerParameteri(_sampler_linear, GL_TEXTURE_MIN_FILTER,
+                GL_LINEAR));
+        ogl(glSamplerParameteri(_sampler_linear, GL_TEXTURE_MAG_FILTER,
+                GL_LINEAR));
+        ogl(glSamplerParameteri(_sampler_linear, GL_TEXTURE_WRAP_S,
+                GL_CLAMP_TO_EDGE));
+        ogl(glSamplerParameteri(_sampler_linear, GL_TEXTURE_WRAP_T,
+                GL_CLAMP_TO_EDGE));
+
+        FilterGraph *graph = &_graph_packed;
+        filterGraphInit(graph, &_quad, &_programs);
+        filterGraphAddInput(graph, "input", _geo.width, _geo.height);
+        filterGraphAddTarget(graph, "rgb", _geo.width, _geo.height, GL_RGB8);
+        /* headless contexts have no default framebuffer to hold it */
+        filterGraphAddTarget(graph, "packed", _geo.width, _geo.height,
+                GL_RGB8);
+        int pass = filterGraphAddPass(graph, "copy", _program_texture,
+                FILTER_INVERTED);
+        filterPassRead(graph, pass, "input", "tex_input", 0);
+        filterPassWrite(graph, pass, "rgb");
+        pass = filterGraphAddPass(graph, "rgb2yuv", _program_rgb2yuv,
+                FILTER_INVERTED | FILTER_CLEAR);
+        filterPassRead(graph, pass, "rgb", "tex_input", 0);
+        filterPassUniform2f(graph, pass, "framesize",
+                _geo.width, _geo.height);
+        filterPassWrite(graph, pass, "packed");
+        filterGraphCompile(graph);
+
+        graph = &_graph_planar;
+        filterGraphInit(graph, &_quad, &_programs);
+        filterGraphAddInput(graph, "input", _geo.width, _geo.height);
+        filterGraphAddTarget(graph, "y", _geo.width, _geo.height, GL_R8);
+        filterGraphAddTarget(graph, "uv", chromaWidth(), chromaHeight(),
+                GL_RG8);
+        pass = addConversionPass(graph, "rgb2y", _program_rgb2y,
+                FILTER_INVERTED, 0);
+        filterPassWrite(graph, pass, "y");
+        pass = addConversionPass(graph, "rgb2uv", _program_rgb2uv,
+                FILTER_INVERTED, _sampler_linear);
+        filterPassWrite(graph, pass, "uv");
+        filterGraphCompile(graph);
+
+        graph = &_graph_luma4;
+        filterGraphInit(graph, &_quad, &_programs);
+        filterGraphAddInput(graph, "input", _geo.width, _geo.height);
+        filterGraphAddTarget(graph, "even", _geo.width / 4, _geo.height / 2,
+                GL_RGBA8);
+        filterGraphAddTarget(graph, "odd", _geo.width / 4, _geo.height / 2,
+                GL_RGBA8);
+        filterGraphAddTarget(graph, "uv", _geo.width / 4, _geo.height / 2,
+                GL_RGBA8);
+        pass = addConversionPass(graph, "rgb2nv12_luma4", _program_luma4,
+                FILTER_INVERTED, 0);
+        filterPassWrite(graph, pass, "even");
+        filterPassWrite(graph, pass, "odd");
+        filterPassWrite(graph, pass, "uv");
+        filterGraphCompile(graph);
+
+        if (_scale_width) {
+                graph = &_graph_scaled;
+                filterGraphInit(graph, &_quad, &_programs);
+                filterGraphAddInput(graph, "input", _geo.width, _geo.height);
+                scalerAddPasses(&_scaler, graph, "input", "");
+                filterGraphCompile(graph);
+                scalerSetInputs(&_scaler, graph);
+        }
 
-        ogl(glDrawElements(GL_TRIANGLES, NumIndices, GL_UNSIGNED_INT, 0));
+        if (_ladder_count) {
+                graph = &_graph_ladder;
+                filterGraphInit(graph, &_quad, &_programs);
+                filterGraphAddInput(graph, "input", _geo.width, _geo.height);
+                scaleLadderAddPasses(&_ladder, graph, "input");
+                filterGraphCompile(graph);
+                scaleLadderSetInputs(&_ladder, graph);
+        }
+}
 
-        ogl(glDisableVertexAttribArray(_tex_coord_attr));
-        ogl(glDisableVertexAttribArray(_position_attr));
+/* NULL for the modes not drawn with a graph */
+static const FilterGraph *modeGraph(OutputMode mode) {
+        switch (mode) {
+        case OUTPUT_PACKED:
+                return &_graph_packed;
+        case OUTPUT_PLANAR:
+                return &_graph_planar;
+        case OUTPUT_LUMA4:
+                return &_graph_luma4;
+        case OUTPUT_SCALED:
+                return &_graph_scaled;
+        case OUTPUT_LADDER:
+                return &_graph_ladder;
+        default:
+                return NULL;
+        }
+}
 
-        ogl(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
-        ogl(glBindBuffer(GL_ARRAY_BUFFER, 0));
-        ogl(glBindVertexArray(0));
+static void destroyGraphs(void) {
+        filterGraphDestroy(&_graph_packed);
+        filterGraphDestroy(&_graph_planar);
+        filterGraphDestroy(&_graph_luma4);
+        if (_scale_width) {
+                filterGraphDestroy(&_graph_scaled);
+                scalerDestroy(&_scaler);
+        }
+        if (_ladder_count) {
+                filterGraphDestroy(&_graph_ladder);
+                scaleLadderDestroy(&_ladder);
+        }
+        filterQuadDestroy(&_quad);
+        ogl(glDeleteSamplers(1, &_sampler_linear));
 }
 
-/*****************************************************************************
- * Rendering RGB to YUV
- ****************************************************************************/
-static void uploadTexture(void) {
-        FILE *fin = fopen("cat_1024_768.rgb", "rb");
-        if (!fin) {
-                perror("fopen");
-                exit(-1);
+static void initializeCompute(void) {
+        /* no compute shaders, or the program did not link */
+        if (!_program_compute) {
+                return;
         }
 
-        size_t buf_size = TEX_WIDTH * TEX_HEIGHT * 3;
-        void *buf = malloc(buf_size);
-        if (!buf) {
-                perror("malloc");
+        GLint location;
+        ogl(glUseProgram(_program_compute));
+        ogl(location = glGetUniformLocation(_program_compute, "tex_input"));
+        ogl(glUniform1i(location, 0));
+        ogl(location = glGetUniformLocation(_program_compute, "framesize"));
+        ogl(glUniform2i(location, _geo.width, _geo.height));
+        ogl(location = glGetUniformLocation(_program_compute, "y_stride"));
+        ogl(glUniform1i(location, _geo.y_stride));
+        ogl(location = glGetUniformLocation(_program_compute, "uv_stride"));
+        ogl(glUniform1i(location, _geo.uv_stride));
+        ogl(location = glGetUniformLocation(_program_compute, "uv_offset"));
+        ogl(glUniform1i(location, ySize()));
+
+        /* whole words, the tail of the last one is never read back */
+        ogl(glGenBuffers(1, &_ssbo_nv12));
+        ogl(glBindBuffer(GL_SHADER_STORAGE_BUFFER, _ssbo_nv12));
+        ogl(glBufferData(GL_SHADER_STORAGE_BUFFER,
+                (ySize() + uvSize() + 3) & ~(size_t)3, NULL, GL_DYNAMIC_COPY));
+        ogl(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+}
+
+/*
+ * Everything here lives for the whole run: programs, quad geometry, the
+ * input texture storage and the filter graphs' targets are set up once
+ * and reused for every frame.
+ */
+static void initializeContext(void) {
+        GLint max_size;
+        ogl(glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size));
+        if (_geo.width > max_size || _geo.height > max_size) {
+                printf("%dx%d exceeds GL_MAX_TEXTURE_SIZE %d\n",
+                        _geo.width, _geo.height, max_size);
                 exit(-1);
         }
-
-        if (1 != fread(buf, buf_size, 1, fin)) {
-                perror("fread");
+        if (_scale_width > max_size || _scale_height > max_size) {
+                printf("--scale=%dx%d exceeds GL_MAX_TEXTURE_SIZE %d\n",
+                        _scale_width, _scale_height, max_size);
                 exit(-1);
         }
+        for (int i = 0; i < _ladder_count; i++) {
+                if (_ladder_sizes[i][0] > max_size
+                        || _ladder_sizes[i][1] > max_size)
+                {
+                        printf("--ladder size %dx%d exceeds "
+                                "GL_MAX_TEXTURE_SIZE %d\n",
+                                _ladder_sizes[i][0], _ladder_sizes[i][1],
+                                max_size);
+                        exit(-1);
+                }
+        }
+
+        ogl(glGenTextures(1, &_texture));
+
+        initializePrograms();
+        filterQuadInit(&_quad);
+
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        ogl(glClearColor(0, 1, 0, 1));
 
         ogl(glActiveTexture(GL_TEXTURE0));
         ogl(glBindTexture(GL_TEXTURE_2D, _texture));
-
         ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
         ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
         ogl(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP));
         ogl(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP));
+        /* input storage is allocated once, frames only replace its contents */
+        if (GLEW_ARB_texture_storage) {
+                ogl(glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGB8,
+                        _geo.width, _geo.height));
+        }
+        else {
+                ogl(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8,
+                        _geo.width, _geo.height,
+                        0, GL_RGB,
+                        GL_UNSIGNED_BYTE, NULL));
+        }
 
-        ogl(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
-                TEX_WIDTH, TEX_HEIGHT,
-                0, GL_RGB,
-                GL_UNSIGNED_BYTE, buf));
+        initializeGraphs();
+        initializeCompute();
 
-        fclose(fin);
-        free(buf);
+        ogl(glPixelStorei(GL_PACK_ALIGNMENT, 1));
+        oglSetRowStride(GL_UNPACK_ROW_LENGTH, GL_UNPACK_ALIGNMENT,
+                _geo.width, 3, _geo.in_stride);
+        ogl(glPixelStorei(GL_PACK_ROW_LENGTH, 0));
+        ogl(glPixelStorei(GL_PACK_SKIP_ROWS, 0));
+        ogl(glPixelStorei(GL_PACK_SKIP_PIXELS, 0));
 }
 
-static void renderFbToYuv(void) {
-        ogl(glBindFramebuffer(GL_FRAMEBUFFER, 0));
-        ogl(glViewport(0, 0, TEX_WIDTH, TEX_HEIGHT));
-        ogl(glClear(GL_COLOR_BUFFER_BIT));
-        setGlProgramForRgb2Yuv();
-        ogl(glBindTexture(GL_TEXTURE_2D, _texture_rgb2yuv_fb));
-        renderTexturedQuad(true);
+static void drawEngineQuad(GLuint program) {
+        ogl(glUseProgram(program));
+        filterQuadDraw(&_quad, true);
 }
 
-static void writeToFile(void *data, size_t size, const char *fname)
+/*****************************************************************************
+ * Misc helpers
+ ****************************************************************************/
+static bool readFromFile(void *data, size_t size, const char *fname)
 {
-        FILE *fout = fopen(fname, "wb");
-        if (!fout) {
-                perror("fopen");
-                exit (-1);
-        }
-
-        if (1 != fwrite(data, size, 1, fout)) {
-                perror("fwrite");
-                exit (-1);
+        FILE *fin = fopen(fname, "rb");
+        if (!fin) {
+                return false;
         }
 
-        fclose(fout);
+        bool ok = (1 == fread(data, size, 1, fin));
+        fclose(fin);
+        return ok;
 }
 
-static void dumpOutputToFile(void) {
-        size_t buf_size = TEX_WIDTH * TEX_HEIGHT * 3;
-        char *buf = (char*)malloc(buf_size);
+static void *mallocOrDie(size_t size) {
+        void *buf = malloc(size);
         if (!buf) {
                 perror("malloc");
-                exit (-1);
+                exit(-1);
         }
-        ogl(glFinish());
-        ogl(glPixelStorei(GL_PACK_ALIGNMENT, 1));
-        ogl(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
-        ogl(glPixelStorei(GL_PACK_ROW_LENGTH, 0));
-        ogl(glPixelStorei(GL_PACK_SKIP_ROWS, 0));
-        ogl(glPixelStorei(GL_PACK_SKIP_PIXELS, 0));
-        ogl(glReadPixels(0, 0, TEX_WIDTH, TEX_HEIGHT,
-                GL_RGB, GL_UNSIGNED_BYTE, buf));
+        return buf;
+}
 
-#ifndef SKIP_YUVCONV
-        buf_size >>= 1;
-#endif
-        writeToFile(buf, buf_size, "out.bin");
-        writeToFile(buf, TEX_WIDTH * TEX_HEIGHT, "y.bin");
-        writeToFile(buf + TEX_WIDTH * TEX_HEIGHT,
-                TEX_WIDTH * TEX_HEIGHT / 2, "uv.bin");
-        free(buf);
-}
-
-int main(void) {
-        glfwInit();
-        glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-#ifndef SHOW_IMAGE
-        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
-#endif
-        glfwWindowHint(GLFW_ALPHA_BITS, 0);
-        glfwWindowHint(GLFW_DEPTH_BITS, 0);
-        glfwWindowHint(GLFW_STENCIL_BITS, 0);
-        GLFWwindow* window = glfwCreateWindow(TEX_WIDTH, TEX_HEIGHT,
-                "OpenGL", NULL, NULL);
-        glfwMakeContextCurrent(window);
+/*
+ * Reads the first frame of the input opened by main(). Mapped input is
+ * used in place and stays open until releaseInput().
+ */
+static const uint8_t *loadInput(FrameReader *reader) {
+        if (frameReaderMapped(reader)) {
+                const void *frame = frameReaderNextMapped(reader);
+                if (!frame) {
+                        printf("no complete %dx%d frame in the input\n",
+                                _geo.width, _geo.height);
+                        exit(-1);
+                }
+                return (const uint8_t*)frame;
+        }
 
-        glewExperimental = GL_TRUE;
-        glewInit();
+        uint8_t *rgb = (uint8_t*)mallocOrDie(inputSize());
+        if (!frameReaderNext(reader, rgb)) {
+                printf("no complete %dx%d frame in the input\n",
+                        _geo.width, _geo.height);
+                exit(-1);
+        }
+        frameReaderClose(reader);
+        return rgb;
+}
 
-        initializeContext();
-        uploadTexture();
+/* rgb is NULL if the input was never loaded */
+static void releaseInput(FrameReader *reader, const uint8_t *rgb) {
+        if (!reader->map) {
+                free((void*)rgb);
+        }
+        frameReaderClose(reader);
+}
 
-        ogl(glBindFramebuffer(GL_FRAMEBUFFER, _fb_rgb2yuv));
-        ogl(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                GL_TEXTURE_2D, _texture_rgb2yuv_fb, 0));
+/*****************************************************************************
+ * Rendering RGB to YUV
+ ****************************************************************************/
+static void uploadTexture(const void *rgb) {
+        gpuTimerStart(&_timer, _stage_upload);
+        ogl(glActiveTexture(GL_TEXTURE0));
+        ogl(glBindTexture(GL_TEXTURE_2D, _texture));
+        ogl(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+                _geo.width, _geo.height,
+                GL_RGB, GL_UNSIGNED_BYTE, rgb));
+        gpuTimerStop(&_timer, _stage_upload);
+}
 
-        GLenum status;
-        ogl(status = glCheckFramebufferStatus(GL_FRAMEBUFFER));
-        if (status != GL_FRAMEBUFFER_COMPLETE) {
-                puts("failed binding framebuffer");
-                exit(-1);
+static void renderCompute(void) {
+        GLuint zero = 0;
+        ogl(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _ssbo_nv12));
+        ogl(glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI,
+                GL_RED_INTEGER, GL_UNSIGNED_INT, &zero));
+
+        ogl(glActiveTexture(GL_TEXTURE0));
+        ogl(glBindTexture(GL_TEXTURE_2D, _texture));
+        ogl(glUseProgram(_program_compute));
+        ogl(glDispatchCompute((chromaWidth() + 7) / 8,
+                (chromaHeight() + 7) / 8, 1));
+        ogl(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0));
+}
+
+/* packed mode times its copy pass separately from the conversion */
+static void renderFrame(void) {
+        /* the pipeline swaps _texture every frame */
+        filterGraphSetInput(&_graph_packed, "input", _texture);
+        filterGraphSetInput(&_graph_planar, "input", _texture);
+        filterGraphSetInput(&_graph_luma4, "input", _texture);
+        if (_scale_width) {
+                filterGraphSetInput(&_graph_scaled, "input", _texture);
+        }
+        if (_ladder_count) {
+                filterGraphSetInput(&_graph_ladder, "input", _texture);
         }
-        /* render the scene */
-        renderTexturedQuad(true);
-        renderFbToYuv();
-        dumpOutputToFile();
 
-#ifdef SHOW_IMAGE
-        while (!glfwWindowShouldClose(window)) {
-                glfwSwapBuffers(window);
-                glfwPollEvents();
+        if (_output_mode == OUTPUT_PACKED) {
+                gpuTimerStart(&_timer, _stage_copy);
+                filterGraphRunPasses(&_graph_packed, 0, 1);
+                gpuTimerStop(&_timer, _stage_copy);
+        }
+
+        gpuTimerStart(&_timer, _stage_convert);
+        switch (_output_mode) {
+        case OUTPUT_PLANAR:
+                filterGraphRun(&_graph_planar);
+                break;
+        case OUTPUT_LUMA4:
+                filterGraphRun(&_graph_luma4);
+                break;
+        case OUTPUT_SCALED:
+                filterGraphRun(&_graph_scaled);
+                break;
+        case OUTPUT_LADDER:
+                filterGraphRun(&_graph_ladder);
+                break;
+        case OUTPUT_COMPUTE:
+                renderCompute();
+                break;
+        case OUTPUT_ENGINE:
+                yuvEngineRender(&_engine, _texture, _yuv_format,
+                        _yuv_matrix, _yuv_range);
+                break;
+        default:
+                filterGraphRunPasses(&_graph_packed, 1, 1);
+                break;
+        }
+        gpuTimerStop(&_timer, _stage_convert);
+}
+
+/*
+ * Queues the NV12 frame of the current output mode into the readback ring,
+ * laid out with the configured plane strides.
+ */
+static void queueReadback(void) {
+        int qw = _geo.width / 4;
+        int qh = _geo.height / 2;
+
+        gpuTimerStart(&_timer, _stage_readback);
+        switch (_output_mode) {
+        case OUTPUT_PLANAR:
+                filterGraphBindRead(&_graph_planar, "y");
+                oglSetRowStride(GL_PACK_ROW_LENGTH, GL_PACK_ALIGNMENT,
+                        _geo.width, 1, _geo.y_stride);
+                readbackRingRead(&_readback, 0, 0, 0,
+                        _geo.width, _geo.height, GL_RED, GL_UNSIGNED_BYTE);
+                filterGraphBindRead(&_graph_planar, "uv");
+                oglSetRowStride(GL_PACK_ROW_LENGTH, GL_PACK_ALIGNMENT,
+                        chromaWidth(), 2, _geo.uv_stride);
+                readbackRingRead(&_readback, ySize(), 0, 0,
+                        chromaWidth(), chromaHeight(),
+                        GL_RG, GL_UNSIGNED_BYTE);
+                break;
+        case OUTPUT_LUMA4:
+                /* even and odd luma rows interleave through the row length */
+                oglSetRowStride(GL_PACK_ROW_LENGTH, GL_PACK_ALIGNMENT,
+                        qw, 4, 2 * _geo.y_stride);
+                filterGraphBindRead(&_graph_luma4, "even");
+                readbackRingRead(&_readback, 0, 0, 0,
+                        qw, qh, GL_RGBA, GL_UNSIGNED_BYTE);
+                filterGraphBindRead(&_graph_luma4, "odd");
+                readbackRingRead(&_readback, _geo.y_stride, 0, 0,
+                        qw, qh, GL_RGBA, GL_UNSIGNED_BYTE);
+                filterGraphBindRead(&_graph_luma4, "uv");
+                oglSetRowStride(GL_PACK_ROW_LENGTH, GL_PACK_ALIGNMENT,
+                        qw, 4, _geo.uv_stride);
+                readbackRingRead(&_readback, ySize(), 0, 0,
+                        qw, qh, GL_RGBA, GL_UNSIGNED_BYTE);
+                break;
+        case OUTPUT_COMPUTE:
+                /* the buffer already has the output layout */
+                ogl(glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT));
+                readbackRingCopy(&_readback, 0, _ssbo_nv12, 0,
+                        ySize() + uvSize());
+                break;
+        case OUTPUT_ENGINE:
+                yuvEngineReadback(&_engine, &_readback, &_layout);
+                break;
+        case OUTPUT_SCALED:
+                scalerReadback(&_scaler, &_graph_scaled, &_readback,
+                        &_scaled_layout, 0);
+                break;
+        case OUTPUT_LADDER:
+                /* every rendition shares the slot and its one fence */
+                scaleLadderReadback(&_ladder, &_graph_ladder, &_readback);
+                break;
+        default:
+                /* NV12 fills the lower half of the rgb2yuv target's rows */
+                filterGraphBindRead(&_graph_packed, "packed");
+                oglSetRowStride(GL_PACK_ROW_LENGTH, GL_PACK_ALIGNMENT,
+                        _geo.width, 3, (size_t)_geo.width * 3);
+                readbackRingRead(&_readback, 0, 0, 0, _geo.width, packedRows(),
+                        GL_RGB, GL_UNSIGNED_BYTE);
+                break;
+        }
+        readbackRingCommit(&_readback);
+        gpuTimerStop(&_timer, _stage_readback);
+}
+
+/* where each rendition lands in out.bin and every frame of --output */
+static void printLadder(void) {
+        for (int i = 0; i < _ladder.count; i++) {
+                const ScaleRendition *r = &_ladder.rendition[i];
+                fprintf(stderr, "%dx%d NV12 at %zu, rows from ",
+                        r->scaler.x.dst_size, r->scaler.y.dst_size,
+                        r->offset);
+                if (r->source < 0) {
+                        fprintf(stderr, "the input\n");
+                }
+                else {
+                        fprintf(stderr, "%dx%d\n",
+                                _ladder_sizes[r->source][0],
+                                _ladder_sizes[r->source][1]);
+                }
+        }
+}
+
+/* y.bin and uv.bin, YUY2 has no separate chroma plane */
+static void exportPlanes(const MappedFile *out, size_t y_size) {
+        bool ok = mappedFileExport(out, "y.bin", 0, y_size);
+        if (ok && out->size > y_size) {
+                ok = mappedFileExport(out, "uv.bin", y_size,
+                        out->size - y_size);
+        }
+        if (!ok) {
+                exit(-1);
+        }
+}
+
+static void dumpOutputToFile(void) {
+        /* the engine's first plane goes to y.bin, the rest to uv.bin */
+        size_t y_size = ySize();
+        if (_output_mode == OUTPUT_ENGINE) {
+                y_size = _layout.plane[0].stride * _layout.plane[0].height;
+        }
+        else if (_output_mode == OUTPUT_SCALED) {
+                y_size = _scaled_layout.plane[1].offset;
+        }
+
+        queueReadback();
+        const void *buf = readbackRingMapOldest(&_readback);
+
+        /* the one copy out of the PBO, the planes are ranges of out.bin */
+        MappedFile out;
+        if (!mappedFileCreate(&out, "out.bin", outputSize())) {
+                exit(-1);
+        }
+        memcpy(out.data, buf, outputSize());
+        readbackRingReleaseOldest(&_readback);
+        /* the renditions are ranges of out.bin, see printLadder() */
+        if (_output_mode != OUTPUT_LADDER) {
+                exportPlanes(&out, y_size);
+        }
+        mappedFileClose(&out);
+}
+
+/*****************************************************************************
+ * Tiles
+ *
+ * A frame too large for one texture is converted a window at a time, see
+ * tiles.h. _geo is the window's geometry with tight rows then, so every
+ * mode renders and reads a window back as if it were a frame, and only
+ * the tile in it is written to out.bin with the frame's plane strides.
+ ****************************************************************************/
+/* the whole frame while _geo is a window */
+static FrameGeometry _frame;
+static YuvLayout _frame_layout;
+
+/* the planes the output mode reads back at _geo, packed has none */
+static void outputLayout(YuvLayout *layout) {
+        if (_output_mode == OUTPUT_ENGINE) {
+                *layout = _layout;
+                return;
+        }
+        yuvLayoutInit(layout, YUV_NV12, _geo.width, _geo.height,
+                _geo.y_stride, _geo.uv_stride);
+}
+
+static void setTileWindow(const TileGrid *grid) {
+        _frame = _geo;
+        outputLayout(&_frame_layout);
+        _geo.width = grid->window_width;
+        _geo.height = grid->window_height;
+        _geo.in_stride = 0;
+        _geo.y_stride = 0;
+        _geo.uv_stride = 0;
+        _yuv_y_stride = 0;
+        _yuv_uv_stride = 0;
+        setTightStrides();
+        setYuvLayout(_yuv_format);
+}
+
+/* writes the tile out of the oldest window read back */
+static void writeOldestTile(int fd, const TileGrid *grid, int index,
+        const YuvLayout *window)
+{
+        Tile tile;
+        tileGridGet(grid, index, &tile);
+        const char *buf = (const char*)readbackRingMapOldest(&_readback);
+        bool ok = true;
+        for (int p = 0; ok && p < window->num_planes; p++) {
+                const YuvPlane *src = &window->plane[p];
+                const YuvPlane *dst = &_frame_layout.plane[p];
+                /* chroma and YUY2 texels cover 2 pixels of a row or column */
+                int dx = grid->window_width / src->width;
+                int dy = grid->window_height / src->height;
+                RawRect rect = { (off_t)dst->offset, dst->stride, dst->bpp,
+                        tile.x / dx, tile.y / dy,
+                        tile.width / dx, tile.height / dy };
+                ok = rawRectWrite(fd, &rect, buf + src->offset
+                                + (size_t)(tile.y - tile.window_y) / dy
+                                        * src->stride
+                                + (size_t)(tile.x - tile.window_x) / dx
+                                        * src->bpp,
+                        src->stride);
+        }
+        readbackRingReleaseOldest(&_readback);
+        if (!ok) {
+                exit(-1);
+        }
+}
+
+/*
+ * Converts the raw frame at path into out.bin a tile at a time. Windows
+ * are read while earlier ones are still in the readback ring, so the GPU
+ * works on one while the CPU reads the next.
+ */
+static void renderTiles(const char *path, const TileGrid *grid) {
+        int in = open(path, O_RDONLY);
+        if (in < 0) {
+                perror(path);
+                exit(-1);
+        }
+        int out = open("out.bin", O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (out < 0 || ftruncate(out, _frame_layout.size)) {
+                perror("out.bin");
+                exit(-1);
+        }
+        YuvLayout window;
+        outputLayout(&window);
+        uint8_t *rgb = (uint8_t*)mallocOrDie(inputSize());
+
+        int written = 0;
+        for (int i = 0; i < tileGridCount(grid); i++) {
+                Tile tile;
+                tileGridGet(grid, i, &tile);
+                RawRect src = { 0, _frame.in_stride, 3,
+                        tile.window_x, tile.window_y,
+                        _geo.width, _geo.height };
+                if (!rawRectRead(in, &src, rgb, _geo.in_stride)) {
+                        printf("%s: not a %dx%d frame\n", path,
+                                _frame.width, _frame.height);
+                        exit(-1);
+                }
+                gpuTimerBeginFrame(&_timer);
+                uploadTexture(rgb);
+                renderFrame();
+                if (readbackRingFull(&_readback)) {
+                        writeOldestTile(out, grid, written++, &window);
+                }
+                queueReadback();
+        }
+        while (!readbackRingEmpty(&_readback)) {
+                writeOldestTile(out, grid, written++, &window);
+        }
+
+        free(rgb);
+        close(in);
+        close(out);
+}
+
+static void timeTiles(const char *path, const TileGrid *grid, int frames) {
+        double start = nowSeconds();
+        for (int i = 0; i < frames; i++) {
+                renderTiles(path, grid);
+        }
+        fprintf(stderr, "frame time %.3f ms over %d frames\n",
+                (nowSeconds() - start) / frames * 1e3, frames);
+}
+
+/*****************************************************************************
+ * Streaming
+ ****************************************************************************/
+static bool writeOldestFrame(FrameWriter *writer) {
+        const void *data = readbackRingMapOldest(&_readback);
+        bool ok = frameWriterWrite(writer, data, outputSize());
+        readbackRingReleaseOldest(&_readback);
+        return ok;
+}
+
+static void printStreamRate(double startup_time, int frames, double elapsed) {
+        fprintf(stderr, "startup %.1f ms, %d frames in %.3f s: "
+                "%.1f fps, %.2f ms/frame\n",
+                startup_time * 1e3, frames, elapsed,
+                elapsed > 0 ? frames / elapsed : 0.0,
+                frames ? elapsed * 1e3 / frames : 0.0);
+}
+
+/*
+ * Converts every frame of the input stream with the GL state created once
+ * by initializeContext() and reports the sustained frame rate. Frames are
+ * read straight into unpack PBOs by the upload ring's reader thread, and
+ * readbacks go through the pack PBO ring, so frame k is copied out while
+ * frame k + 1 renders.
+ */
+static int streamFrames(FrameReader *reader, const char *out_path,
+        int upload_depth, double startup_time)
+{
+        FrameWriter writer;
+        if (!frameWriterOpen(&writer, out_path)) {
+                frameReaderClose(reader);
+                return -1;
+        }
+
+        UploadRing upload;
+        uploadRingInit(&upload, upload_depth, reader->frame_size);
+        uploadRingStart(&upload, reader);
+
+        int frames = 0;
+        bool ok = true;
+        double start = nowSeconds();
+        /* the timer frame starts once there is a frame to time */
+        while (ok && uploadRingWait(&upload)) {
+                gpuTimerBeginFrame(&_timer);
+                gpuTimerStart(&_timer, _stage_upload);
+                uploadRingNext(&upload, _texture, _geo.width, _geo.height,
+                        GL_RGB);
+                gpuTimerStop(&_timer, _stage_upload);
+
+                renderFrame();
+                if (readbackRingFull(&_readback)) {
+                        ok = writeOldestFrame(&writer);
+                }
+                queueReadback();
+                frames++;
+        }
+        while (ok && !readbackRingEmpty(&_readback)) {
+                ok = writeOldestFrame(&writer);
+        }
+        double elapsed = nowSeconds() - start;
+
+        printStreamRate(startup_time, frames, elapsed);
+        uploadRingPrintStats(&upload);
+        readbackRingPrintStats(&_readback, frames);
+        if (_output_mode == OUTPUT_ENGINE) {
+                yuvEnginePrintStats(&_engine);
+        }
+
+        uploadRingDestroy(&upload);
+        frameWriterClose(&writer);
+        frameReaderClose(reader);
+        return ok ? 0 : -1;
+}
+
+/* runs on the render thread, the upload stage is not GPU timed */
+static void renderPipelineFrame(GLuint texture) {
+        gpuTimerBeginFrame(&_timer);
+        /* rebinding makes the upload context's writes visible */
+        _texture = texture;
+        ogl(glActiveTexture(GL_TEXTURE0));
+        ogl(glBindTexture(GL_TEXTURE_2D, _texture));
+        renderFrame();
+        queueReadback();
+}
+
+/*
+ * Same as streamFrames(), but reading and uploading, converting, and
+ * mapping and writing run on three threads, see pipeline.h.
+ */
+static int streamPipeline(GlContext *context, FrameReader *reader,
+        const char *out_path, int depth, double startup_time)
+{
+        FrameWriter writer;
+        if (!frameWriterOpen(&writer, out_path)) {
+                frameReaderClose(reader);
+                return -1;
+        }
+
+        Pipeline pipe;
+        if (!pipelineInit(&pipe, context, depth, _geo.width, _geo.height)) {
+                frameWriterClose(&writer);
+                frameReaderClose(reader);
+                return -1;
+        }
+
+        GLuint texture = _texture;
+        int frames = pipelineRun(&pipe, reader, &writer, outputSize(),
+                &_readback, renderPipelineFrame);
+        _texture = texture;
+
+        printStreamRate(startup_time, pipe.stage[PIPELINE_RENDER].frames,
+                pipe.elapsed);
+        pipelinePrintStats(&pipe);
+        readbackRingPrintStats(&_readback, pipe.stage[PIPELINE_WRITE].frames);
+        if (_output_mode == OUTPUT_ENGINE) {
+                yuvEnginePrintStats(&_engine);
+        }
+
+        pipelineDestroy(&pipe);
+        frameWriterClose(&writer);
+        frameReaderClose(reader);
+        return frames < 0 ? -1 : 0;
+}
+
+/*****************************************************************************
+ * CPU reference conversion
+ ****************************************************************************/
+static void cpuConvert(const uint8_t *rgb, uint8_t *nv12, CpuKernel kernel,
+        int num_threads)
+{
+        cpuRgbToNv12(rgb, _geo.in_stride,
+                nv12, _geo.y_stride,
+                nv12 + ySize(), _geo.uv_stride,
+                _geo.width, _geo.height, kernel, num_threads);
+}
+
+static void convertOnCpu(const uint8_t *rgb, CpuKernel kernel,
+        int num_threads)
+{
+        /* converts straight into out.bin, padding stays zero filled */
+        MappedFile out;
+        if (!mappedFileCreate(&out, "out.bin", ySize() + uvSize())) {
+                exit(-1);
+        }
+        cpuConvert(rgb, (uint8_t*)out.data, kernel, num_threads);
+        exportPlanes(&out, ySize());
+        mappedFileClose(&out);
+}
+
+struct PlaneDiff {
+        int max_err;
+        double mean_err;
+        size_t mismatches;
+};
+
+/* compares row_size bytes of every row, padding is ignored */
+static PlaneDiff diffPlane(const uint8_t *a, const uint8_t *b,
+        size_t row_size, int rows, size_t stride)
+{
+        PlaneDiff d = { 0, 0.0, 0 };
+        unsigned long long sum = 0;
+        for (int y = 0; y < rows; y++) {
+                const uint8_t *ra = a + y * stride;
+                const uint8_t *rb = b + y * stride;
+                for (size_t i = 0; i < row_size; i++) {
+                        int e = abs((int)ra[i] - (int)rb[i]);
+                        if (e) {
+                                d.mismatches++;
+                                sum += e;
+                        }
+                        if (e > d.max_err) {
+                                d.max_err = e;
+                        }
+                }
+        }
+        size_t size = row_size * rows;
+        d.mean_err = size ? (double)sum / size : 0.0;
+        return d;
+}
+
+static PlaneDiff diffY(const uint8_t *a, const uint8_t *b) {
+        return diffPlane(a, b, _geo.width, _geo.height, _geo.y_stride);
+}
+
+static PlaneDiff diffUV(const uint8_t *a, const uint8_t *b) {
+        return diffPlane(a, b, (size_t)chromaWidth() * 2, chromaHeight(),
+                _geo.uv_stride);
+}
+
+static void printDiff(const char *name, PlaneDiff d, size_t size) {
+        printf("  %-8s max err %3d  mean err %7.4f  mismatches %8zu / %zu\n",
+                name, d.max_err, d.mean_err, d.mismatches, size);
+}
+
+/*
+ * Times every supported CPU kernel single- and multi-threaded, checks that
+ * they agree with the scalar kernel bit for bit, and diffs the result
+ * against the out.bin/y.bin/uv.bin dumps written by the GPU path.
+ */
+static void compareWithDumps(const uint8_t *rgb, int num_threads,
+        int iterations)
+{
+        size_t y_size = ySize();
+        size_t nv12_size = y_size + uvSize();
+        size_t y_pixels = (size_t)_geo.width * _geo.height;
+        size_t uv_bytes = (size_t)chromaWidth() * 2 * chromaHeight();
+        uint8_t *ref = (uint8_t*)mallocOrDie(nv12_size);
+        uint8_t *nv12 = (uint8_t*)mallocOrDie(nv12_size);
+        uint8_t *dump = (uint8_t*)mallocOrDie(nv12_size);
+
+        memset(ref, 0, nv12_size);
+        cpuConvert(rgb, ref, CPU_KERNEL_SCALAR, 1);
+
+        printf("%-8s %8s %10s %10s %s\n",
+                "kernel", "threads", "ms/frame", "MB/s", "vs scalar");
+        for (int k = 0; k < CPU_KERNEL_COUNT; k++) {
+                CpuKernel kernel = (CpuKernel)k;
+                if (!cpuKernelSupported(kernel)) {
+                        printf("%-8s %8s\n", cpuKernelName(kernel),
+                                "unsupported");
+                        continue;
+                }
+
+                int thread_counts[] = { 1, num_threads };
+                int num_runs = (num_threads > 1) ? 2 : 1;
+                for (int t = 0; t < num_runs; t++) {
+                        memset(nv12, 0, nv12_size);
+                        double start = nowSeconds();
+                        for (int i = 0; i < iterations; i++) {
+                                cpuConvert(rgb, nv12, kernel,
+                                        thread_counts[t]);
+                        }
+                        double elapsed = (nowSeconds() - start) / iterations;
+
+                        printf("%-8s %8d %10.3f %10.1f %s\n",
+                                cpuKernelName(kernel), thread_counts[t],
+                                elapsed * 1e3,
+                                y_pixels * 3 / elapsed / (1024 * 1024),
+                                memcmp(ref, nv12, nv12_size) ?
+                                        "MISMATCH" : "exact");
+                }
+        }
+
+        puts("CPU reference vs GPU dumps:");
+        if (readFromFile(dump, nv12_size, "out.bin")) {
+                printDiff("out.bin Y", diffY(ref, dump), y_pixels);
+                printDiff("out.bin UV", diffUV(ref + y_size, dump + y_size),
+                        uv_bytes);
+        }
+        else {
+                puts("  out.bin missing, run the GPU path first");
+        }
+        if (readFromFile(dump, y_size, "y.bin")) {
+                printDiff("y.bin", diffY(ref, dump), y_pixels);
+        }
+        if (readFromFile(dump, uvSize(), "uv.bin")) {
+                printDiff("uv.bin", diffUV(ref + y_size, dump), uv_bytes);
+        }
+
+        free(dump);
+        free(nv12);
+        free(ref);
+}
+
+/*****************************************************************************
+ * Output mode benchmark
+ ****************************************************************************/
+static void drainOneReadback(uint8_t *copy) {
+        const void *data = readbackRingMapOldest(&_readback);
+        if (copy) {
+                memcpy(copy, data, outputSize());
+        }
+        readbackRingReleaseOldest(&_readback);
+}
+
+/* whether the current output is the CPU reference's NV12 */
+static bool matchesCpuReference(void) {
+        if (_output_mode == OUTPUT_SCALED || _output_mode == OUTPUT_LADDER) {
+                return false;
+        }
+        return _output_mode != OUTPUT_ENGINE
+                || (_yuv_format == YUV_NV12 && _yuv_matrix == YUV_BT601
+                        && _yuv_range == YUV_RANGE_LIMITED);
+}
+
+/*
+ * Renders and reads back the same frame with every output mode through the
+ * readback ring, and checks the result against the CPU reference. Modes
+ * that cannot produce the configured geometry are skipped.
+ */
+static void benchOutputModes(const uint8_t *rgb, int iterations) {
+        size_t nv12_size = ySize() + uvSize();
+        size_t out_size = nv12_size;
+        for (int m = 0; m < OUTPUT_MODE_COUNT; m++) {
+                _output_mode = (OutputMode)m;
+                if (outputSize() > out_size) {
+                        out_size = outputSize();
+                }
+        }
+        uint8_t *ref = (uint8_t*)mallocOrDie(nv12_size);
+        uint8_t *out = (uint8_t*)mallocOrDie(out_size);
+
+        cpuConvert(rgb, ref, CPU_KERNEL_AUTO, cpuDefaultThreads());
+        uploadTexture(rgb);
+
+        printf("%-8s %10s %8s %10s %10s\n",
+                "mode", "ms/frame", "fps", "Y max err", "UV max err");
+        for (int m = 0; m < OUTPUT_MODE_COUNT; m++) {
+                _output_mode = (OutputMode)m;
+                const char *error = geometryError(_output_mode);
+                if (!error && m == OUTPUT_COMPUTE && !_program_compute) {
+                        error = "no GL 4.3 compute shaders";
+                }
+                if (error) {
+                        printf("%-8s skipped: %s\n", output_mode_names[m],
+                                error);
+                        continue;
+                }
+
+                /* warm up, also gives the frame to check */
+                renderFrame();
+                queueReadback();
+                drainOneReadback(out);
+
+                double start = nowSeconds();
+                for (int i = 0; i < iterations; i++) {
+                        renderFrame();
+                        if (readbackRingFull(&_readback)) {
+                                drainOneReadback(NULL);
+                        }
+                        queueReadback();
+                }
+                while (!readbackRingEmpty(&_readback)) {
+                        drainOneReadback(NULL);
+                }
+                double elapsed = (nowSeconds() - start) / iterations;
+
+                printf("%-8s %10.3f %8.1f", output_mode_names[m],
+                        elapsed * 1e3, 1.0 / elapsed);
+                if (matchesCpuReference()) {
+                        PlaneDiff y = diffY(ref, out);
+                        PlaneDiff uv = diffUV(ref + ySize(), out + ySize());
+                        printf(" %10d %10d", y.max_err, uv.max_err);
+                }
+                printf("\n");
+        }
+
+        free(out);
+        free(ref);
+}
+
+/* largest difference of two byte ranges */
+static int maxDiff(const uint8_t *a, const uint8_t *b, size_t size) {
+        int max_err = 0;
+        for (size_t i = 0; i < size; i++) {
+                int err = abs((int)a[i] - (int)b[i]);
+                max_err = err > max_err ? err : max_err;
+        }
+        return max_err;
+}
+
+/*
+ * One --scale run per rendition: an upload, a graph and a slot each. With
+ * ladder, every rendition is read right away and diffed against it.
+ */
+static void separateRenditions(const uint8_t *rgb, Scaler *scaler,
+        FilterGraph *graph, const uint8_t *ladder)
+{
+        for (int r = 0; r < _ladder_count; r++) {
+                const ScaleRendition *rendition = &_ladder.rendition[r];
+                uploadTexture(rgb);
+                filterGraphRun(&graph[r]);
+                if (readbackRingFull(&_readback)) {
+                        drainOneReadback(NULL);
+                }
+                scalerReadback(&scaler[r], &graph[r], &_readback,
+                        &rendition->layout, 0);
+                readbackRingCommit(&_readback);
+                if (!ladder) {
+                        continue;
+                }
+
+                const uint8_t *data = (const uint8_t*)
+                        readbackRingMapOldest(&_readback);
+                char size[32], source[32] = "input";
+                snprintf(size, sizeof(size), "%dx%d",
+                        _ladder_sizes[r][0], _ladder_sizes[r][1]);
+                if (rendition->source >= 0) {
+                        snprintf(source, sizeof(source), "%dx%d",
+                                _ladder_sizes[rendition->source][0],
+                                _ladder_sizes[rendition->source][1]);
+                }
+                printf("%-10s %-10s %10d\n", size, source,
+                        maxDiff(ladder + rendition->offset, data,
+                                rendition->layout.size));
+                readbackRingReleaseOldest(&_readback);
+        }
+}
+
+/*
+ * Times the ladder against converting every rendition on its own, like
+ * one --scale run per rendition scaling from the input. Both include the
+ * uploads. The diffs show what reading a wider rendition's rows costs.
+ */
+static void benchLadder(const uint8_t *rgb, int iterations) {
+        Scaler scaler[SCALE_MAX_RENDITIONS];
+        FilterGraph graph[SCALE_MAX_RENDITIONS];
+        for (int r = 0; r < _ladder_count; r++) {
+                scalerInit(&scaler[r], &_programs, _scale_filter,
+                        _geo.width, _geo.height, _ladder_sizes[r][0],
+                        _ladder_sizes[r][1]);
+        }
+        programCacheFinish(&_programs);
+        for (int r = 0; r < _ladder_count; r++) {
+                filterGraphInit(&graph[r], &_quad, &_programs);
+                filterGraphAddInput(&graph[r], "input", _geo.width,
+                        _geo.height);
+                scalerAddPasses(&scaler[r], &graph[r], "input", "");
+                filterGraphCompile(&graph[r]);
+                scalerSetInputs(&scaler[r], &graph[r]);
+                filterGraphSetInput(&graph[r], "input", _texture);
+        }
+
+        /* warm up, also gives the renditions to diff */
+        _output_mode = OUTPUT_LADDER;
+        uint8_t *ladder = (uint8_t*)mallocOrDie(_ladder.size);
+        uploadTexture(rgb);
+        renderFrame();
+        queueReadback();
+        drainOneReadback(ladder);
+        printf("%-10s %-10s %10s\n", "rendition", "rows from", "max diff");
+        separateRenditions(rgb, scaler, graph, ladder);
+
+        double start = nowSeconds();
+        for (int i = 0; i < iterations; i++) {
+                uploadTexture(rgb);
+                renderFrame();
+                if (readbackRingFull(&_readback)) {
+                        drainOneReadback(NULL);
+                }
+                queueReadback();
+        }
+        while (!readbackRingEmpty(&_readback)) {
+                drainOneReadback(NULL);
+        }
+        double ladder_time = (nowSeconds() - start) / iterations;
+
+        start = nowSeconds();
+        for (int i = 0; i < iterations; i++) {
+                separateRenditions(rgb, scaler, graph, NULL);
+        }
+        while (!readbackRingEmpty(&_readback)) {
+                drainOneReadback(NULL);
+        }
+        double separate_time = (nowSeconds() - start) / iterations;
+
+        printf("%-10s %10s %8s\n", "", "ms/frame", "fps");
+        printf("%-10s %10.3f %8.1f\n", "ladder", ladder_time * 1e3,
+                1.0 / ladder_time);
+        printf("%-10s %10.3f %8.1f\n", "separate", separate_time * 1e3,
+                1.0 / separate_time);
+        printf("the ladder takes %.0f%% of the time of %d separate runs\n",
+                100.0 * ladder_time / separate_time, _ladder_count);
+
+        for (int r = 0; r < _ladder_count; r++) {
+                filterGraphDestroy(&graph[r]);
+                scalerDestroy(&scaler[r]);
+        }
+        free(ladder);
+}
+
+/*
+ * Renders and reads back the same frame in every engine format with the
+ * selected matrix and range. Each format runs twice, so the second sweep
+ * only hits the variant cache. NV12 with BT.601 limited range is checked
+ * against the CPU reference.
+ */
+static void benchFormats(const uint8_t *rgb, int iterations) {
+        size_t out_size = 0;
+        for (int f = 0; f < YUV_FORMAT_COUNT; f++) {
+                setYuvLayout((YuvFormat)f);
+                if (_layout.size > out_size) {
+                        out_size = _layout.size;
+                }
+        }
+        size_t nv12_size = ySize() + uvSize();
+        uint8_t *ref = (uint8_t*)mallocOrDie(nv12_size);
+        uint8_t *out = (uint8_t*)mallocOrDie(out_size);
+
+        cpuConvert(rgb, ref, CPU_KERNEL_AUTO, cpuDefaultThreads());
+        uploadTexture(rgb);
+        _output_mode = OUTPUT_ENGINE;
+
+        printf("%s %s range\n", yuvMatrixName(_yuv_matrix),
+                yuvRangeName(_yuv_range));
+        printf("%-6s %5s %10s %8s %10s %10s\n",
+                "format", "sweep", "ms/frame", "fps", "MB/s", "Y/UV err");
+        for (int sweep = 0; sweep < 2; sweep++) {
+                for (int f = 0; f < YUV_FORMAT_COUNT; f++) {
+                        setYuvLayout((YuvFormat)f);
+                        const char *error = yuvLayoutError(&_layout);
+                        if (error) {
+                                printf("%-6s skipped: %s\n",
+                                        yuvFormatName(_yuv_format), error);
+                                continue;
+                        }
+
+                        double start = nowSeconds();
+                        renderFrame();
+                        queueReadback();
+                        drainOneReadback(out);
+                        for (int i = 1; i < iterations; i++) {
+                                renderFrame();
+                                if (readbackRingFull(&_readback)) {
+                                        drainOneReadback(NULL);
+                                }
+                                queueReadback();
+                        }
+                        while (!readbackRingEmpty(&_readback)) {
+                                drainOneReadback(NULL);
+                        }
+                        double elapsed = (nowSeconds() - start) / iterations;
+
+                        printf("%-6s %5d %10.3f %8.1f %10.1f",
+                                yuvFormatName(_yuv_format), sweep + 1,
+                                elapsed * 1e3, 1.0 / elapsed,
+                                _layout.size / elapsed / (1024 * 1024));
+                        if (matchesCpuReference() && !strideError()) {
+                                PlaneDiff y = diffY(ref, out);
+                                PlaneDiff uv = diffUV(ref + ySize(),
+                                        out + ySize());
+                                printf(" %5d/%d", y.max_err, uv.max_err);
+                        }
+                        printf("\n");
+                }
+        }
+        yuvEnginePrintStats(&_engine);
+
+        free(out);
+        free(ref);
+}
+
+/*****************************************************************************
+ * Context
+ ****************************************************************************/
+static bool initializeGlew(void) {
+        glewExperimental = GL_TRUE;
+        GLenum status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+        /* a GLX build of GLEW still resolves the entry points under EGL */
+        if (status == GLEW_ERROR_NO_GLX_DISPLAY) {
+                status = GLEW_OK;
+        }
+#endif
+        if (status != GLEW_OK) {
+                printf("glewInit failed: %s\n", glewGetErrorString(status));
+                return false;
+        }
+        oglDebugInit();
+        return true;
+}
+
+/* blits the packed frame into the window until it is closed */
+static void showPackedFrame(GlContext *ctx) {
+        filterGraphBindRead(&_graph_packed, "packed");
+        ogl(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0));
+        ogl(glBlitFramebuffer(0, 0, _geo.width, _geo.height,
+                0, 0, _geo.width, _geo.height,
+                GL_COLOR_BUFFER_BIT, GL_NEAREST));
+        while (!contextShouldClose(ctx)) {
+                contextSwapBuffers(ctx);
+        }
+}
+
+/* creates and destroys a context with every backend compiled in */
+static void benchContexts(void) {
+        printf("%-8s %10s %s\n", "backend", "create ms", "renderer");
+        for (int b = 0; b < CONTEXT_BACKEND_COUNT; b++) {
+                ContextBackend backend = (ContextBackend)b;
+                if (!contextBackendSupported(backend)) {
+                        printf("%-8s %10s\n", contextBackendName(backend),
+                                "not compiled in");
+                        continue;
+                }
+                GlContext context;
+                if (!contextCreate(&context, backend, _geo.width,
+                        _geo.height, 0, 0, false))
+                {
+                        printf("%-8s %10s\n", contextBackendName(backend),
+                                "failed");
+                        continue;
+                }
+                printf("%-8s %10.1f %s\n", contextBackendName(backend),
+                        context.create_time * 1e3,
+                        (const char *)glGetString(GL_RENDERER));
+                contextDestroy(&context);
+        }
+}
+
+/*****************************************************************************
+ * Stage profiling
+ ****************************************************************************/
+static void initializeTimer(bool enabled) {
+        gpuTimerInit(&_timer, TimerDepth, enabled);
+        _stage_upload = gpuTimerAddStage(&_timer, "upload");
+        _stage_copy = gpuTimerAddStage(&_timer, "copy");
+        _stage_convert = gpuTimerAddStage(&_timer, "convert");
+        _stage_readback = gpuTimerAddStage(&_timer, "readback");
+}
+
+/* prints the stage times and writes them to path if there is one */
+static void finishTimer(const char *path) {
+        gpuTimerFlush(&_timer);
+        gpuTimerPrintStats(&_timer);
+        if (path && !gpuTimerWriteCsv(&_timer, path,
+                output_mode_names[_output_mode]))
+        {
+                printf("failed writing %s\n", path);
+        }
+        gpuTimerDestroy(&_timer);
+}
+
+/*
+ * Uploads, converts and reads back the same frame iterations times, so
+ * every stage gets enough samples for stable percentiles.
+ */
+static void profileStages(const uint8_t *rgb, int iterations) {
+        for (int i = 0; i < iterations; i++) {
+                gpuTimerBeginFrame(&_timer);
+                uploadTexture(rgb);
+                renderFrame();
+                if (readbackRingFull(&_readback)) {
+                        drainOneReadback(NULL);
+                }
+                queueReadback();
+        }
+        while (!readbackRingEmpty(&_readback)) {
+                drainOneReadback(NULL);
+        }
+}
+
+/* the mean time of whole frames, see regress.sh */
+static void timeFrames(const uint8_t *rgb, int frames) {
+        double start = nowSeconds();
+        profileStages(rgb, frames);
+        fprintf(stderr, "frame time %.3f ms over %d frames\n",
+                (nowSeconds() - start) / frames * 1e3, frames);
+}
+
+static void usage(const char *argv0) {
+        printf("usage: %s [--cpu | --compare | --stream | --bench] "
+                "[--output-mode=MODE] [--kernel=NAME] "
+                "[--threads=N] [--iterations=N] [--input=PATH] "
+                "[--output=PATH] [--ring=N] [--upload-ring=N] "
+                "[--size=WxH] [--in-stride=N] [--y-stride=N] "
+                "[--uv-stride=N] [--format=FMT] [--matrix=M] "
+                "[--range=R] [--bench-formats] [--context=NAME] "
+                "[--bench-context] [--profile] [--timing=PATH] "
+                "[--pipeline] [--program-cache=DIR] "
+                "[--frame-time=FRAMES] [--tile[=N]] [--scale=WxH] "
+                "[--filter=NAME] [--ladder=WxH,...] [--ladder-direct]\n",
+                argv0);
+        printf("  --cpu          convert on the CPU instead of the GPU\n");
+        printf("  --stream       convert raw RGB24 or Y4M frames from "
+                "--input to NV12 frames on --output\n");
+        printf("  --pipeline     stream with separate upload, convert and "
+                "write threads,\n"
+                "                --upload-ring input textures deep\n");
+        printf("  --input=PATH   raw RGB24 or Y4M 4:4:4 (C444) input, - for "
+                "stdin (default: stdin\n"
+                "                when streaming, %s otherwise)\n",
+                DefaultInput);
+        printf("  --output=PATH  stream output, - for stdout (default)\n");
+        printf("  --size=WxH     raw input frame size (default %dx%d), "
+                "Y4M input sets it from its header\n",
+                DEFAULT_WIDTH, DEFAULT_HEIGHT);
+        printf("  --in-stride=N  bytes per input row (default: tight)\n");
+        printf("  --y-stride=N   bytes per output Y row (default: tight)\n");
+        printf("  --uv-stride=N  bytes per output UV row (default: tight)\n");
+        printf("  --ring=N       readback PBO ring depth (default 3)\n");
+        printf("  --upload-ring=N  upload PBO ring depth (default 3)\n");
+        printf("  --output-mode=MODE  packed (default), planar, luma4, "
+                "compute, engine, scaled or ladder\n");
+        printf("  --format=FMT   engine output: nv12 (default), nv21, i420, "
+                "yuy2 or p010, selects the engine output mode\n");
+        printf("  --matrix=M     engine matrix: bt601 (default), bt709 or "
+                "bt2020\n");
+        printf("  --range=R      engine range: limited (default) or full\n");
+        printf("  --bench-formats  time every engine format on the same "
+                "frame\n");
+        printf("  --scale=WxH    resize to an even WxH on the way to NV12, "
+                "selects the scaled\n"
+                "                output mode\n");
+        printf("  --filter=NAME  scaled and ladder output: bilinear, bicubic "
+                "(default) or lanczos3\n");
+        printf("  --ladder=WxH,...  up to %d even sizes converted from one "
+                "upload into out.bin\n"
+                "                one after the other, selects the ladder "
+                "output mode, with\n"
+                "                --bench also times them against a "
+                "--scale run each\n", SCALE_MAX_RENDITIONS);
+        printf("  --ladder-direct  scale every rendition from the input, "
+                "not from the rows of\n"
+                "                the wider rendition before it\n");
+        printf("  --context=NAME glfw (default) or egl, the surfaceless "
+                "EGL context needs no window system\n");
+        printf("  --bench-context  time context creation with every "
+                "backend\n");
+        printf("  --profile      convert the same frame --iterations times "
+                "with GPU stage timers\n");
+        printf("  --timing=PATH  time every stage on the GPU and write "
+                "min/median/p99 to a CSV file\n");
+        printf("  --program-cache=DIR  program binaries, none to always "
+                "compile\n"
+                "                (default: %s)\n",
+                programCacheDefaultDir() ? programCacheDefaultDir() : "none");
+        printf("  --frame-time=FRAMES  time FRAMES more frames after "
+                "out.bin is written\n");
+        printf("  --tile[=N]     convert a raw --input in tiles of up to "
+                "NxN (default %d) into\n"
+                "                out.bin only, frames larger than a "
+                "texture always are\n", DEFAULT_TILE);
+        printf("  --bench        time every output mode on the same "
+                "frame\n");
+        printf("  --compare      benchmark the CPU kernels and diff them "
+                "against out.bin/y.bin/uv.bin\n");
+        printf("  --kernel=NAME  scalar, ssse3 or avx2 (default: best "
+                "supported)\n");
+}
+
+int main(int argc, char **argv) {
+        bool cpu_mode = false;
+        bool compare_mode = false;
+        bool stream_mode = false;
+        bool pipeline_mode = false;
+        bool bench_mode = false;
+        bool bench_formats = false;
+        bool context_bench = false;
+        bool profile_mode = false;
+        const char *timing_path = NULL;
+        const char *program_dir = programCacheDefaultDir();
+        ContextBackend backend = CONTEXT_GLFW;
+        const char *in_path = NULL;
+        const char *out_path = "-";
+        CpuKernel kernel = CPU_KERNEL_AUTO;
+        int num_threads = cpuDefaultThreads();
+        int iterations = 20;
+        int frame_time = 0;
+        int ring_depth = 3;
+        int upload_depth = 3;
+        int tile_size = 0;
+
+        for (int i = 1; i < argc; i++) {
+                if (!strcmp(argv[i], "--cpu")) {
+                        cpu_mode = true;
+                }
+                else if (!strcmp(argv[i], "--compare")) {
+                        compare_mode = true;
+                }
+                else if (!strcmp(argv[i], "--stream")) {
+                        stream_mode = true;
+                }
+                else if (!strcmp(argv[i], "--pipeline")) {
+                        stream_mode = true;
+                        pipeline_mode = true;
+                }
+                else if (!strncmp(argv[i], "--input=", 8)) {
+                        in_path = argv[i] + 8;
+                }
+                else if (!strncmp(argv[i], "--output=", 9)) {
+                        out_path = argv[i] + 9;
+                }
+                else if (!strncmp(argv[i], "--size=", 7)) {
+                        if (2 != sscanf(argv[i] + 7, "%dx%d",
+                                &_geo.width, &_geo.height)
+                                || _geo.width < 1 || _geo.height < 1)
+                        {
+                                usage(argv[0]);
+                                return -1;
+                        }
+                }
+                else if (!strncmp(argv[i], "--in-stride=", 12)) {
+                        _geo.in_stride = strtoul(argv[i] + 12, NULL, 10);
+                }
+                else if (!strncmp(argv[i], "--y-stride=", 11)) {
+                        _geo.y_stride = strtoul(argv[i] + 11, NULL, 10);
+                }
+                else if (!strncmp(argv[i], "--uv-stride=", 12)) {
+                        _geo.uv_stride = strtoul(argv[i] + 12, NULL, 10);
+                }
+                else if (!strncmp(argv[i], "--ring=", 7)) {
+                        ring_depth = atoi(argv[i] + 7);
+                }
+                else if (!strcmp(argv[i], "--bench")) {
+                        bench_mode = true;
+                }
+                else if (!strncmp(argv[i], "--output-mode=", 14)) {
+                        int m = 0;
+                        while (m < OUTPUT_MODE_COUNT
+                                && strcmp(argv[i] + 14, output_mode_names[m]))
+                        {
+                                m++;
+                        }
+                        if (m == OUTPUT_MODE_COUNT) {
+                                usage(argv[0]);
+                                return -1;
+                        }
+                        _output_mode = (OutputMode)m;
+                }
+                else if (!strncmp(argv[i], "--format=", 9)) {
+                        int f = yuvFormatFromName(argv[i] + 9);
+                        if (f < 0) {
+                                usage(argv[0]);
+                                return -1;
+                        }
+                        _yuv_format = (YuvFormat)f;
+                        _output_mode = OUTPUT_ENGINE;
+                }
+                else if (!strncmp(argv[i], "--matrix=", 9)) {
+                        int m = yuvMatrixFromName(argv[i] + 9);
+                        if (m < 0) {
+                                usage(argv[0]);
+                                return -1;
+                        }
+                        _yuv_matrix = (YuvMatrix)m;
+                        _output_mode = OUTPUT_ENGINE;
+                }
+                else if (!strncmp(argv[i], "--range=", 8)) {
+                        int r = yuvRangeFromName(argv[i] + 8);
+                        if (r < 0) {
+                                usage(argv[0]);
+                                return -1;
+                        }
+                        _yuv_range = (YuvRange)r;
+                        _output_mode = OUTPUT_ENGINE;
+                }
+                else if (!strncmp(argv[i], "--scale=", 8)) {
+                        if (2 != sscanf(argv[i] + 8, "%dx%d",
+                                &_scale_width, &_scale_height)
+                                || _scale_width < 1 || _scale_height < 1)
+                        {
+                                usage(argv[0]);
+                                return -1;
+                        }
+                        _output_mode = OUTPUT_SCALED;
+                }
+                else if (!strncmp(argv[i], "--filter=", 9)) {
+                        int f = scaleFilterFromName(argv[i] + 9);
+                        if (f < 0) {
+                                usage(argv[0]);
+                                return -1;
+                        }
+                        _scale_filter = (ScaleFilter)f;
+                        if (_output_mode != OUTPUT_LADDER) {
+                                _output_mode = OUTPUT_SCALED;
+                        }
+                }
+                else if (!strncmp(argv[i], "--ladder=", 9)) {
+                        if (!parseLadder(argv[i] + 9)) {
+                                usage(argv[0]);
+                                return -1;
+                        }
+                        _output_mode = OUTPUT_LADDER;
+                }
+                else if (!strcmp(argv[i], "--ladder-direct")) {
+                        _ladder_chain = false;
+                }
+                else if (!strncmp(argv[i], "--context=", 10)) {
+                        int b = contextBackendFromName(argv[i] + 10);
+                        if (b < 0) {
+                                usage(argv[0]);
+                                return -1;
+                        }
+                        backend = (ContextBackend)b;
+                }
+                else if (!strcmp(argv[i], "--profile")) {
+                        profile_mode = true;
+                }
+                else if (!strncmp(argv[i], "--timing=", 9)) {
+                        timing_path = argv[i] + 9;
+                }
+                else if (!strncmp(argv[i], "--program-cache=", 16)) {
+                        program_dir = strcmp(argv[i] + 16, "none") ?
+                                argv[i] + 16 : NULL;
+                }
+                else if (!strcmp(argv[i], "--bench-context")) {
+                        context_bench = true;
+                }
+                else if (!strcmp(argv[i], "--bench-formats")) {
+                        bench_formats = true;
+                }
+                else if (!strncmp(argv[i], "--upload-ring=", 14)) {
+                        upload_depth = atoi(argv[i] + 14);
+                }
+                else if (!strncmp(argv[i], "--kernel=", 9)) {
+                        kernel = cpuKernelFromName(argv[i] + 9);
+                }
+                else if (!strncmp(argv[i], "--threads=", 10)) {
+                        num_threads = atoi(argv[i] + 10);
+                }
+                else if (!strncmp(argv[i], "--iterations=", 13)) {
+                        iterations = atoi(argv[i] + 13);
+                }
+                else if (!strncmp(argv[i], "--frame-time=", 13)) {
+                        frame_time = atoi(argv[i] + 13);
+                }
+                else if (!strcmp(argv[i], "--tile")) {
+                        tile_size = DEFAULT_TILE;
+                }
+                else if (!strncmp(argv[i], "--tile=", 7)) {
+                        tile_size = atoi(argv[i] + 7);
+                        if (tile_size < 1) {
+                                usage(argv[0]);
+                                return -1;
+                        }
+                }
+                else {
+                        usage(argv[0]);
+                        return -1;
+                }
+        }
+        if (iterations < 1) {
+                iterations = 1;
+        }
+
+        /* the input decides the geometry before any GL object is sized */
+        if (!in_path) {
+                in_path = stream_mode ? "-" : DefaultInput;
+        }
+        FrameReader reader;
+        if (!frameReaderOpen(&reader, in_path, _geo.width, _geo.height,
+                _geo.in_stride))
+        {
+                return -1;
+        }
+        _geo.width = reader.width;
+        _geo.height = reader.height;
+        _geo.in_stride = reader.stride;
+        _yuv_y_stride = _geo.y_stride;
+        _yuv_uv_stride = _geo.uv_stride;
+        setTightStrides();
+        setYuvLayout(_yuv_format);
+        setScaledLayout();
+
+        /* the benches skip what cannot produce this geometry */
+        const char *error = bench_formats ? inputStrideError()
+                : (bench_mode || cpu_mode || compare_mode) ?
+                strideError() : geometryError(_output_mode);
+        if (error) {
+                printf("%dx%d, %s output: %s\n", _geo.width, _geo.height,
+                        output_mode_names[_output_mode], error);
+                return -1;
+        }
+        if ((_scale_width || _ladder_count) && (cpu_mode || compare_mode)) {
+                puts("--scale and --ladder are converted on the GPU only");
+                return -1;
+        }
+
+        /* loaded once the GL path knows it is not tiled */
+        const uint8_t *rgb = NULL;
+        if (compare_mode || cpu_mode) {
+                rgb = loadInput(&reader);
+        }
+
+        if (compare_mode) {
+                compareWithDumps(rgb, num_threads, iterations);
+                releaseInput(&reader, rgb);
+                return 0;
+        }
+        if (cpu_mode) {
+                convertOnCpu(rgb, kernel, num_threads);
+                releaseInput(&reader, rgb);
+                return 0;
+        }
+
+        if (context_bench) {
+                benchContexts();
+                releaseInput(&reader, rgb);
+                return 0;
+        }
+
+        /* cold and warm starts differ in the program cache only */
+        double launch = nowSeconds();
+        GlContext context;
+        if (!contextCreate(&context, backend, _geo.width, _geo.height,
+                0, 0, ShowImage))
+        {
+                releaseInput(&reader, rgb);
+                return -1;
+        }
+        fprintf(stderr, "%s context created in %.1f ms\n",
+                contextBackendName(backend), context.create_time * 1e3);
+        if (!initializeGlew()) {
+                contextDestroy(&context);
+                releaseInput(&reader, rgb);
+                return -1;
+        }
+
+        int max_size = oglMaxRenderSize();
+        bool tiled = tile_size || _geo.width > max_size
+                || _geo.height > max_size;
+        TileGrid grid;
+        if (tiled) {
+                const char *tile_error = NULL;
+                if (stream_mode || bench_mode || bench_formats
+                        || profile_mode)
+                {
+                        tile_error = "tiles convert a single frame";
+                }
+                else if (reader.y4m || !strcmp(in_path, "-")) {
+                        tile_error = "tiles are read from a raw input file";
+                }
+                else if (_output_mode == OUTPUT_PACKED) {
+                        tile_error = "packed output cannot be tiled";
+                }
+                else if (_output_mode == OUTPUT_SCALED) {
+                        tile_error = "scaled output cannot be tiled";
+                }
+                else if (_output_mode == OUTPUT_LADDER) {
+                        tile_error = "ladder output cannot be tiled";
+                }
+                else if (!tileGridInit(&grid, _geo.width, _geo.height,
+                        tile_size ? tile_size : DEFAULT_TILE, CHROMA_HALO,
+                        max_size, _output_mode == OUTPUT_LUMA4 ? 4 : 2))
+                {
+                        tile_error = "no tiles fit the frame and the "
+                                "largest texture";
+                }
+                if (tile_error) {
+                        printf("%dx%d: %s\n", _geo.width, _geo.height,
+                                tile_error);
+                        contextDestroy(&context);
+                        releaseInput(&reader, rgb);
+                        return -1;
+                }
+                frameReaderClose(&reader);
+                setTileWindow(&grid);
+                fprintf(stderr, "%d tiles of %dx%d in %dx%d windows, "
+                        "halo %d\n", tileGridCount(&grid), grid.tile_width,
+                        grid.tile_height, grid.window_width,
+                        grid.window_height, grid.halo);
+        }
+        else if (!stream_mode) {
+                rgb = loadInput(&reader);
+        }
+
+        programCacheInit(&_programs, program_dir);
+        initializeContext();
+        if (_output_mode == OUTPUT_COMPUTE && !_program_compute) {
+                puts("compute output needs GL 4.3 compute shaders");
+                programCacheDestroy(&_programs);
+                contextDestroy(&context);
+                releaseInput(&reader, rgb);
+                return -1;
+        }
+        yuvEngineInit(&_engine, &_programs, _geo.width, _geo.height,
+                drawEngineQuad);
+        if (_output_mode == OUTPUT_LADDER) {
+                printLadder();
+        }
+        size_t readback_size = outputSize();
+        if (bench_mode && readback_size < ySize() + uvSize()) {
+                readback_size = ySize() + uvSize();
+        }
+        if (bench_mode && readback_size < _scaled_layout.size) {
+                readback_size = _scaled_layout.size;
+        }
+        if (bench_mode && readback_size < ladderSize()) {
+                readback_size = ladderSize();
+        }
+        for (int f = 0; bench_formats && f < YUV_FORMAT_COUNT; f++) {
+                YuvLayout layout;
+                yuvLayoutInit(&layout, (YuvFormat)f, _geo.width, _geo.height,
+                        _yuv_y_stride, _yuv_uv_stride);
+                if (readback_size < layout.size) {
+                        readback_size = layout.size;
+                }
+        }
+        bool benching = bench_mode || bench_formats;
+        readbackRingInit(&_readback,
+                (stream_mode || benching || profile_mode || tiled) ?
+                        ring_depth : 1,
+                readback_size);
+        /* the benches time whole frames, the timers would only add noise */
+        initializeTimer(!benching && (profile_mode || timing_path));
+        double startup = nowSeconds() - launch;
+
+        if (stream_mode) {
+                int ret = pipeline_mode ?
+                        streamPipeline(&context, &reader, out_path,
+                                upload_depth, startup) :
+                        streamFrames(&reader, out_path, upload_depth,
+                                startup);
+                programCachePrintStats(&_programs);
+                finishTimer(timing_path);
+                yuvEngineDestroy(&_engine);
+                destroyGraphs();
+                programCacheDestroy(&_programs);
+                readbackRingDestroy(&_readback);
+                contextDestroy(&context);
+                return ret;
+        }
+
+        if (benching) {
+                if (bench_mode) {
+                        benchOutputModes(rgb, iterations);
+                }
+                if (bench_mode && _ladder_count) {
+                        benchLadder(rgb, iterations);
+                }
+                if (bench_formats) {
+                        benchFormats(rgb, iterations);
+                }
+                releaseInput(&reader, rgb);
+                yuvEngineDestroy(&_engine);
+                destroyGraphs();
+                programCacheDestroy(&_programs);
+                readbackRingDestroy(&_readback);
+                contextDestroy(&context);
+                return 0;
+        }
+
+        if (profile_mode) {
+                profileStages(rgb, iterations);
+                finishTimer(timing_path);
+                releaseInput(&reader, rgb);
+                yuvEngineDestroy(&_engine);
+                destroyGraphs();
+                programCacheDestroy(&_programs);
+                readbackRingDestroy(&_readback);
+                contextDestroy(&context);
+                return 0;
+        }
+
+        /* render the scene */
+        if (tiled) {
+                renderTiles(in_path, &grid);
+        }
+        else {
+                gpuTimerBeginFrame(&_timer);
+                uploadTexture(rgb);
+                renderFrame();
+                dumpOutputToFile();
+        }
+        fprintf(stderr, "first frame %.1f ms after start\n",
+                (nowSeconds() - launch) * 1e3);
+        if (frame_time > 0 && tiled) {
+                timeTiles(in_path, &grid, frame_time);
+        }
+        else if (frame_time > 0) {
+                timeFrames(rgb, frame_time);
+        }
+        programCachePrintStats(&_programs);
+        if (modeGraph(_output_mode)) {
+                filterGraphPrintStats(modeGraph(_output_mode),
+                        output_mode_names[_output_mode]);
+        }
+        finishTimer(timing_path);
+        /* reads the packed graph's target, so before the teardown */
+        if (ShowImage && !tiled) {
+                showPackedFrame(&context);
         }
-#endif
 
-        glfwTerminate();
+        releaseInput(&reader, rgb);
+        yuvEngineDestroy(&_engine);
+        destroyGraphs();
+        programCacheDestroy(&_programs);
+        readbackRingDestroy(&_readback);
+        contextDestroy(&context);
         return 0;
 }
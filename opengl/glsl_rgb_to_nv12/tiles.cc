@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <unistd.h>
+
+#include "tiles.h"
+
+/*****************************************************************************
+ * Tile grids
+ ****************************************************************************/
+/* tile and window size and count along one axis */
+static bool splitAxis(int size, int tile_size, int halo, int max_window,
+        int align, int *tile, int *window, int *count)
+{
+        if (size <= tile_size && size <= max_window) {
+                *tile = size;
+                *window = size;
+                *count = 1;
+                return true;
+        }
+        int t = tile_size < max_window - 2 * halo ?
+                tile_size : max_window - 2 * halo;
+        t = t / align * align;
+        if (t < align) {
+                return false;
+        }
+        *tile = t;
+        *window = t + 2 * halo < size ? t + 2 * halo : size;
+        *count = (size + t - 1) / t;
+        return true;
+}
+
+bool tileGridInit(TileGrid *grid, int width, int height, int tile_size,
+        int halo, int max_window, int align)
+{
+        if (width % align || height % align) {
+                return false;
+        }
+        grid->width = width;
+        grid->height = height;
+        grid->halo = (halo + align - 1) / align * align;
+        return splitAxis(width, tile_size, grid->halo, max_window, align,
+                        &grid->tile_width, &grid->window_width,
+                        &grid->columns)
+                && splitAxis(height, tile_size, grid->halo, max_window,
+                        align, &grid->tile_height, &grid->window_height,
+                        &grid->rows);
+}
+
+static int clampInt(int v, int lo, int hi) {
+        return v < lo ? lo : (v > hi ? hi : v);
+}
+
+void tileGridGet(const TileGrid *grid, int index, Tile *tile) {
+        tile->x = index % grid->columns * grid->tile_width;
+        tile->y = index / grid->columns * grid->tile_height;
+        tile->width = grid->width - tile->x < grid->tile_width ?
+                grid->width - tile->x : grid->tile_width;
+        tile->height = grid->height - tile->y < grid->tile_height ?
+                grid->height - tile->y : grid->tile_height;
+        tile->window_x = clampInt(tile->x - grid->halo, 0,
+                grid->width - grid->window_width);
+        tile->window_y = clampInt(tile->y - grid->halo, 0,
+                grid->height - grid->window_height);
+}
+
+/*****************************************************************************
+ * Raw rectangles
+ ****************************************************************************/
+static off_t rowOffset(const RawRect *rect, int row) {
+        return rect->offset + (off_t)(rect->y + row) * rect->stride
+                + (off_t)rect->x * rect->bpp;
+}
+
+bool rawRectRead(int fd, const RawRect *rect, void *dst, size_t dst_stride) {
+        size_t size = (size_t)rect->width * rect->bpp;
+        for (int row = 0; row < rect->height; row++) {
+                char *p = (char*)dst + row * dst_stride;
+                ssize_t done = pread(fd, p, size, rowOffset(rect, row));
+                if (done != (ssize_t)size) {
+                        if (done < 0) {
+                                perror("pread");
+                        }
+                        return false;
+                }
+        }
+        return true;
+}
+
+bool rawRectWrite(int fd, const RawRect *rect, const void *src,
+        size_t src_stride)
+{
+        size_t size = (size_t)rect->width * rect->bpp;
+        for (int row = 0; row < rect->height; row++) {
+                const char *p = (const char*)src + row * src_stride;
+                if (pwrite(fd, p, size, rowOffset(rect, row))
+                        != (ssize_t)size)
+                {
+                        perror("pwrite");
+                        return false;
+                }
+        }
+        return true;
+}
@@ -0,0 +1,75 @@
+#ifndef __TILES__H__
+#define __TILES__H__
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*****************************************************************************
+ * Tiled frames
+ *
+ * Frames larger than the largest texture, or than the memory one should
+ * take, are rendered a tile at a time. Each tile is rendered from a window
+ * of the input reaching halo pixels past the tile on every side, clamped
+ * to the frame, so effects reading neighbouring pixels see what one
+ * full-frame pass would. Windows all have the same size, the ones at the
+ * frame's edges are shifted inwards, so a graph sized once renders every
+ * tile. Tiles, windows and the halo are multiples of align, 2 keeps
+ * chroma blocks whole.
+ ****************************************************************************/
+struct TileGrid {
+        int width;
+        int height;
+        int tile_width;
+        int tile_height;
+        int halo;
+        int window_width;
+        int window_height;
+        int columns;
+        int rows;
+};
+
+struct Tile {
+        /* the part of the frame the tile produces */
+        int x;
+        int y;
+        int width;
+        int height;
+        /* the input window rendered for it */
+        int window_x;
+        int window_y;
+};
+
+/*
+ * Tiles of at most tile_size pixels squared whose windows fit max_window,
+ * returns false if not even a tile of align pixels does or the frame is
+ * not a multiple of align.
+ */
+bool tileGridInit(TileGrid *grid, int width, int height, int tile_size,
+        int halo, int max_window, int align);
+static inline int tileGridCount(const TileGrid *grid) {
+        return grid->columns * grid->rows;
+}
+void tileGridGet(const TileGrid *grid, int index, Tile *tile);
+
+/*****************************************************************************
+ * Rectangles of raw frames on disk
+ *
+ * Tiles are read from the input and written into the output a row at a
+ * time, so no buffer holds more than a window. Rows of the file are
+ * stride bytes apart from offset on, pixels bpp bytes wide.
+ ****************************************************************************/
+struct RawRect {
+        off_t offset;
+        size_t stride;
+        int bpp;
+        int x;
+        int y;
+        int width;
+        int height;
+};
+
+bool rawRectRead(int fd, const RawRect *rect, void *dst, size_t dst_stride);
+bool rawRectWrite(int fd, const RawRect *rect, const void *src,
+        size_t src_stride);
+
+#endif //__TILES__H__
@@ -0,0 +1,290 @@
+#include "opengl_utils.h"
+#include "upload.h"
+
+static void mapSlot(UploadRing *ring, UploadSlot *slot) {
+        GLbitfield access = GL_MAP_WRITE_BIT;
+        if (ring->persistent) {
+                access |= GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        }
+        else {
+                access |= GL_MAP_INVALIDATE_BUFFER_BIT;
+        }
+        ogl(slot->ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+                ring->size, access));
+        if (!slot->ptr) {
+                puts("failed to map upload buffer");
+                exit(-1);
+        }
+}
+
+void uploadRingInit(UploadRing *ring, int depth, size_t size) {
+        if (depth < 2) {
+                depth = 2;
+        }
+        if (depth > UPLOAD_MAX_DEPTH) {
+                depth = UPLOAD_MAX_DEPTH;
+        }
+
+        ring->depth = depth;
+        ring->size = size;
+        ring->persistent = GLEW_ARB_buffer_storage;
+        ring->fill_idx = 0;
+        ring->submit_idx = 0;
+        ring->eof = false;
+        ring->stop = false;
+        ring->reader = NULL;
+        ring->frames = 0;
+        ring->fill_time = 0.0;
+        ring->starve_time = 0.0;
+        ring->fence_time = 0.0;
+        ring->gpu_ns = 0;
+        ring->call_time = 0.0;
+
+        for (int i = 0; i < depth; i++) {
+                UploadSlot *slot = ring->slot + i;
+                slot->fence = 0;
+                slot->query_pending = false;
+                slot->state = UPLOAD_SLOT_FREE;
+
+                ogl(glGenBuffers(1, &slot->pbo));
+                ogl(glGenQueries(1, &slot->query));
+                ogl(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->pbo));
+                if (ring->persistent) {
+                        ogl(glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL,
+                                GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT
+                                | GL_MAP_COHERENT_BIT));
+                }
+                else {
+                        ogl(glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL,
+                                GL_STREAM_DRAW));
+                }
+                mapSlot(ring, slot);
+        }
+        ogl(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+}
+
+static void collectQuery(UploadRing *ring, UploadSlot *slot) {
+        if (!slot->query_pending) {
+                return;
+        }
+        GLuint64 ns;
+        ogl(glGetQueryObjectui64v(slot->query, GL_QUERY_RESULT, &ns));
+        ring->gpu_ns += ns;
+        slot->query_pending = false;
+}
+
+/* blocks until the GPU is done reading the slot, called without the lock */
+static void waitSlotFence(UploadRing *ring, UploadSlot *slot) {
+        double start = nowSeconds();
+        GLenum status;
+        do {
+                ogl(status = glClientWaitSync(slot->fence,
+                        GL_SYNC_FLUSH_COMMANDS_BIT, 1000000));
+        } while (status == GL_TIMEOUT_EXPIRED);
+        ring->fence_time += nowSeconds() - start;
+
+        ogl(glDeleteSync(slot->fence));
+        slot->fence = 0;
+}
+
+/* hands back every in-flight slot whose upload already completed */
+static void recycleSlots(UploadRing *ring) {
+        bool freed = false;
+        for (int i = 0; i < ring->depth; i++) {
+                UploadSlot *slot = ring->slot + i;
+                if (slot->state != UPLOAD_SLOT_IN_FLIGHT) {
+                        continue;
+                }
+                GLenum status;
+                ogl(status = glClientWaitSync(slot->fence, 0, 0));
+                if (status != GL_ALREADY_SIGNALED
+                        && status != GL_CONDITION_SATISFIED)
+                {
+                        continue;
+                }
+                ogl(glDeleteSync(slot->fence));
+                slot->fence = 0;
+
+                std::lock_guard<std::mutex> guard(ring->lock);
+                slot->state = UPLOAD_SLOT_FREE;
+                freed = true;
+        }
+        if (freed) {
+                ring->cond.notify_all();
+        }
+}
+
+static void readerThread(UploadRing *ring) {
+        for (;;) {
+                UploadSlot *slot;
+                {
+                        std::unique_lock<std::mutex> guard(ring->lock);
+                        slot = ring->slot + ring->fill_idx;
+                        while (!ring->stop
+                                && slot->state != UPLOAD_SLOT_FREE)
+                        {
+                                ring->cond.wait(guard);
+                        }
+                        if (ring->stop) {
+                                return;
+                        }
+                }
+
+                double start = nowSeconds();
+                bool ok = frameReaderNext(ring->reader, slot->ptr);
+                ring->fill_time += nowSeconds() - start;
+
+                {
+                        std::lock_guard<std::mutex> guard(ring->lock);
+                        if (ok) {
+                                slot->state = UPLOAD_SLOT_FILLED;
+                                ring->fill_idx = (ring->fill_idx + 1)
+                                        % ring->depth;
+                        }
+                        else {
+                                ring->eof = true;
+                        }
+                }
+                ring->cond.notify_all();
+                if (!ok) {
+                        return;
+                }
+        }
+}
+
+void uploadRingStart(UploadRing *ring, FrameReader *reader) {
+        ring->reader = reader;
+        ring->thread = std::thread(readerThread, ring);
+}
+
+bool uploadRingWait(UploadRing *ring) {
+        UploadSlot *slot = ring->slot + ring->submit_idx;
+        recycleSlots(ring);
+
+        double start = nowSeconds();
+        {
+                std::unique_lock<std::mutex> guard(ring->lock);
+                while (slot->state != UPLOAD_SLOT_FILLED && !ring->eof) {
+                        /* the reader may be waiting on a slot still in use */
+                        UploadSlot *next = ring->slot + ring->fill_idx;
+                        if (next->state == UPLOAD_SLOT_IN_FLIGHT) {
+                                guard.unlock();
+                                waitSlotFence(ring, next);
+                                guard.lock();
+                                next->state = UPLOAD_SLOT_FREE;
+                                ring->cond.notify_all();
+                                continue;
+                        }
+                        ring->cond.wait(guard);
+                }
+                if (slot->state != UPLOAD_SLOT_FILLED) {
+                        guard.unlock();
+                        if (ring->thread.joinable()) {
+                                ring->thread.join();
+                        }
+                        return false;
+                }
+        }
+        ring->starve_time += nowSeconds() - start;
+        return true;
+}
+
+bool uploadRingNext(UploadRing *ring, GLuint texture,
+        GLsizei width, GLsizei height, GLenum format)
+{
+        if (!uploadRingWait(ring)) {
+                return false;
+        }
+
+        UploadSlot *slot = ring->slot + ring->submit_idx;
+        ogl(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->pbo));
+        if (!ring->persistent) {
+                ogl(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+        }
+
+        collectQuery(ring, slot);
+        ogl(glBeginQuery(GL_TIME_ELAPSED, slot->query));
+        ogl(glActiveTexture(GL_TEXTURE0));
+        ogl(glBindTexture(GL_TEXTURE_2D, texture));
+        double start = nowSeconds();
+        ogl(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+                format, GL_UNSIGNED_BYTE, 0));
+        ring->call_time += nowSeconds() - start;
+        ogl(glEndQuery(GL_TIME_ELAPSED));
+        slot->query_pending = true;
+
+        if (ring->persistent) {
+                ogl(slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+                std::lock_guard<std::mutex> guard(ring->lock);
+                slot->state = UPLOAD_SLOT_IN_FLIGHT;
+        }
+        else {
+                /* orphan the storage so the next fill never waits on the GPU */
+                ogl(glBufferData(GL_PIXEL_UNPACK_BUFFER, ring->size, NULL,
+                        GL_STREAM_DRAW));
+                mapSlot(ring, slot);
+                {
+                        std::lock_guard<std::mutex> guard(ring->lock);
+                        slot->state = UPLOAD_SLOT_FREE;
+                }
+                ring->cond.notify_all();
+        }
+        ogl(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+
+        ring->submit_idx = (ring->submit_idx + 1) % ring->depth;
+        ring->frames++;
+        return true;
+}
+
+void uploadRingDestroy(UploadRing *ring) {
+        {
+                std::lock_guard<std::mutex> guard(ring->lock);
+                ring->stop = true;
+        }
+        ring->cond.notify_all();
+        if (ring->thread.joinable()) {
+                ring->thread.join();
+        }
+
+        for (int i = 0; i < ring->depth; i++) {
+                UploadSlot *slot = ring->slot + i;
+                if (slot->fence) {
+                        waitSlotFence(ring, slot);
+                }
+                collectQuery(ring, slot);
+                ogl(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->pbo));
+                ogl(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+                ogl(glDeleteBuffers(1, &slot->pbo));
+                ogl(glDeleteQueries(1, &slot->query));
+        }
+        ogl(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+}
+
+/*
+ * Software rasterizers copy the pixels inside glTexSubImage2D and never
+ * show it on the GPU timer, hardware drivers do the opposite, so the
+ * upload cost is whichever of the two is larger.
+ */
+void uploadRingPrintStats(UploadRing *ring) {
+        for (int i = 0; i < ring->depth; i++) {
+                collectQuery(ring, ring->slot + i);
+        }
+
+        double mb = (double)ring->size * ring->frames / (1024 * 1024);
+        double gpu_s = ring->gpu_ns * 1e-9;
+        double upload_s = (gpu_s > ring->call_time) ? gpu_s : ring->call_time;
+        int frames = ring->frames ? ring->frames : 1;
+        fprintf(stderr, "upload ring depth %d (%s): %.1f MB, "
+                "upload %.3f ms/frame = %.1f MB/s "
+                "(GPU timer %.3f ms, driver call %.3f ms), "
+                "reader fill %.3f ms/frame = %.1f MB/s, "
+                "starved %.3f ms/frame, fence wait %.3f ms/frame\n",
+                ring->depth, ring->persistent ? "persistent" : "orphaned",
+                mb, upload_s * 1e3 / frames,
+                upload_s > 0 ? mb / upload_s : 0.0,
+                gpu_s * 1e3 / frames, ring->call_time * 1e3 / frames,
+                ring->fill_time * 1e3 / frames,
+                ring->fill_time > 0 ? mb / ring->fill_time : 0.0,
+                ring->starve_time * 1e3 / frames,
+                ring->fence_time * 1e3 / frames);
+}
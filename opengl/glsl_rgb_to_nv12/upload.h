@@ -0,0 +1,88 @@
+#ifndef __UPLOAD__H__
+#define __UPLOAD__H__
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <GL/glew.h>
+
+#include "frame_io.h"
+
+/*****************************************************************************
+ * Streaming texture upload ring
+ *
+ * A reader thread fills GL_PIXEL_UNPACK_BUFFERs straight from the frame
+ * stream, the GL thread turns each filled buffer into a glTexSubImage2D of
+ * the immutable input texture. Buffers are persistently mapped when
+ * ARB_buffer_storage is available, otherwise they are orphaned and
+ * re-mapped after every upload.
+ ****************************************************************************/
+enum {
+        UPLOAD_MAX_DEPTH = 16,
+};
+
+enum UploadSlotState {
+        UPLOAD_SLOT_FREE,
+        UPLOAD_SLOT_FILLED,
+        UPLOAD_SLOT_IN_FLIGHT,
+};
+
+struct UploadSlot {
+        GLuint pbo;
+        GLuint query;
+        GLsync fence;
+        void *ptr;
+        bool query_pending;
+        UploadSlotState state;
+};
+
+struct UploadRing {
+        UploadSlot slot[UPLOAD_MAX_DEPTH];
+        int depth;
+        size_t size;
+        bool persistent;
+
+        /* next slot for the reader thread and for the GL thread */
+        int fill_idx;
+        int submit_idx;
+        bool eof;
+        bool stop;
+        FrameReader *reader;
+        std::thread thread;
+        std::mutex lock;
+        std::condition_variable cond;
+
+        /* stats */
+        int frames;
+        double fill_time;
+        double starve_time;
+        double fence_time;
+        double call_time;
+        GLuint64 gpu_ns;
+};
+
+void uploadRingInit(UploadRing *ring, int depth, size_t size);
+void uploadRingDestroy(UploadRing *ring);
+
+/* starts the reader thread pulling frames from reader into the ring */
+void uploadRingStart(UploadRing *ring, FrameReader *reader);
+
+/*
+ * Blocks until the reader thread has filled the next frame. Returns false
+ * once the stream is exhausted.
+ */
+bool uploadRingWait(UploadRing *ring);
+
+/*
+ * Uploads the next frame into texture, waiting for it with
+ * uploadRingWait() first. Returns false once the stream is exhausted.
+ */
+bool uploadRingNext(UploadRing *ring, GLuint texture,
+        GLsizei width, GLsizei height, GLenum format);
+
+void uploadRingPrintStats(UploadRing *ring);
+
+#endif //__UPLOAD__H__
@@ -0,0 +1,523 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "opengl_utils.h"
+#include "yuv_engine.h"
+
+/*****************************************************************************
+ * Names
+ ****************************************************************************/
+static const char *format_names[YUV_FORMAT_COUNT] = {
+        "nv12",
+        "nv21",
+        "i420",
+        "yuy2",
+        "p010",
+};
+
+static const char *matrix_names[YUV_MATRIX_COUNT] = {
+        "bt601",
+        "bt709",
+        "bt2020",
+};
+
+static const char *range_names[YUV_RANGE_COUNT] = {
+        "limited",
+        "full",
+};
+
+static int lookupName(const char *const *names, int count, const char *name) {
+        for (int i = 0; i < count; i++) {
+                if (!strcmp(names[i], name)) {
+                        return i;
+                }
+        }
+        return -1;
+}
+
+const char *yuvFormatName(YuvFormat format) {
+        if (format < 0 || format >= YUV_FORMAT_COUNT) {
+                return NULL;
+        }
+        return format_names[format];
+}
+
+const char *yuvMatrixName(YuvMatrix matrix) {
+        if (matrix < 0 || matrix >= YUV_MATRIX_COUNT) {
+                return NULL;
+        }
+        return matrix_names[matrix];
+}
+
+const char *yuvRangeName(YuvRange range) {
+        if (range < 0 || range >= YUV_RANGE_COUNT) {
+                return NULL;
+        }
+        return range_names[range];
+}
+
+int yuvFormatFromName(const char *name) {
+        return lookupName(format_names, YUV_FORMAT_COUNT, name);
+}
+
+int yuvMatrixFromName(const char *name) {
+        return lookupName(matrix_names, YUV_MATRIX_COUNT, name);
+}
+
+int yuvRangeFromName(const char *name) {
+        return lookupName(range_names, YUV_RANGE_COUNT, name);
+}
+
+/*****************************************************************************
+ * Layout
+ ****************************************************************************/
+static void setPlane(YuvPlane *plane, int width, int height, int bpp,
+        GLenum format, GLenum type, size_t stride)
+{
+        plane->width = width;
+        plane->height = height;
+        plane->bpp = bpp;
+        plane->format = format;
+        plane->type = type;
+        plane->stride = stride ? stride : (size_t)width * bpp;
+}
+
+void yuvLayoutInit(YuvLayout *layout, YuvFormat format, int width, int height,
+        size_t y_stride, size_t uv_stride)
+{
+        int cw = (width + 1) / 2;
+        int ch = (height + 1) / 2;
+
+        memset(layout, 0, sizeof(*layout));
+        layout->format = format;
+        switch (format) {
+        case YUV_I420:
+                layout->num_planes = 3;
+                setPlane(&layout->plane[0], width, height, 1,
+                        GL_RED, GL_UNSIGNED_BYTE, y_stride);
+                setPlane(&layout->plane[1], cw, ch, 1,
+                        GL_RED, GL_UNSIGNED_BYTE, uv_stride);
+                setPlane(&layout->plane[2], cw, ch, 1,
+                        GL_RED, GL_UNSIGNED_BYTE, uv_stride);
+                break;
+        case YUV_YUY2:
+                /* one RGBA texel per horizontal pixel pair */
+                layout->num_planes = 1;
+                setPlane(&layout->plane[0], cw, height, 4,
+                        GL_RGBA, GL_UNSIGNED_BYTE, y_stride);
+                break;
+        case YUV_P010:
+                layout->num_planes = 2;
+                setPlane(&layout->plane[0], width, height, 2,
+                        GL_RED, GL_UNSIGNED_SHORT, y_stride);
+                setPlane(&layout->plane[1], cw, ch, 4,
+                        GL_RG, GL_UNSIGNED_SHORT, uv_stride);
+                break;
+        default:
+                layout->num_planes = 2;
+                setPlane(&layout->plane[0], width, height, 1,
+                        GL_RED, GL_UNSIGNED_BYTE, y_stride);
+                setPlane(&layout->plane[1], cw, ch, 2,
+                        GL_RG, GL_UNSIGNED_BYTE, uv_stride);
+                break;
+        }
+
+        size_t offset = 0;
+        for (int i = 0; i < layout->num_planes; i++) {
+                layout->plane[i].offset = offset;
+                offset += layout->plane[i].stride * layout->plane[i].height;
+        }
+        layout->size = offset;
+}
+
+const char *yuvLayoutError(const YuvLayout *layout) {
+        for (int i = 0; i < layout->num_planes; i++) {
+                const YuvPlane *plane = &layout->plane[i];
+                GLint row_length, alignment;
+                if (plane->stride < (size_t)plane->width * plane->bpp) {
+                        return i ? "UV stride shorter than a row"
+                                : "Y stride shorter than a row";
+                }
+                if (!oglRowStrideParams(plane->width, plane->bpp,
+                        plane->stride, &row_length, &alignment))
+                {
+                        return i ? "UV stride is not a multiple of a sample"
+                                : "Y stride is not a multiple of a sample";
+                }
+        }
+        return NULL;
+}
+
+/*****************************************************************************
+ * Shader generation
+ *
+ * Every variant is the prelude with its matrix and range as constants,
+ * followed by the main() of one pass. Samples are computed in integer
+ * code units and rounded before they are scaled to the target's format,
+ * so 8 bit and 16 bit targets store exact codes.
+ ****************************************************************************/
+static const char *vert_position =
+        "#version 120\n"
+        "attribute vec4 position;\n"
+        "void main(void) {\n"
+        "        gl_Position = position;\n"
+        "}\n";
+
+static const char *prelude_format =
+        "#version 120\n"
+        "precision mediump float;\n"
+        "uniform sampler2D tex_input;\n"
+        "uniform vec2 framesize;\n"
+        "const vec4 y_coef = vec4(%.9f, %.9f, %.9f, %.9f);\n"
+        "const vec4 u_coef = vec4(%.9f, %.9f, %.9f, %.9f);\n"
+        "const vec4 v_coef = vec4(%.9f, %.9f, %.9f, %.9f);\n"
+        "const float code_max = %.1f;\n"
+        "const float out_scale = %.12f;\n"
+        "vec4 fetch(vec2 pixel) {\n"
+        "        return vec4(texture2D(tex_input,\n"
+        "                (pixel + vec2(0.5)) / framesize).rgb, 1.0);\n"
+        "}\n"
+        /* the corner shared by a 2x2 block, through the linear sampler */
+        "vec4 fetchBlock(void) {\n"
+        "        return vec4(texture2D(tex_input,\n"
+        "                2.0 * gl_FragCoord.xy / framesize).rgb, 1.0);\n"
+        "}\n"
+        "float quantize(float code) {\n"
+        "        return floor(clamp(code, 0.0, code_max) + 0.5) * out_scale;\n"
+        "}\n"
+        "float luma(vec4 rgb) {\n"
+        "        return quantize(dot(y_coef, rgb));\n"
+        "}\n"
+        "float cb(vec4 rgb) {\n"
+        "        return quantize(dot(u_coef, rgb));\n"
+        "}\n"
+        "float cr(vec4 rgb) {\n"
+        "        return quantize(dot(v_coef, rgb));\n"
+        "}\n";
+
+static const char *main_y =
+        "void main(void) {\n"
+        "        gl_FragData[0] = vec4(luma(fetch(floor(gl_FragCoord.xy))));\n"
+        "}\n";
+
+static const char *main_uv =
+        "void main(void) {\n"
+        "        vec4 rgb = fetchBlock();\n"
+        "        gl_FragData[0] = vec4(cb(rgb), cr(rgb), 0.0, 0.0);\n"
+        "}\n";
+
+static const char *main_vu =
+        "void main(void) {\n"
+        "        vec4 rgb = fetchBlock();\n"
+        "        gl_FragData[0] = vec4(cr(rgb), cb(rgb), 0.0, 0.0);\n"
+        "}\n";
+
+static const char *main_u_v =
+        "void main(void) {\n"
+        "        vec4 rgb = fetchBlock();\n"
+        "        gl_FragData[0] = vec4(cb(rgb));\n"
+        "        gl_FragData[1] = vec4(cr(rgb));\n"
+        "}\n";
+
+/* the last pair of an odd width replicates its left pixel */
+static const char *main_yuy2 =
+        "void main(void) {\n"
+        "        vec2 pair = floor(gl_FragCoord.xy) * vec2(2.0, 1.0);\n"
+        "        vec4 left = fetch(pair);\n"
+        "        vec4 right = fetch(vec2(min(pair.x + 1.0,\n"
+        "                framesize.x - 1.0), pair.y));\n"
+        "        vec4 rgb = 0.5 * (left + right);\n"
+        "        gl_FragData[0] = vec4(luma(left), cb(rgb),\n"
+        "                luma(right), cr(rgb));\n"
+        "}\n";
+
+struct YuvPassDesc {
+        const char *main;
+        /* planes written by the pass, one color attachment each */
+        int first_plane;
+        int num_planes;
+        /* samples through the engine's linear sampler */
+        bool linear;
+};
+
+struct YuvFormatDesc {
+        int bits;
+        int num_passes;
+        YuvPassDesc pass[YUV_MAX_PASSES];
+};
+
+static const YuvFormatDesc format_descs[YUV_FORMAT_COUNT] = {
+        /* NV12 */
+        { 8, 2, { { main_y, 0, 1, false }, { main_uv, 1, 1, true } } },
+        /* NV21 */
+        { 8, 2, { { main_y, 0, 1, false }, { main_vu, 1, 1, true } } },
+        /* I420, U and V through two attachments of one pass */
+        { 8, 2, { { main_y, 0, 1, false }, { main_u_v, 1, 2, true } } },
+        /* YUY2 */
+        { 8, 1, { { main_yuy2, 0, 1, false } } },
+        /* P010 */
+        { 10, 2, { { main_y, 0, 1, false }, { main_uv, 1, 1, true } } },
+};
+
+/* Kr and Kb of each matrix, Kg = 1 - Kr - Kb */
+static const double matrix_kr_kb[YUV_MATRIX_COUNT][2] = {
+        { 0.299, 0.114 },
+        { 0.2126, 0.0722 },
+        { 0.2627, 0.0593 },
+};
+
+static void generatePrelude(char *buf, size_t size, int bits,
+        YuvMatrix matrix, YuvRange range)
+{
+        double kr = matrix_kr_kb[matrix][0];
+        double kb = matrix_kr_kb[matrix][1];
+        double kg = 1.0 - kr - kb;
+        double code_max = (1 << bits) - 1;
+        double unit = 1 << (bits - 8);
+
+        /* code = offset + scale * (normalized Y or Cb/Cr) */
+        double y_scale, y_offset, c_scale, c_offset;
+        if (range == YUV_RANGE_FULL) {
+                y_scale = code_max;
+                y_offset = 0.0;
+                c_scale = code_max;
+                c_offset = 128.0 * unit;
+        }
+        else {
+                y_scale = 219.0 * unit;
+                y_offset = 16.0 * unit;
+                c_scale = 224.0 * unit;
+                c_offset = 128.0 * unit;
+        }
+        double cb_div = 2.0 * (1.0 - kb);
+        double cr_div = 2.0 * (1.0 - kr);
+
+        /* 10 bit codes sit in the top of the 16 bit sample */
+        double out_scale = (bits > 8) ? (1 << (16 - bits)) / 65535.0
+                : 1.0 / code_max;
+
+        snprintf(buf, size, prelude_format,
+                kr * y_scale, kg * y_scale, kb * y_scale, y_offset,
+                -kr / cb_div * c_scale, -kg / cb_div * c_scale,
+                0.5 * c_scale, c_offset,
+                0.5 * c_scale, -kg / cr_div * c_scale,
+                -kb / cr_div * c_scale, c_offset,
+                code_max, out_scale);
+}
+
+static GLuint compileProgram(YuvEngine *engine, const char *prelude,
+        const char *main)
+{
+        const char *frag_source[] = { prelude, main };
+        ProgramDesc desc;
+        programDescInit(&desc);
+        programDescAddStage(&desc, GL_VERTEX_SHADER, 1, &vert_position);
+        programDescAddStage(&desc, GL_FRAGMENT_SHADER, 2, frag_source);
+        desc.attrib[0] = "position";
+
+        /* a variant is needed right away, there is nothing to overlap */
+        GLuint program = programCacheRequest(engine->programs, &desc);
+        programCacheFinish(engine->programs);
+
+        GLint location;
+        ogl(glUseProgram(program));
+        ogl(location = glGetUniformLocation(program, "tex_input"));
+        ogl(glUniform1i(location, 0));
+        ogl(location = glGetUniformLocation(program, "framesize"));
+        ogl(glUniform2f(location, engine->width, engine->height));
+        return program;
+}
+
+static YuvVariant *getVariant(YuvEngine *engine, YuvFormat format,
+        YuvMatrix matrix, YuvRange range)
+{
+        YuvVariant *variant = &engine->variant[format][matrix][range];
+        if (variant->compiled) {
+                engine->hits++;
+                return variant;
+        }
+
+        const YuvFormatDesc *desc = &format_descs[format];
+        char prelude[2048];
+        double start = nowSeconds();
+
+        generatePrelude(prelude, sizeof(prelude), desc->bits, matrix, range);
+        for (int p = 0; p < desc->num_passes; p++) {
+                variant->program[p] = compileProgram(engine, prelude,
+                        desc->pass[p].main);
+        }
+        variant->compiled = true;
+
+        engine->compiles++;
+        engine->compile_time += nowSeconds() - start;
+        return variant;
+}
+
+/*****************************************************************************
+ * Render targets
+ ****************************************************************************/
+static GLenum internalFormat(const YuvPlane *plane) {
+        bool wide = (plane->type == GL_UNSIGNED_SHORT);
+        switch (plane->format) {
+        case GL_RG:
+                return wide ? GL_RG16 : GL_RG8;
+        case GL_RGBA:
+                return wide ? GL_RGBA16 : GL_RGBA8;
+        default:
+                return wide ? GL_R16 : GL_R8;
+        }
+}
+
+static YuvTargets *getTargets(YuvEngine *engine, YuvFormat format) {
+        YuvTargets *targets = &engine->targets[format];
+        if (targets->created) {
+                return targets;
+        }
+
+        const YuvFormatDesc *desc = &format_descs[format];
+        YuvLayout layout;
+        yuvLayoutInit(&layout, format, engine->width, engine->height, 0, 0);
+
+        ogl(glGenTextures(layout.num_planes, targets->texture));
+        for (int i = 0; i < layout.num_planes; i++) {
+                const YuvPlane *plane = &layout.plane[i];
+                ogl(glBindTexture(GL_TEXTURE_2D, targets->texture[i]));
+                ogl(glTexImage2D(GL_TEXTURE_2D, 0, internalFormat(plane),
+                        plane->width, plane->height, 0,
+                        plane->format, plane->type, NULL));
+                ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                        GL_NEAREST));
+                ogl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                        GL_NEAREST));
+        }
+        ogl(glBindTexture(GL_TEXTURE_2D, 0));
+
+        /* one framebuffer per pass, the render area is its smallest plane */
+        ogl(glGenFramebuffers(desc->num_passes, targets->fb));
+        for (int p = 0; p < desc->num_passes; p++) {
+                const YuvPassDesc *pass = &desc->pass[p];
+                ogl(glBindFramebuffer(GL_FRAMEBUFFER, targets->fb[p]));
+                for (int i = 0; i < pass->num_planes; i++) {
+                        ogl(glFramebufferTexture2D(GL_FRAMEBUFFER,
+                                GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D,
+                                targets->texture[pass->first_plane + i], 0));
+                }
+                GLenum status;
+                ogl(status = glCheckFramebufferStatus(GL_FRAMEBUFFER));
+                if (status != GL_FRAMEBUFFER_COMPLETE) {
+                        printf("incomplete %s framebuffer\n",
+                                yuvFormatName(format));
+                        exit(-1);
+                }
+        }
+        ogl(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+
+        targets->created = true;
+        return targets;
+}
+
+/*****************************************************************************
+ * Engine
+ ****************************************************************************/
+void yuvEngineInit(YuvEngine *engine, ProgramCache *programs,
+        int width, int height, void (*draw_quad)(GLuint program))
+{
+        memset(engine, 0, sizeof(*engine));
+        engine->programs = programs;
+        engine->width = width;
+        engine->height = height;
+        engine->draw_quad = draw_quad;
+
+        ogl(glGenSamplers(1, &engine->sampler));
+        ogl(glSamplerParameteri(engine->sampler, GL_TEXTURE_MIN_FILTER,
+                GL_LINEAR));
+        ogl(glSamplerParameteri(engine->sampler, GL_TEXTURE_MAG_FILTER,
+                GL_LINEAR));
+        ogl(glSamplerParameteri(engine->sampler, GL_TEXTURE_WRAP_S,
+                GL_CLAMP_TO_EDGE));
+        ogl(glSamplerParameteri(engine->sampler, GL_TEXTURE_WRAP_T,
+                GL_CLAMP_TO_EDGE));
+}
+
+void yuvEngineDestroy(YuvEngine *engine) {
+        for (int f = 0; f < YUV_FORMAT_COUNT; f++) {
+                const YuvFormatDesc *desc = &format_descs[f];
+                /* the programs belong to the program cache */
+                for (int m = 0; m < YUV_MATRIX_COUNT; m++) {
+                        for (int r = 0; r < YUV_RANGE_COUNT; r++) {
+                                engine->variant[f][m][r].compiled = false;
+                        }
+                }
+
+                YuvTargets *targets = &engine->targets[f];
+                if (targets->created) {
+                        YuvLayout layout;
+                        yuvLayoutInit(&layout, (YuvFormat)f,
+                                engine->width, engine->height, 0, 0);
+                        ogl(glDeleteFramebuffers(desc->num_passes,
+                                targets->fb));
+                        ogl(glDeleteTextures(layout.num_planes,
+                                targets->texture));
+                        targets->created = false;
+                }
+        }
+        ogl(glDeleteSamplers(1, &engine->sampler));
+}
+
+void yuvEngineRender(YuvEngine *engine, GLuint texture, YuvFormat format,
+        YuvMatrix matrix, YuvRange range)
+{
+        static const GLenum buffers[] = {
+                GL_COLOR_ATTACHMENT0,
+                GL_COLOR_ATTACHMENT1,
+                GL_COLOR_ATTACHMENT2,
+        };
+        const YuvFormatDesc *desc = &format_descs[format];
+        YuvVariant *variant = getVariant(engine, format, matrix, range);
+        YuvTargets *targets = getTargets(engine, format);
+        YuvLayout layout;
+        yuvLayoutInit(&layout, format, engine->width, engine->height, 0, 0);
+
+        ogl(glActiveTexture(GL_TEXTURE0));
+        ogl(glBindTexture(GL_TEXTURE_2D, texture));
+        for (int p = 0; p < desc->num_passes; p++) {
+                const YuvPassDesc *pass = &desc->pass[p];
+                const YuvPlane *plane = &layout.plane[pass->first_plane];
+
+                ogl(glBindFramebuffer(GL_FRAMEBUFFER, targets->fb[p]));
+                ogl(glDrawBuffers(pass->num_planes, buffers));
+                ogl(glViewport(0, 0, plane->width, plane->height));
+                ogl(glBindSampler(0, pass->linear ? engine->sampler : 0));
+                engine->draw_quad(variant->program[p]);
+        }
+        ogl(glBindSampler(0, 0));
+}
+
+void yuvEngineReadback(YuvEngine *engine, ReadbackRing *ring,
+        const YuvLayout *layout)
+{
+        const YuvFormatDesc *desc = &format_descs[layout->format];
+        YuvTargets *targets = getTargets(engine, layout->format);
+
+        for (int p = 0; p < desc->num_passes; p++) {
+                const YuvPassDesc *pass = &desc->pass[p];
+                ogl(glBindFramebuffer(GL_READ_FRAMEBUFFER, targets->fb[p]));
+                for (int i = 0; i < pass->num_planes; i++) {
+                        const YuvPlane *plane =
+                                &layout->plane[pass->first_plane + i];
+                        ogl(glReadBuffer(GL_COLOR_ATTACHMENT0 + i));
+                        oglSetRowStride(GL_PACK_ROW_LENGTH, GL_PACK_ALIGNMENT,
+                                plane->width, plane->bpp, plane->stride);
+                        readbackRingRead(ring, plane->offset, 0, 0,
+                                plane->width, plane->height,
+                                plane->format, plane->type);
+                }
+        }
+        ogl(glReadBuffer(GL_COLOR_ATTACHMENT0));
+}
+
+void yuvEnginePrintStats(const YuvEngine *engine) {
+        fprintf(stderr, "yuv engine: %d variants compiled in %.1f ms, "
+                "%d cache hits\n", engine->compiles,
+                engine->compile_time * 1e3, engine->hits);
+}
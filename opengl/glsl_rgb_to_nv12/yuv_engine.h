@@ -0,0 +1,131 @@
+#ifndef __YUV_ENGINE__H__
+#define __YUV_ENGINE__H__
+
+#include <stddef.h>
+
+#include <GL/glew.h>
+
+#include "program_cache.h"
+#include "readback.h"
+
+/*****************************************************************************
+ * RGB -> YUV conversion engine
+ *
+ * Generates the fragment shaders for an output format, matrix and range
+ * with the coefficients baked in as constants. Each variant is compiled
+ * the first time it is rendered and cached for the rest of the run, so
+ * switching formats between streams never recompiles.
+ ****************************************************************************/
+enum YuvFormat {
+        YUV_NV12,
+        YUV_NV21,
+        YUV_I420,
+        /* 4:2:2 packed Y0 U Y1 V */
+        YUV_YUY2,
+        /* NV12 layout, 10 bits in the top of 16 bit samples */
+        YUV_P010,
+        YUV_FORMAT_COUNT,
+};
+
+enum YuvMatrix {
+        YUV_BT601,
+        YUV_BT709,
+        YUV_BT2020,
+        YUV_MATRIX_COUNT,
+};
+
+enum YuvRange {
+        YUV_RANGE_LIMITED,
+        YUV_RANGE_FULL,
+        YUV_RANGE_COUNT,
+};
+
+enum {
+        YUV_MAX_PLANES = 3,
+        YUV_MAX_PASSES = 2,
+};
+
+/* names return NULL / the lookups return -1 when out of range */
+const char *yuvFormatName(YuvFormat format);
+const char *yuvMatrixName(YuvMatrix matrix);
+const char *yuvRangeName(YuvRange range);
+int yuvFormatFromName(const char *name);
+int yuvMatrixFromName(const char *name);
+int yuvRangeFromName(const char *name);
+
+struct YuvPlane {
+        /* in texels of the render target */
+        int width;
+        int height;
+        int bpp;
+        GLenum format;
+        GLenum type;
+        size_t stride;
+        size_t offset;
+};
+
+/* memory layout of one output frame */
+struct YuvLayout {
+        YuvFormat format;
+        int num_planes;
+        YuvPlane plane[YUV_MAX_PLANES];
+        size_t size;
+};
+
+/*
+ * y_stride applies to the first plane, uv_stride to every chroma plane,
+ * 0 means tight rows.
+ */
+void yuvLayoutInit(YuvLayout *layout, YuvFormat format, int width, int height,
+        size_t y_stride, size_t uv_stride);
+/* returns why the strides cannot be read back, NULL if they can */
+const char *yuvLayoutError(const YuvLayout *layout);
+
+struct YuvVariant {
+        GLuint program[YUV_MAX_PASSES];
+        bool compiled;
+};
+
+struct YuvTargets {
+        GLuint fb[YUV_MAX_PASSES];
+        GLuint texture[YUV_MAX_PLANES];
+        bool created;
+};
+
+struct YuvEngine {
+        int width;
+        int height;
+        GLuint sampler;
+        /* owns the variant programs */
+        ProgramCache *programs;
+        /* draws a quad covering the viewport with the given program */
+        void (*draw_quad)(GLuint program);
+
+        YuvVariant variant[YUV_FORMAT_COUNT][YUV_MATRIX_COUNT]
+                [YUV_RANGE_COUNT];
+        YuvTargets targets[YUV_FORMAT_COUNT];
+
+        /* cache stats */
+        int compiles;
+        int hits;
+        double compile_time;
+};
+
+void yuvEngineInit(YuvEngine *engine, ProgramCache *programs,
+        int width, int height, void (*draw_quad)(GLuint program));
+void yuvEngineDestroy(YuvEngine *engine);
+
+/* converts texture unit 0's input texture, compiling the variant if new */
+void yuvEngineRender(YuvEngine *engine, GLuint texture, YuvFormat format,
+        YuvMatrix matrix, YuvRange range);
+
+/*
+ * Reads every plane of the last rendered frame of layout->format into the
+ * ring's next slot. The caller commits the slot.
+ */
+void yuvEngineReadback(YuvEngine *engine, ReadbackRing *ring,
+        const YuvLayout *layout);
+
+void yuvEnginePrintStats(const YuvEngine *engine);
+
+#endif //__YUV_ENGINE__H__
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image_quality.h"
+
+/*****************************************************************************
+ * Compares a raw frame against its golden, see regress.sh. Exits with 0
+ * when PSNR and SSIM reach the thresholds, 1 when not, 2 on errors.
+ ****************************************************************************/
+static const double DefaultMinPsnr = 40.0;
+static const double DefaultMinSsim = 0.99;
+
+static uint8_t *readImage(const char *path, size_t size) {
+        FILE *fin = fopen(path, "rb");
+        if (!fin) {
+                perror(path);
+                return NULL;
+        }
+        uint8_t *buf = (uint8_t*)malloc(size);
+        if (!buf) {
+                perror("malloc");
+                fclose(fin);
+                return NULL;
+        }
+        if (1 != fread(buf, size, 1, fin) || fgetc(fin) != EOF) {
+                fprintf(stderr, "%s: not a %zu byte frame\n", path, size);
+                free(buf);
+                buf = NULL;
+        }
+        fclose(fin);
+        return buf;
+}
+
+static void usage(const char *argv0) {
+        printf("usage: %s --format=rgb24|nv12|i420 --size=WxH "
+                "[--psnr=DB] [--ssim=S] IMAGE GOLDEN\n"
+                "  --psnr   lowest PSNR that passes (default %.0f dB)\n"
+                "  --ssim   lowest SSIM that passes (default %.2f)\n",
+                argv0, DefaultMinPsnr, DefaultMinSsim);
+}
+
+int main(int argc, char **argv) {
+        int format = -1;
+        int width = 0;
+        int height = 0;
+        double min_psnr = DefaultMinPsnr;
+        double min_ssim = DefaultMinSsim;
+        const char *path[2] = { NULL, NULL };
+        int num_paths = 0;
+        for (int i = 1; i < argc; i++) {
+                if (!strncmp(argv[i], "--format=", 9)) {
+                        format = imageFormatFromName(argv[i] + 9);
+                }
+                else if (!strncmp(argv[i], "--size=", 7)) {
+                        sscanf(argv[i] + 7, "%dx%d", &width, &height);
+                }
+                else if (!strncmp(argv[i], "--psnr=", 7)) {
+                        min_psnr = atof(argv[i] + 7);
+                }
+                else if (!strncmp(argv[i], "--ssim=", 7)) {
+                        min_ssim = atof(argv[i] + 7);
+                }
+                else if (argv[i][0] != '-' && num_paths < 2) {
+                        path[num_paths++] = argv[i];
+                }
+                else {
+                        usage(argv[0]);
+                        return 2;
+                }
+        }
+        if (format < 0 || width <= 0 || height <= 0 || num_paths != 2) {
+                usage(argv[0]);
+                return 2;
+        }
+
+        ImageLayout layout;
+        imageLayoutInit(&layout, (ImageFormat)format, width, height);
+        uint8_t *image = readImage(path[0], layout.size);
+        uint8_t *golden = readImage(path[1], layout.size);
+        if (!image || !golden) {
+                free(image);
+                free(golden);
+                return 2;
+        }
+
+        ImageQuality q;
+        imageQuality(&layout, image, golden, &q);
+        bool ok = q.psnr >= min_psnr && q.ssim >= min_ssim;
+        printf("psnr %6.2f dB  ssim %.5f  planes", q.psnr, q.ssim);
+        for (int i = 0; i < layout.num_planes; i++) {
+                printf("  %.2f/%.4f", q.plane[i].psnr, q.plane[i].ssim);
+        }
+        printf("  %s\n", ok ? "ok" : "FAIL");
+
+        free(image);
+        free(golden);
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+#include <math.h>
+#include <string.h>
+
+#include "image_quality.h"
+
+static const char *format_names[IMAGE_FORMAT_COUNT] = {
+        "rgb24", "nv12", "i420",
+};
+
+const char *imageFormatName(ImageFormat format) {
+        return format_names[format];
+}
+
+int imageFormatFromName(const char *name) {
+        for (int f = 0; f < IMAGE_FORMAT_COUNT; f++) {
+                if (!strcmp(name, format_names[f])) {
+                        return f;
+                }
+        }
+        return -1;
+}
+
+static void setPlane(ImagePlane *plane, size_t offset, int width,
+        int height, size_t stride, int step)
+{
+        plane->offset = offset;
+        plane->width = width;
+        plane->height = height;
+        plane->stride = stride;
+        plane->step = step;
+}
+
+void imageLayoutInit(ImageLayout *layout, ImageFormat format,
+        int width, int height)
+{
+        int cw = (width + 1) / 2;
+        int ch = (height + 1) / 2;
+        size_t y_size = (size_t)width * height;
+        layout->format = format;
+        layout->num_planes = 3;
+        switch (format) {
+        case IMAGE_RGB24:
+                for (int c = 0; c < 3; c++) {
+                        setPlane(&layout->plane[c], c, width, height,
+                                (size_t)width * 3, 3);
+                }
+                layout->size = y_size * 3;
+                break;
+        case IMAGE_NV12:
+                setPlane(&layout->plane[0], 0, width, height, width, 1);
+                setPlane(&layout->plane[1], y_size, cw, ch, cw * 2, 2);
+                setPlane(&layout->plane[2], y_size + 1, cw, ch, cw * 2, 2);
+                layout->size = y_size + (size_t)cw * ch * 2;
+                break;
+        default:
+                setPlane(&layout->plane[0], 0, width, height, width, 1);
+                setPlane(&layout->plane[1], y_size, cw, ch, cw, 1);
+                setPlane(&layout->plane[2], y_size + (size_t)cw * ch,
+                        cw, ch, cw, 1);
+                layout->size = y_size + (size_t)cw * ch * 2;
+                break;
+        }
+}
+
+/*****************************************************************************
+ * Metrics
+ ****************************************************************************/
+enum {
+        SSIM_WINDOW = 8,
+        SSIM_STEP = 4,
+};
+
+static double psnr(double mse) {
+        if (mse <= 0.0) {
+                return IMAGE_PSNR_MAX;
+        }
+        double db = 10.0 * log10(255.0 * 255.0 / mse);
+        return db < IMAGE_PSNR_MAX ? db : IMAGE_PSNR_MAX;
+}
+
+static double planeMse(const ImagePlane *p, const uint8_t *a,
+        const uint8_t *b)
+{
+        double sum = 0.0;
+        for (int y = 0; y < p->height; y++) {
+                const uint8_t *ra = a + p->offset + y * p->stride;
+                const uint8_t *rb = b + p->offset + y * p->stride;
+                for (int x = 0; x < p->width; x++) {
+                        int d = ra[x * p->step] - rb[x * p->step];
+                        sum += d * d;
+                }
+        }
+        return sum / ((double)p->width * p->height);
+}
+
+static double windowSsim(const ImagePlane *p, const uint8_t *a,
+        const uint8_t *b, int x0, int y0, int w, int h)
+{
+        const double c1 = (0.01 * 255) * (0.01 * 255);
+        const double c2 = (0.03 * 255) * (0.03 * 255);
+        double sa = 0.0, sb = 0.0, saa = 0.0, sbb = 0.0, sab = 0.0;
+        for (int y = y0; y < y0 + h; y++) {
+                const uint8_t *ra = a + p->offset + y * p->stride;
+                const uint8_t *rb = b + p->offset + y * p->stride;
+                for (int x = x0; x < x0 + w; x++) {
+                        double va = ra[x * p->step];
+                        double vb = rb[x * p->step];
+                        sa += va;
+                        sb += vb;
+                        saa += va * va;
+                        sbb += vb * vb;
+                        sab += va * vb;
+                }
+        }
+        double n = (double)w * h;
+        double ma = sa / n;
+        double mb = sb / n;
+        double va = saa / n - ma * ma;
+        double vb = sbb / n - mb * mb;
+        double cov = sab / n - ma * mb;
+        return (2.0 * ma * mb + c1) * (2.0 * cov + c2)
+                / ((ma * ma + mb * mb + c1) * (va + vb + c2));
+}
+
+/* planes smaller than a window are one window */
+static double planeSsim(const ImagePlane *p, const uint8_t *a,
+        const uint8_t *b)
+{
+        int w = p->width < SSIM_WINDOW ? p->width : SSIM_WINDOW;
+        int h = p->height < SSIM_WINDOW ? p->height : SSIM_WINDOW;
+        double sum = 0.0;
+        int count = 0;
+        for (int y = 0; y + h <= p->height; y += SSIM_STEP) {
+                for (int x = 0; x + w <= p->width; x += SSIM_STEP) {
+                        sum += windowSsim(p, a, b, x, y, w, h);
+                        count++;
+                }
+        }
+        return count ? sum / count : 1.0;
+}
+
+void imageQuality(const ImageLayout *layout, const uint8_t *image,
+        const uint8_t *reference, ImageQuality *quality)
+{
+        double total_mse = 0.0;
+        double total_ssim = 0.0;
+        double pixels = 0.0;
+        for (int i = 0; i < layout->num_planes; i++) {
+                const ImagePlane *p = &layout->plane[i];
+                double n = (double)p->width * p->height;
+                double mse = planeMse(p, image, reference);
+                quality->plane[i].psnr = psnr(mse);
+                quality->plane[i].ssim = planeSsim(p, image, reference);
+                total_mse += mse * n;
+                total_ssim += quality->plane[i].ssim * n;
+                pixels += n;
+        }
+        quality->psnr = psnr(total_mse / pixels);
+        quality->ssim = total_ssim / pixels;
+}
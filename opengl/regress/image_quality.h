@@ -0,0 +1,69 @@
+#ifndef __IMAGE_QUALITY__H__
+#define __IMAGE_QUALITY__H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*****************************************************************************
+ * Image quality metrics
+ *
+ * PSNR and SSIM of 8-bit frames against a reference, per plane and over
+ * the whole frame. Interleaved channels are planes of their own, so RGB24
+ * has three planes and NV12 has Y, U and V. SSIM is the mean over 8x8
+ * windows 4 pixels apart with the usual C1 = (0.01 * 255)^2 and
+ * C2 = (0.03 * 255)^2, the frame's is the mean of its planes weighted by
+ * their pixels.
+ ****************************************************************************/
+enum ImageFormat {
+        IMAGE_RGB24,
+        IMAGE_NV12,
+        IMAGE_I420,
+        IMAGE_FORMAT_COUNT,
+};
+
+enum {
+        IMAGE_MAX_PLANES = 3,
+};
+
+/* PSNR of identical planes, anything above is reported as this */
+static const double IMAGE_PSNR_MAX = 100.0;
+
+/* one channel: pixel x of row y is at offset + y * stride + x * step */
+struct ImagePlane {
+        size_t offset;
+        int width;
+        int height;
+        size_t stride;
+        int step;
+};
+
+struct ImageLayout {
+        ImageFormat format;
+        int num_planes;
+        ImagePlane plane[IMAGE_MAX_PLANES];
+        size_t size;
+};
+
+const char *imageFormatName(ImageFormat format);
+/* -1 for unknown names */
+int imageFormatFromName(const char *name);
+
+/* tight rows, chroma of odd sizes rounds up like cpu_nv12.h */
+void imageLayoutInit(ImageLayout *layout, ImageFormat format,
+        int width, int height);
+
+struct PlaneQuality {
+        double psnr;
+        double ssim;
+};
+
+struct ImageQuality {
+        double psnr;
+        double ssim;
+        PlaneQuality plane[IMAGE_MAX_PLANES];
+};
+
+void imageQuality(const ImageLayout *layout, const uint8_t *image,
+        const uint8_t *reference, ImageQuality *quality);
+
+#endif //__IMAGE_QUALITY__H__
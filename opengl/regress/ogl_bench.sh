@@ -0,0 +1,99 @@
+#!/bin/bash
+#
+# Frame time of the strict and the release ogl() builds.
+#
+# Builds glsl_rgb_to_nv12 and glsl_hexagon twice, once checking glGetError()
+# after every GL call and once with make OGL=release, which leaves errors to
+# the KHR_debug callback (see ogl_debug.h). Every case then runs --rounds
+# times with each build, alternating, on the surfaceless EGL context and
+# keeps its best mean frame time. The tools are left built strict.
+#
+# usage: ogl_bench.sh [--frames=N] [--rounds=N] [CASE...] [VAR=VALUE...]
+#
+# VAR=VALUE arguments go to make, e.g. LDFLAGS for the link.
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+NV12=$ROOT/glsl_rgb_to_nv12
+HEXAGON=$ROOT/glsl_hexagon
+INPUT=$NV12/cat_1024_768.rgb
+
+frames=100
+rounds=3
+only=()
+make_args=()
+for arg in "$@"; do
+        case $arg in
+        --frames=*) frames=${arg#*=} ;;
+        --rounds=*) rounds=${arg#*=} ;;
+        -*)
+                sed -n '/^# usage:/,/^$/s/^# \?//p' "$0"
+                exit 2
+                ;;
+        *=*) make_args+=("$arg") ;;
+        *) only+=("$arg") ;;
+        esac
+done
+
+# name, tool directory and the tool's arguments
+CASES="
+nv12_packed     $NV12     --output-mode=packed
+nv12_planar     $NV12     --output-mode=planar
+nv12_engine     $NV12     --output-mode=engine
+nv12_ladder     $NV12     --ladder=640x480,320x240
+hex_analytic    $HEXAGON
+hex_fused       $HEXAGON  --fuse
+hex_video       $HEXAGON  --video
+"
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# builds the tool in $1 with OGL=$2 into $work/<tool>_$2
+build() {
+        make -s -C "$1" clean >/dev/null 2>&1
+        make -s -C "$1" OGL="$2" "${make_args[@]}" >/dev/null 2>&1 || exit 2
+        cp "$1/test" "$work/$(basename "$1")_$2"
+}
+
+for ogl in release strict; do
+        build "$NV12" $ogl
+        build "$HEXAGON" $ogl
+done
+
+# mean frame time in ms of binary $1 with arguments $2
+frame_time() {
+        # shellcheck disable=SC2086
+        (cd "$work" && "$1" --context=egl --input="$INPUT" \
+                --frame-time="$frames" $2 2>&1) |
+                sed -n 's/^frame time \([0-9.]*\) ms.*/\1/p'
+}
+
+# the smaller of two times, either may be empty
+best() {
+        awk -v a="$1" -v b="$2" 'BEGIN {
+                print (b == "" || (a != "" && a + 0 < b + 0)) ? a : b }'
+}
+
+printf "%-14s %12s %12s %8s\n" case "strict ms" "release ms" diff
+while read -r name dir args; do
+        [ -z "$name" ] && continue
+        if [ ${#only[@]} -gt 0 ] && [[ ! " ${only[*]} " =~ " $name " ]]; then
+                continue
+        fi
+        tool=$work/$(basename "$dir")
+        strict=
+        release=
+        for ((r = 0; r < rounds; r++)); do
+                strict=$(best "$(frame_time "${tool}_strict" "$args")" \
+                        "$strict")
+                release=$(best "$(frame_time "${tool}_release" "$args")" \
+                        "$release")
+        done
+        if [ -z "$strict" ] || [ -z "$release" ]; then
+                printf "%-14s failed\n" "$name"
+                continue
+        fi
+        awk -v n="$name" -v s="$strict" -v r="$release" 'BEGIN {
+                printf "%-14s %12.3f %12.3f %+7.1f%%\n", n, s, r,
+                        (r / s - 1) * 100 }'
+done <<< "$CASES"
@@ -0,0 +1,157 @@
+#!/bin/bash
+#
+# Golden-image regression suite for glsl_rgb_to_nv12 and glsl_hexagon.
+#
+# Runs every case headless on the surfaceless EGL context (llvmpipe where
+# there is no GPU), compares its out.bin to the golden with image_diff and
+# fails when PSNR or SSIM drop below the thresholds, or when the mean frame
+# time is more than --slower percent above the golden's. A case over the
+# limit is timed twice more and keeps its best time, software rendering on
+# a loaded machine is noisy.
+#
+# usage: regress.sh [--update] [--psnr=DB] [--ssim=S] [--slower=PERCENT]
+#                   [--frames=N] [CASE...]
+#
+# Goldens are not checked in: their pixels differ between drivers and their
+# frame times between machines, so a shared set would fail everywhere but
+# where it was recorded. Record them locally with --update on a known good
+# tree, then run without it after every change. They go to golden/, or to
+# $REGRESS_GOLDEN when set.
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+REGRESS=$ROOT/regress
+NV12=$ROOT/glsl_rgb_to_nv12
+HEXAGON=$ROOT/glsl_hexagon
+GOLDEN=${REGRESS_GOLDEN:-$REGRESS/golden}
+INPUT=$NV12/cat_1024_768.rgb
+SIZE=1024x768
+
+update=0
+psnr=40
+ssim=0.99
+slower=25
+frames=20
+only=()
+for arg in "$@"; do
+        case $arg in
+        --update) update=1 ;;
+        --psnr=*) psnr=${arg#*=} ;;
+        --ssim=*) ssim=${arg#*=} ;;
+        --slower=*) slower=${arg#*=} ;;
+        --frames=*) frames=${arg#*=} ;;
+        -*)
+                sed -n '/^# usage:/,/^[^#]/{/^#/s/^# \?//p}' "$0"
+                exit 2
+                ;;
+        *) only+=("$arg") ;;
+        esac
+done
+
+# name, tool directory, out.bin format and the tool's arguments, out.bin is
+# $SIZE unless --scale says else. input.y4m is $INPUT as planar Y4M 4:4:4.
+CASES="
+nv12_packed     $NV12     nv12  --output-mode=packed
+nv12_planar     $NV12     nv12  --output-mode=planar
+nv12_luma4      $NV12     nv12  --output-mode=luma4
+nv12_compute    $NV12     nv12  --output-mode=compute
+nv12_engine     $NV12     nv12  --output-mode=engine
+nv12_bt709      $NV12     nv12  --matrix=bt709 --range=full
+i420_engine     $NV12     i420  --format=i420
+nv12_tiled      $NV12     nv12  --output-mode=planar --tile=300
+nv12_scaled     $NV12     nv12  --scale=640x360 --filter=lanczos3
+nv12_y4m        $NV12     nv12  --stream --input=input.y4m --output=out.bin
+hex_analytic    $HEXAGON  rgb24
+hex_loop        $HEXAGON  rgb24 --grid=loop
+hex_sat_gpu     $HEXAGON  rgb24 --sat=gpu
+hex_sat_cpu     $HEXAGON  rgb24 --sat=cpu
+hex_fused       $HEXAGON  rgb24 --fuse
+hex_shape       $HEXAGON  rgb24 --radius=30 --points=5 --line-width=3
+hex_nv12        $HEXAGON  nv12  --nv12
+hex_cpu         $HEXAGON  rgb24 --cpu --threads=4
+hex_tiled       $HEXAGON  rgb24 --tile=300
+hex_video       $HEXAGON  rgb24 --video
+"
+
+for dir in "$NV12" "$HEXAGON" "$REGRESS"; do
+        make -s -C "$dir" >/dev/null || exit 2
+done
+
+# runs a case in $work, sets log and time
+run_case() {
+        rm -f "$work/out.bin"
+        # shellcheck disable=SC2086
+        log=$(cd "$work" && "$1/test" --context=egl --input="$INPUT" \
+                --frame-time="$frames" $2 2>&1)
+        # --stream reports its rate instead of the frame time
+        time=$(echo "$log" | sed -n -e 's/^frame time \([0-9.]*\) ms.*/\1/p' \
+                -e 's/^startup .* \([0-9.]*\) ms\/frame$/\1/p')
+}
+
+# the time over the golden's in percent, exits with 1 above --slower
+compare_time() {
+        awk -v t="$1" -v g="$2" -v s="$slower" 'BEGIN {
+                d = (t / g - 1) * 100
+                printf "%8.3f ms/frame (golden %.3f, %+.0f%%) %s", t, g, d,
+                        (d > s) ? "SLOWER" : "ok"
+                exit (d > s) }'
+}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+mkdir -p "$GOLDEN"
+"$REGRESS/rgb_to_y4m" --size="$SIZE" "$INPUT" "$work/input.y4m" || exit 2
+
+failed=0
+count=0
+while read -r name dir format args; do
+        [ -n "$name" ] || continue
+        if [ ${#only[@]} -gt 0 ] && [[ ! " ${only[*]} " =~ " $name " ]]; then
+                continue
+        fi
+        count=$((count + 1))
+        run_case "$dir" "$args"
+        if [ ! -f "$work/out.bin" ] || [ -z "$time" ]; then
+                echo "$name: FAIL, no output"
+                echo "$log" | sed 's/^/  /'
+                failed=$((failed + 1))
+                continue
+        fi
+
+        if [ $update = 1 ]; then
+                cp "$work/out.bin" "$GOLDEN/$name.bin"
+                echo "$time" > "$GOLDEN/$name.time"
+                printf "%-14s golden updated, %8.3f ms/frame\n" "$name" "$time"
+                continue
+        fi
+        if [ ! -f "$GOLDEN/$name.bin" ]; then
+                echo "$name: FAIL, no golden, run with --update first"
+                failed=$((failed + 1))
+                continue
+        fi
+
+        size=$SIZE
+        if [[ $args =~ --scale=([0-9]+x[0-9]+) ]]; then
+                size=${BASH_REMATCH[1]}
+        fi
+        quality=$("$REGRESS/image_diff" --format="$format" --size="$size" \
+                --psnr="$psnr" --ssim="$ssim" "$work/out.bin" \
+                "$GOLDEN/$name.bin")
+        quality_status=$?
+        golden_time=$(cat "$GOLDEN/$name.time")
+        best=$time
+        for retry in 1 2; do
+                compare_time "$best" "$golden_time" >/dev/null && break
+                run_case "$dir" "$args"
+                best=$(awk -v a="$best" -v b="$time" \
+                        'BEGIN { print (b != "" && b < a) ? b : a }')
+        done
+        timing=$(compare_time "$best" "$golden_time")
+        time_status=$?
+        printf "%-14s %s\n%14s %s\n" "$name" "$quality" "" "$timing"
+        if [ $quality_status != 0 ] || [ $time_status != 0 ]; then
+                failed=$((failed + 1))
+        fi
+done <<< "$CASES"
+
+echo "$count cases, $failed failed"
+[ $failed = 0 ]
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/*****************************************************************************
+ * Converts a raw RGB24 frame to a one frame YUV4MPEG2 stream of planar
+ * 4:4:4 (C444), BT.601 limited range, for the tools' Y4M input in
+ * regress.sh. Exits with 0 on success, 2 on errors.
+ ****************************************************************************/
+static uint8_t clampByte(int v) {
+        return v < 0 ? 0 : v > 255 ? 255 : (uint8_t)v;
+}
+
+static void usage(const char *argv0) {
+        printf("usage: %s --size=WxH RGB Y4M\n", argv0);
+}
+
+int main(int argc, char **argv) {
+        int width = 0;
+        int height = 0;
+        const char *path[2] = { NULL, NULL };
+        int num_paths = 0;
+        for (int i = 1; i < argc; i++) {
+                if (!strncmp(argv[i], "--size=", 7)) {
+                        sscanf(argv[i] + 7, "%dx%d", &width, &height);
+                }
+                else if (argv[i][0] != '-' && num_paths < 2) {
+                        path[num_paths++] = argv[i];
+                }
+                else {
+                        usage(argv[0]);
+                        return 2;
+                }
+        }
+        if (width <= 0 || height <= 0 || num_paths != 2) {
+                usage(argv[0]);
+                return 2;
+        }
+
+        size_t pixels = (size_t)width * height;
+        uint8_t *rgb = (uint8_t*)malloc(pixels * 3);
+        uint8_t *planes = (uint8_t*)malloc(pixels * 3);
+        FILE *fin = fopen(path[0], "rb");
+        if (!rgb || !planes || !fin || 1 != fread(rgb, pixels * 3, 1, fin)) {
+                fprintf(stderr, "%s: can't read a %dx%d frame\n", path[0],
+                        width, height);
+                if (fin) {
+                        fclose(fin);
+                }
+                free(rgb);
+                free(planes);
+                return 2;
+        }
+        fclose(fin);
+
+        /* 16.16 fixed point */
+        for (size_t i = 0; i < pixels; i++) {
+                int r = rgb[i * 3];
+                int g = rgb[i * 3 + 1];
+                int b = rgb[i * 3 + 2];
+                planes[i] = clampByte((16829 * r + 33039 * g + 6416 * b
+                        + (16 << 16) + 32768) >> 16);
+                planes[pixels + i] = clampByte((-9714 * r - 19071 * g
+                        + 28784 * b + (128 << 16) + 32768) >> 16);
+                planes[pixels * 2 + i] = clampByte((28784 * r - 24103 * g
+                        - 4681 * b + (128 << 16) + 32768) >> 16);
+        }
+
+        FILE *fout = fopen(path[1], "wb");
+        bool ok = fout
+                && fprintf(fout, "YUV4MPEG2 W%d H%d F30:1 Ip A1:1 C444\n"
+                        "FRAME\n", width, height) > 0
+                && 1 == fwrite(planes, pixels * 3, 1, fout);
+        if (fout && fclose(fout)) {
+                ok = false;
+        }
+        if (!ok) {
+                perror(path[1]);
+        }
+        free(rgb);
+        free(planes);
+        return ok ? 0 : 2;
+}